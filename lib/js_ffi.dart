@@ -6,7 +6,9 @@ import 'package:ffi/ffi.dart';
 
 import 'types.dart';
 
-typedef SetupJsContextFunc = Pointer Function(Pointer<JsArgument>, Pointer<JsArgument>, Pointer<JsHandlers>);
+typedef NewJsRuntimeFunc = Pointer Function();
+typedef ReleaseJsRuntimeFunc = Void Function(Pointer);
+typedef SetupJsContextFunc = Pointer Function(Pointer<JsArgument>, Pointer<JsArgument>, Pointer<JsHandlers>, Pointer runtime);
 typedef DeleteJsContextFunc = Void Function(Pointer);
 typedef JsContextActionFunc = Int32 Function(Pointer context, Int32 type, Int32 argc);
 typedef JsContextToStringFunc = Pointer<Utf8> Function(Pointer context, Pointer ptr);
@@ -20,8 +22,25 @@ typedef JsContextExecutePendingJobFunc = Int32 Function(Pointer context);
 typedef JsContextNewPromiseFunc = Pointer Function(Pointer context);
 typedef JsContextBackupFunc = Pointer Function(Pointer context);
 typedef JsContextReverseFunc = Void Function(Pointer context, Pointer backup);
+typedef JsContextRunGCSliceFunc = Int32 Function(Pointer context, Int64 budget);
+typedef JsContextSetGCSliceBudgetFunc = Void Function(Pointer context, Int64 budget);
+typedef JsContextSetGCNurserySizeFunc = Void Function(Pointer context, Int64 size);
+typedef JsContextGetGCStatsFunc = Void Function(Pointer context, Pointer<JsGCStats> stats);
+typedef JsContextSetRegExpCacheSizeFunc = Void Function(Pointer context, Int32 size);
+typedef JsContextGetRegExpCacheStatsFunc = Void Function(Pointer context, Pointer<JsRegExpCacheStats> stats);
+typedef JsContextStartProfilingFunc = Int32 Function(Pointer context, Int64 interval);
+typedef JsContextStopProfilingFunc = Int32 Function(Pointer context, Pointer<Utf8> path);
+typedef JsContextStartAllocProfilingFunc = Int32 Function(Pointer context, Int64 interval);
+typedef JsContextDumpAllocProfileFunc = Int32 Function(Pointer context, Pointer<Utf8> path);
+typedef JsContextStopAllocProfilingFunc = Void Function(Pointer context);
+typedef JsContextWriteHeapSnapshotFunc = Int32 Function(Pointer context, Pointer<Utf8> path, Pointer<Pointer> handles, Int32 count);
+typedef JsContextStartTracingFunc = Int32 Function(Pointer context, Pointer<Utf8> path);
+typedef JsContextStopTracingFunc = Void Function(Pointer context);
+typedef JsContextGetActionStatsFunc = Int32 Function(Pointer context, Int32 dart, Int32 type, Pointer<JsActionStats> stats);
+typedef JsContextSetConsoleFunc = Void Function(Pointer context, Int32 level, Int32 bufferSize, Int32 flags);
+typedef JsContextFlushConsoleFunc = Void Function(Pointer context);
 
-typedef JsPrintHandlerFunc = Void Function(Int32 type, Pointer<Utf8> str);
+typedef JsPrintHandlerFunc = Void Function(Pointer context, Int32 count, Pointer<Int32> levels, Pointer<Pointer<Utf8>> texts);
 typedef JsToDartActionFunc = Int32 Function(Pointer context, Int32 type, Int32 argc);
 
 base class JsHandlers extends Struct {
@@ -30,6 +49,9 @@ base class JsHandlers extends Struct {
 
   external Pointer<NativeFunction<JsPrintHandlerFunc>> print;
   external Pointer<NativeFunction<JsToDartActionFunc>> toDartAction;
+
+  @Int32()
+  external int intrinsics;
 }
 
 base class JsArgument extends Struct {
@@ -45,6 +67,62 @@ base class JsArgument extends Struct {
   external Pointer ptrValue;
 }
 
+const int GC_PAUSE_HISTOGRAM_SIZE = 16;
+
+base class JsGCStats extends Struct {
+  @Int64()
+  external int fullCount;
+
+  @Int64()
+  external int sliceCount;
+
+  @Int64()
+  external int minorCount;
+
+  @Int64()
+  external int totalPause;
+
+  @Int64()
+  external int maxPause;
+
+  @Array(GC_PAUSE_HISTOGRAM_SIZE)
+  external Array<Int64> pauseHistogram;
+}
+
+base class JsRegExpCacheStats extends Struct {
+  @Int64()
+  external int hits;
+
+  @Int64()
+  external int misses;
+
+  @Int64()
+  external int count;
+
+  @Int64()
+  external int size;
+}
+
+const int ACTION_TYPE_COUNT = 128;
+const int ACTION_HISTOGRAM_SIZE = 16;
+
+base class JsActionStats extends Struct {
+  @Int64()
+  external int count;
+
+  @Int64()
+  external int nativeTime;
+
+  @Int64()
+  external int dartTime;
+
+  @Int64()
+  external int maxTime;
+
+  @Array(ACTION_HISTOGRAM_SIZE)
+  external Array<Int64> histogram;
+}
+
 base class JsMember extends Struct {
   external Pointer<Utf8> name;
 
@@ -69,6 +147,8 @@ class JsBinder {
       "libjs_script_plugin.dll" : "libjs_script_plugin.so")
           : DynamicLibrary.process());
 
+  late NewJsRuntimeFunc newJsRuntime;
+  late void Function(Pointer) releaseJsRuntime;
   late SetupJsContextFunc setupJsContext;
   late void Function(Pointer) deleteJsContext;
   late int Function(Pointer context, int type, int argc) action;
@@ -83,8 +163,29 @@ class JsBinder {
   late int Function(Pointer) executePendingJob;
   late Pointer Function(Pointer) backup;
   late void Function(Pointer, Pointer) reverse;
+  late int Function(Pointer, int) runGCSlice;
+  late void Function(Pointer, int) setGCSliceBudget;
+  late void Function(Pointer, int) setGCNurserySize;
+  late void Function(Pointer, Pointer<JsGCStats>) getGCStats;
+  late void Function(Pointer, int) setRegExpCacheSize;
+  late void Function(Pointer, Pointer<JsRegExpCacheStats>) getRegExpCacheStats;
+  late int Function(Pointer, int) startProfiling;
+  late int Function(Pointer, Pointer<Utf8>) stopProfiling;
+  late int Function(Pointer, int) startAllocProfiling;
+  late int Function(Pointer, Pointer<Utf8>) dumpAllocProfile;
+  late void Function(Pointer) stopAllocProfiling;
+  late int Function(Pointer, Pointer<Utf8>, Pointer<Pointer>, int) writeHeapSnapshot;
+  late int Function(Pointer, Pointer<Utf8>) startTracing;
+  late void Function(Pointer) stopTracing;
+  late int Function(Pointer, int, int, Pointer<JsActionStats>) getActionStats;
+  late void Function(Pointer, int, int, int) setConsole;
+  late void Function(Pointer) flushConsole;
 
   JsBinder() {
+    newJsRuntime = nativeGLib
+        .lookup<NativeFunction<NewJsRuntimeFunc>>("newJsRuntime").asFunction();
+    releaseJsRuntime = nativeGLib
+        .lookup<NativeFunction<ReleaseJsRuntimeFunc>>("releaseJsRuntime").asFunction();
     setupJsContext = nativeGLib
         .lookup<NativeFunction<SetupJsContextFunc>>("setupJsContext").asFunction();
     deleteJsContext = nativeGLib
@@ -113,6 +214,40 @@ class JsBinder {
         .lookup<NativeFunction<JsContextBackupFunc>>("jsContextBackup").asFunction();
     reverse = nativeGLib
         .lookup<NativeFunction<JsContextReverseFunc>>("jsContextReverse").asFunction();
+    runGCSlice = nativeGLib
+        .lookup<NativeFunction<JsContextRunGCSliceFunc>>("jsContextRunGCSlice").asFunction();
+    setGCSliceBudget = nativeGLib
+        .lookup<NativeFunction<JsContextSetGCSliceBudgetFunc>>("jsContextSetGCSliceBudget").asFunction();
+    setGCNurserySize = nativeGLib
+        .lookup<NativeFunction<JsContextSetGCNurserySizeFunc>>("jsContextSetGCNurserySize").asFunction();
+    getGCStats = nativeGLib
+        .lookup<NativeFunction<JsContextGetGCStatsFunc>>("jsContextGetGCStats").asFunction();
+    setRegExpCacheSize = nativeGLib
+        .lookup<NativeFunction<JsContextSetRegExpCacheSizeFunc>>("jsContextSetRegExpCacheSize").asFunction();
+    getRegExpCacheStats = nativeGLib
+        .lookup<NativeFunction<JsContextGetRegExpCacheStatsFunc>>("jsContextGetRegExpCacheStats").asFunction();
+    startProfiling = nativeGLib
+        .lookup<NativeFunction<JsContextStartProfilingFunc>>("jsContextStartProfiling").asFunction();
+    stopProfiling = nativeGLib
+        .lookup<NativeFunction<JsContextStopProfilingFunc>>("jsContextStopProfiling").asFunction();
+    startAllocProfiling = nativeGLib
+        .lookup<NativeFunction<JsContextStartAllocProfilingFunc>>("jsContextStartAllocProfiling").asFunction();
+    dumpAllocProfile = nativeGLib
+        .lookup<NativeFunction<JsContextDumpAllocProfileFunc>>("jsContextDumpAllocProfile").asFunction();
+    stopAllocProfiling = nativeGLib
+        .lookup<NativeFunction<JsContextStopAllocProfilingFunc>>("jsContextStopAllocProfiling").asFunction();
+    writeHeapSnapshot = nativeGLib
+        .lookup<NativeFunction<JsContextWriteHeapSnapshotFunc>>("jsContextWriteHeapSnapshot").asFunction();
+    startTracing = nativeGLib
+        .lookup<NativeFunction<JsContextStartTracingFunc>>("jsContextStartTracing").asFunction();
+    stopTracing = nativeGLib
+        .lookup<NativeFunction<JsContextStopTracingFunc>>("jsContextStopTracing").asFunction();
+    getActionStats = nativeGLib
+        .lookup<NativeFunction<JsContextGetActionStatsFunc>>("jsContextGetActionStats").asFunction();
+    setConsole = nativeGLib
+        .lookup<NativeFunction<JsContextSetConsoleFunc>>("jsContextSetConsole").asFunction();
+    flushConsole = nativeGLib
+        .lookup<NativeFunction<JsContextFlushConsoleFunc>>("jsContextFlushConsole").asFunction();
   }
 }
 
@@ -163,6 +298,11 @@ const int JS_ACTION_NEW_ARRAYBUFFER = 14;
 const int JS_ACTION_COMPILE = 15;
 const int JS_ACTION_LOAD_COMPILED = 16;
 const int JS_ACTION_NEW_ARRAY = 17;
+const int JS_ACTION_LOAD_PLUGIN = 18;
+
+// result of an action when results[0] holds the value thrown by the
+// script, the other failures return -1 with a message
+const int ACTION_RESULT_EXCEPTION = -2;
 
 const int JS_ACTION_IS_ARRAY = 100;
 const int JS_ACTION_IS_FUNCTION = 101;
@@ -187,4 +327,17 @@ const int ARG_TYPE_DART_CLASS = 8;
 const int ARG_TYPE_DART_OBJECT = 9;
 const int ARG_TYPE_RAW_POINTER = 10;
 const int ARG_TYPE_PROMISE = 11;
-const int ARG_TYPE_MANAGED_VALUE = 12;
\ No newline at end of file
+const int ARG_TYPE_MANAGED_VALUE = 12;
+
+const int INTRINSIC_OPERATORS   = 1 << 0;
+const int INTRINSIC_BIGFLOAT    = 1 << 1;
+const int INTRINSIC_BIGDECIMAL  = 1 << 2;
+const int INTRINSIC_MATH_MODE   = 1 << 3;
+
+// console levels, also the levels passed to the print handler
+const int CONSOLE_LOG   = 0;
+const int CONSOLE_WARN  = 1;
+const int CONSOLE_ERROR = 2;
+const int CONSOLE_NONE  = 3;
+
+const int CONSOLE_TIMESTAMPS = 1 << 0;
@@ -173,6 +173,84 @@ abstract class JsValue {
   String toString();
 }
 
+/// An exception thrown by a JS script.
+///
+/// The thrown [value] is kept alive as long as the exception, the
+/// [message] and the [stack] are only formatted when they are read.
+class JsException implements Exception {
+  static final Finalizer<JsValue> _finalizer =
+      Finalizer((value) => value.release());
+
+  /// The thrown value, a [JsValue] for the JS objects otherwise one of
+  /// [int], [double], [bool], [String] or null.
+  final dynamic value;
+
+  final dynamic Function()? _readStack;
+
+  /// [readStack] reads the `stack` property of [value], it lets the
+  /// platform skip the read once the script is disposed.
+  JsException(this.value, [dynamic Function()? readStack]) :
+        _readStack = readStack {
+    if (value is JsValue) {
+      value.retain();
+      _finalizer.attach(this, value);
+    }
+  }
+
+  String? _message;
+
+  /// The thrown value converted to a string, like
+  /// "TypeError: not a function".
+  ///
+  /// It is converted when first read. Once the script is disposed, an
+  /// unread message is "[Disposed JsValue]", see [resolve].
+  String get message {
+    if (_message == null) {
+      try {
+        _message = value.toString();
+      } catch (_) {
+        // the conversion ran JS code that threw
+        _message = "[Unprintable JsValue]";
+      }
+    }
+    return _message!;
+  }
+
+  bool _hasStack = false;
+  String? _stack;
+
+  /// The `stack` property of the thrown object if any, null when it
+  /// is first read after the script was disposed.
+  String? get stack {
+    if (!_hasStack) {
+      _hasStack = true;
+      if (value is JsValue && value.type == JsValueType.JsObject) {
+        try {
+          var stack = _readStack == null ? value.get("stack") : _readStack!();
+          if (stack is String) _stack = stack;
+        } catch (_) {
+          // a getter of `stack` threw
+        }
+      }
+    }
+    return _stack;
+  }
+
+  /// Reads [message] and [stack] now, while the script that threw
+  /// [value] is alive, so that they stay available after it is
+  /// disposed.
+  void resolve() {
+    message;
+    stack;
+  }
+
+  @override
+  String toString() {
+    var stack = this.stack;
+    return stack == null ? message : "$message\n$stack";
+  }
+}
+
 abstract class JsCompiled {
   void dispose();
 }
@@ -223,18 +223,27 @@ class IOJsValue extends JsValue {
 
 }
 
-void _printHandler(int type, Pointer<Utf8> str) {
-  switch (type)
-  {
-    case 0:
-      print("[Js:Log] ${str.toDartString()}");
-      break;
-    case 1:
-      print("[Js:Warn] ${str.toDartString()}");
-      break;
-    case 2:
-      print("[Js:Error] ${str.toDartString()}");
-      break;
+void _printHandler(Pointer context, int count, Pointer<Int32> levels, Pointer<Pointer<Utf8>> texts) {
+  var onConsole = IOJsScript._index[context]?.onConsole;
+  for (int i = 0; i < count; ++i) {
+    int level = levels[i];
+    String str = texts[i].toDartString();
+    if (onConsole != null) {
+      onConsole(JsConsoleLevel.values[level], str);
+      continue;
+    }
+    switch (level)
+    {
+      case CONSOLE_LOG:
+        print("[Js:Log] $str");
+        break;
+      case CONSOLE_WARN:
+        print("[Js:Warn] $str");
+        break;
+      case CONSOLE_ERROR:
+        print("[Js:Error] $str");
+        break;
+    }
   }
 }
 
@@ -246,6 +255,100 @@ int _toDartHandler(Pointer context, int type, int argc) {
   return -2;
 }
 
+/// Built-in objects of a new context, see [IOJsScript.new].
+enum JsIntrinsics {
+  /// The ES2020 built-ins, BigInt included.
+  es2020(0),
+
+  /// [es2020] and the operator overloading (`Operators`).
+  operators(INTRINSIC_OPERATORS),
+
+  /// All the bignum extensions: the operator overloading, BigFloat,
+  /// BigDecimal and the "use math" directive.
+  bignum(INTRINSIC_OPERATORS | INTRINSIC_BIGFLOAT | INTRINSIC_BIGDECIMAL | INTRINSIC_MATH_MODE);
+
+  final int flags;
+
+  const JsIntrinsics(this.flags);
+}
+
+/// Minimum level of the console messages, see [IOJsScript.setConsole].
+enum JsConsoleLevel {
+  /// `console.log`, `console.info`, `console.debug`, `console.count`
+  /// and the timers.
+  log(CONSOLE_LOG),
+  warn(CONSOLE_WARN),
+  error(CONSOLE_ERROR),
+
+  /// Drop all the messages.
+  none(CONSOLE_NONE);
+
+  final int value;
+
+  const JsConsoleLevel(this.value);
+}
+
+/// Pauses of the cycle collector, see [IOJsScript.gcStats].
+class GCStats {
+  final int fullCount;
+  final int sliceCount;
+  final int minorCount;
+  final Duration totalPause;
+  final Duration maxPause;
+
+  /// [pauseHistogram][i] is the number of pauses which took from 2^i
+  /// to 2^(i+1) microseconds.
+  final List<int> pauseHistogram;
+
+  GCStats._(JsGCStats stats) :
+        fullCount = stats.fullCount,
+        sliceCount = stats.sliceCount,
+        minorCount = stats.minorCount,
+        totalPause = Duration(microseconds: stats.totalPause),
+        maxPause = Duration(microseconds: stats.maxPause),
+        pauseHistogram = List.generate(GC_PAUSE_HISTOGRAM_SIZE, (i) => stats.pauseHistogram[i]);
+}
+
+/// Usage of the compiled RegExp cache, see [IOJsScript.regExpCacheSize].
+class RegExpCacheStats {
+  final int hits;
+  final int misses;
+
+  /// Number of cached regexps.
+  final int count;
+  final int size;
+
+  RegExpCacheStats._(JsRegExpCacheStats stats) :
+        hits = stats.hits,
+        misses = stats.misses,
+        count = stats.count,
+        size = stats.size;
+}
+
+/// Latency of one action type crossing the bridge, see
+/// [IOJsScript.startTracing].
+class ActionStats {
+  final int count;
+
+  /// Time spent in native code, the nested Dart callbacks excluded.
+  final Duration nativeTime;
+
+  /// Time spent waiting for Dart callbacks.
+  final Duration dartTime;
+  final Duration maxTime;
+
+  /// [histogram][i] is the number of actions which took from 2^i to
+  /// 2^(i+1) microseconds.
+  final List<int> histogram;
+
+  ActionStats._(JsActionStats stats) :
+        count = stats.count,
+        nativeTime = Duration(microseconds: stats.nativeTime),
+        dartTime = Duration(microseconds: stats.dartTime),
+        maxTime = Duration(microseconds: stats.maxTime),
+        histogram = List.generate(ACTION_HISTOGRAM_SIZE, (i) => stats.histogram[i]);
+}
+
 class IOJsCompiled extends JsCompiled {
   Pointer pointer;
   int length;
@@ -301,6 +404,27 @@ class IOJsBuffer extends JsBuffer {
 
 }
 
+/// A JS runtime which could be shared by several [IOJsScript]s.
+///
+/// The atoms, object shapes and the GC heap are shared by the scripts
+/// created with it, so many small scripts warm up faster and use less
+/// memory. The scripts of a runtime must be used on the same thread.
+class IOJsRuntime {
+  final Pointer _runtime;
+  bool _disposed = false;
+
+  IOJsRuntime() : _runtime = binder.newJsRuntime();
+
+  /// Release this runtime, it is freed when all the scripts created
+  /// with it have been disposed.
+  void dispose() {
+    if (!_disposed) {
+      _disposed = true;
+      binder.releaseJsRuntime(_runtime);
+    }
+  }
+}
+
 class IOJsScript extends JsScript {
   static HashMap<Pointer, IOJsScript> _index = HashMap();
 
@@ -320,10 +444,16 @@ class IOJsScript extends JsScript {
   bool _disposed = false;
   void Function(String)? onUncaughtError;
 
+  /// Receives the console messages instead of [print], see
+  /// [setConsole].
+  void Function(JsConsoleLevel level, String message)? onConsole;
+
   IOJsScript({
     this.maxArguments = MAX_ARGUMENTS,
     this.onUncaughtError,
-    fileSystems = const []
+    fileSystems = const [],
+    IOJsRuntime? runtime,
+    JsIntrinsics intrinsics = JsIntrinsics.operators,
   }) : _rawArguments = malloc.allocate(maxArguments * sizeOf<JsArgument>()),
         _rawResults = malloc.allocate(maxArguments * sizeOf<JsArgument>()),
         super.init(fileSystems: fileSystems) {
@@ -338,7 +468,8 @@ class IOJsScript extends JsScript {
     handlers.ref.maxArguments = maxArguments;
     handlers.ref.print = _printHandlerPtr;
     handlers.ref.toDartAction = _toDartHandlerPtr;
-    _context = binder.setupJsContext(_rawArguments, _rawResults, handlers);
+    handlers.ref.intrinsics = intrinsics.flags;
+    _context = binder.setupJsContext(_rawArguments, _rawResults, handlers, runtime?._runtime ?? nullptr);
     _index[_context] = this;
     malloc.free(handlers);
     addClass(ClassInfo<Object>(
@@ -428,13 +559,23 @@ class IOJsScript extends JsScript {
     });
   }
 
+  JsException _exception(dynamic error) {
+    return JsException(error, () {
+      if (_disposed || (error is IOJsValue && error._disposed)) return null;
+      return error.get("stack");
+    });
+  }
+
   dynamic _action(int type, int argc, {
     Function(List<JsArgument> results, int length)? block,
   }) {
     int len = binder.action(_context, type, argc);
     _needClearTemporary();
     if (len < 0) {
-      throw Exception(_results[0].get(this));
+      var error = _results[0].get(this);
+      binder.clearCache(_context);
+      if (len == ACTION_RESULT_EXCEPTION) throw _exception(error);
+      throw Exception(error);
     }
     var ret = block?.call(_results, len);
     binder.clearCache(_context);
@@ -450,7 +591,10 @@ class IOJsScript extends JsScript {
       int ret = binder.executePendingJob(_context);
       if (ret == 0) return;
       else if (ret < 0) {
-        String str = _results[0].get(this);
+        var error = _results[0].get(this);
+        binder.clearCache(_context);
+        // never throws, the formatting falls back on errors
+        String str = _exception(error).toString();
         if (onUncaughtError == null) {
           print("Uncaught $str");
         } else {
@@ -656,7 +800,9 @@ class IOJsScript extends JsScript {
   Pointer _newPromise(Future future) {
     Pointer promise = binder.newPromise(_context);
     if (promise.address == 0) {
-      throw Exception(_results[0].get(this));
+      var error = _results[0].get(this);
+      binder.clearCache(_context);
+      throw _exception(error);
     }
     promiseComplete(bool success, dynamic object) {
       if (_disposed) return;
@@ -720,6 +866,37 @@ class IOJsScript extends JsScript {
     );
   }
 
+  /// Load the native plugin library at [path] and return its exports.
+  ///
+  /// The library must export `js_init_plugin` (see `JS_PluginInitFunction`
+  /// in quickjs_ext.h), which registers its C functions and classes on
+  /// the exports object, so they are called without going through Dart.
+  /// If [name] is given, the exports are also set on the global object.
+  /// A library is loaded once per script and never unloaded.
+  ///
+  /// The plugin must not bundle its own copy of QuickJS. Its `JS_*`
+  /// symbols are resolved from this package's native library, see
+  /// quickjs_ext.h for the link flags of each platform.
+  JsValue loadNativePlugin(String path, {String? name}) {
+    _arguments[0].setString(path, this);
+    if (name != null) {
+      _arguments[1].setString(name, this);
+    } else {
+      _arguments[1].setNull();
+    }
+    return _action(JS_ACTION_LOAD_PLUGIN, 2,
+      block: (results, len) {
+        if (len == 1 && results[0].type == ARG_TYPE_RAW_POINTER) {
+          Pointer rawPtr = results[0].ptrValue;
+          var ptr = binder.retainValue(_context, rawPtr);
+          return IOJsValue._js(this, ptr.ref.ptrValue);
+        } else {
+          throw Exception("Wrong result");
+        }
+      },
+    );
+  }
+
   JsValue? _wrapper;
   JsValue collectionWrap(JsValue value) {
     if (_wrapper == null) {
@@ -780,6 +957,192 @@ class IOJsScript extends JsScript {
       return _action(JS_ACTION_LOAD_COMPILED, 2);
     }
   }
+
+  /// Run the cycle collector for about [budget], could be called
+  /// between frames. Successive calls go through the whole heap.
+  ///
+  /// Return true if the whole heap has been collected.
+  bool runGCSlice(Duration budget) {
+    return binder.runGCSlice(_context, budget.inMicroseconds) != 0;
+  }
+
+  /// Limit the automatic collections to slices of [budget] until the
+  /// heap doubles, null to collect the whole heap each time.
+  set gcSliceBudget(Duration? budget) {
+    binder.setGCSliceBudget(_context, budget?.inMicroseconds ?? 0);
+  }
+
+  /// Collect the objects allocated since the last collection each time
+  /// [size] bytes were allocated, 0 to disable.
+  ///
+  /// Most short lived cycles are then freed without scanning the
+  /// whole heap.
+  set gcNurserySize(int size) {
+    binder.setGCNurserySize(_context, size);
+  }
+
+  GCStats get gcStats {
+    Pointer<JsGCStats> stats = malloc.allocate(sizeOf<JsGCStats>());
+    try {
+      binder.getGCStats(_context, stats);
+      return GCStats._(stats.ref);
+    } finally {
+      malloc.free(stats);
+    }
+  }
+
+  /// Keep the bytecode of the [size] most recently compiled regexps so
+  /// that `new RegExp` and the regexp literals with the same source and
+  /// flags are not compiled again, 0 to disable. Defaults to 64, at most
+  /// 65536.
+  set regExpCacheSize(int size) {
+    binder.setRegExpCacheSize(_context, size);
+  }
+
+  RegExpCacheStats get regExpCacheStats {
+    Pointer<JsRegExpCacheStats> stats = malloc.allocate(sizeOf<JsRegExpCacheStats>());
+    try {
+      binder.getRegExpCacheStats(_context, stats);
+      return RegExpCacheStats._(stats.ref);
+    } finally {
+      malloc.free(stats);
+    }
+  }
+
+  /// Configure the console of the script.
+  ///
+  /// The messages below [level] are dropped before their arguments are
+  /// converted to strings. Up to [bufferSize] messages are kept and
+  /// printed in order, at the latest when the current call into the
+  /// script returns, 0 prints each message immediately. The errors are
+  /// never delayed. With [timestamps] each message starts with the
+  /// milliseconds elapsed since the script was created.
+  void setConsole({
+    JsConsoleLevel level = JsConsoleLevel.log,
+    int bufferSize = 64,
+    bool timestamps = false,
+  }) {
+    binder.setConsole(_context, level.value, bufferSize,
+        timestamps ? CONSOLE_TIMESTAMPS : 0);
+  }
+
+  /// Print the buffered console messages now.
+  void flushConsole() {
+    binder.flushConsole(_context);
+  }
+
+  /// Sample the JS call stack every [interval] of script execution
+  /// until [stopProfiling] is called.
+  void startProfiling({Duration interval = const Duration(milliseconds: 1)}) {
+    if (binder.startProfiling(_context, interval.inMicroseconds) != 0) {
+      throw Exception("Profiler already started");
+    }
+  }
+
+  /// Stop the profiler and write the samples to [path] in the Chrome
+  /// trace event format, which can be opened with chrome://tracing or
+  /// Perfetto. The samples are dropped if [path] is null.
+  void stopProfiling([String? path]) {
+    Pointer<Utf8> str = path?.toNativeUtf8() ?? nullptr;
+    try {
+      if (binder.stopProfiling(_context, str) != 0) {
+        throw Exception("Can not write the profile");
+      }
+    } finally {
+      if (str != nullptr) malloc.free(str);
+    }
+  }
+
+  /// Record the JS stack and the kind (object, string, array or
+  /// bytecode) of an allocation each time [sampleInterval] bytes were
+  /// allocated, until [stopAllocProfiling] is called.
+  void startAllocProfiling({int sampleInterval = 512 * 1024}) {
+    if (binder.startAllocProfiling(_context, sampleInterval) != 0) {
+      throw Exception("Allocation profiler already started");
+    }
+  }
+
+  /// Write the sampled allocations which are still alive to [path] in
+  /// the folded stacks format, read by flamegraph.pl and speedscope.
+  void dumpAllocProfile(String path) {
+    Pointer<Utf8> str = path.toNativeUtf8();
+    try {
+      if (binder.dumpAllocProfile(_context, str) != 0) {
+        throw Exception("Can not write the allocation profile");
+      }
+    } finally {
+      malloc.free(str);
+    }
+  }
+
+  void stopAllocProfiling() {
+    binder.stopAllocProfiling(_context);
+  }
+
+  /// Run the GC and write the heap to [path] in the V8 .heapsnapshot
+  /// format, which can be loaded in the Memory panel of the Chrome
+  /// DevTools.
+  ///
+  /// The values held by Dart are reported under the "(Host handles)"
+  /// root and the instances of the Dart classes have a "(native)" child.
+  void writeHeapSnapshot(String path) {
+    Pointer<Utf8> str = path.toNativeUtf8();
+    // each cached value holds one reference to its JS object
+    Pointer<Pointer> handles = _cache.isEmpty ? nullptr :
+        malloc.allocate(sizeOf<Pointer>() * _cache.length);
+    try {
+      for (int i = 0; i < _cache.length; ++i) {
+        handles[i] = _cache[i]._ptr;
+      }
+      if (binder.writeHeapSnapshot(_context, str, handles, _cache.length) != 0) {
+        throw Exception("Can not write the heap snapshot");
+      }
+    } finally {
+      if (handles != nullptr) malloc.free(handles);
+      malloc.free(str);
+    }
+  }
+
+  /// Record the count and the latency of each JS_ACTION and
+  /// DART_ACTION type until [stopTracing] is called. If [path] is set,
+  /// every action is also written to it as a Chrome trace event.
+  void startTracing([String? path]) {
+    Pointer<Utf8> str = path?.toNativeUtf8() ?? nullptr;
+    try {
+      if (binder.startTracing(_context, str) != 0) {
+        throw Exception("Can not start tracing");
+      }
+    } finally {
+      if (str != nullptr) malloc.free(str);
+    }
+  }
+
+  /// Stop tracing, drop the statistics and close the trace file.
+  void stopTracing() {
+    binder.stopTracing(_context);
+  }
+
+  Map<int, ActionStats> _actionStats(bool dart) {
+    Map<int, ActionStats> map = {};
+    Pointer<JsActionStats> stats = malloc.allocate(sizeOf<JsActionStats>());
+    try {
+      for (int type = 0; type < ACTION_TYPE_COUNT; ++type) {
+        if (binder.getActionStats(_context, dart ? 1 : 0, type, stats) != 0) break;
+        if (stats.ref.count > 0) map[type] = ActionStats._(stats.ref);
+      }
+    } finally {
+      malloc.free(stats);
+    }
+    return map;
+  }
+
+  /// Statistics of the JS_ACTION types called from Dart since
+  /// [startTracing], by type.
+  Map<int, ActionStats> get jsActionStats => _actionStats(false);
+
+  /// Statistics of the DART_ACTION callbacks called from JS since
+  /// [startTracing], by type.
+  Map<int, ActionStats> get dartActionStats => _actionStats(true);
 }
 
 const int _Int32Max = 2147483647;
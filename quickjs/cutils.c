@@ -29,6 +29,14 @@
 
 #include "cutils.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CUTILS_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CUTILS_NEON
+#endif
+
 void pstrcpy(char *buf, int buf_size, const char *str)
 {
     int c;
@@ -303,6 +311,168 @@ int unicode_from_utf8(const uint8_t *p, int max_len, const uint8_t **pp)
     return c;
 }
 
+/* string kernels: SSE2 and NEON are part of the base x86_64 and
+   aarch64 ABIs, other targets use the portable loops */
+
+/* return the number of leading ASCII bytes of 'buf' */
+size_t ascii_span(const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+#if defined(CUTILS_SSE2)
+    for(; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(buf + i)));
+        if (mask != 0)
+            return i + ctz32(mask);
+    }
+#elif defined(CUTILS_NEON)
+    for(; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(buf + i)) >= 0x80)
+            break;
+    }
+#else
+    for(; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, buf + i, 8);
+        if (v & 0x8080808080808080)
+            break;
+    }
+#endif
+    while (i < len && buf[i] < 0x80)
+        i++;
+    return i;
+}
+
+/* return the number of leading characters of 'buf' which are < 0x100 */
+size_t latin1_span16(const uint16_t *buf, size_t len)
+{
+    size_t i = 0;
+#if defined(CUTILS_SSE2)
+    const __m128i hi = _mm_set1_epi16((short)0xff00);
+    for(; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        v = _mm_cmpeq_epi16(_mm_and_si128(v, hi), _mm_setzero_si128());
+        if (_mm_movemask_epi8(v) != 0xffff)
+            break;
+    }
+#elif defined(CUTILS_NEON)
+    for(; i + 8 <= len; i += 8) {
+        if (vmaxvq_u16(vld1q_u16(buf + i)) > 0xff)
+            break;
+    }
+#endif
+    while (i < len && buf[i] < 0x100)
+        i++;
+    return i;
+}
+
+/* return the index of the first occurrence of 'c' in 'buf' or 'len' */
+size_t memchr16(const uint16_t *buf, uint16_t c, size_t len)
+{
+    size_t i = 0;
+#if defined(CUTILS_SSE2)
+    const __m128i vc = _mm_set1_epi16(c);
+    for(; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, vc));
+        if (mask != 0)
+            return i + (ctz32(mask) >> 1);
+    }
+#elif defined(CUTILS_NEON)
+    const uint16x8_t vc = vdupq_n_u16(c);
+    for(; i + 8 <= len; i += 8) {
+        if (vmaxvq_u16(vceqq_u16(vld1q_u16(buf + i), vc)) != 0)
+            break;
+    }
+#endif
+    while (i < len && buf[i] != c)
+        i++;
+    return i;
+}
+
+/* return the index of the first difference between 'a' and 'b' or 'len' */
+size_t memdiff16(const uint16_t *a, const uint16_t *b, size_t len)
+{
+    size_t i = 0;
+#if defined(CUTILS_SSE2)
+    for(; i + 8 <= len; i += 8) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(b + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v1, v2)) ^ 0xffff;
+        if (mask != 0)
+            return i + (ctz32(mask) >> 1);
+    }
+#elif defined(CUTILS_NEON)
+    for(; i + 8 <= len; i += 8) {
+        if (vminvq_u16(vceqq_u16(vld1q_u16(a + i), vld1q_u16(b + i))) == 0)
+            break;
+    }
+#endif
+    while (i < len && a[i] == b[i])
+        i++;
+    return i;
+}
+
+/* same as memdiff16() with 8 bit characters in 'b' */
+size_t memdiff16_8(const uint16_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+#if defined(CUTILS_SSE2)
+    for(; i + 8 <= len; i += 8) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i v2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(b + i)),
+                                       _mm_setzero_si128());
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v1, v2)) ^ 0xffff;
+        if (mask != 0)
+            return i + (ctz32(mask) >> 1);
+    }
+#elif defined(CUTILS_NEON)
+    for(; i + 8 <= len; i += 8) {
+        uint16x8_t v2 = vmovl_u8(vld1_u8(b + i));
+        if (vminvq_u16(vceqq_u16(vld1q_u16(a + i), v2)) == 0)
+            break;
+    }
+#endif
+    while (i < len && a[i] == b[i])
+        i++;
+    return i;
+}
+
+/* convert the ASCII letters of 'src' to lower case (or upper case if
+   'to_lower' is false). Other bytes are copied unchanged. */
+void ascii_case_conv(uint8_t *dst, const uint8_t *src, size_t len,
+                     int to_lower)
+{
+    size_t i = 0;
+    int first = to_lower ? 'A' : 'a';
+#if defined(CUTILS_SSE2)
+    /* c - first < 26 as a signed comparison biased by 0x80 */
+    const __m128i bias = _mm_set1_epi8((char)(0x80 - first));
+    const __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i m = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+        v = _mm_xor_si128(v, _mm_and_si128(m, flip));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+#elif defined(CUTILS_NEON)
+    const uint8x16_t vfirst = vdupq_n_u8(first);
+    const uint8x16_t limit = vdupq_n_u8(26);
+    const uint8x16_t flip = vdupq_n_u8(0x20);
+    for(; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x16_t m = vcltq_u8(vsubq_u8(v, vfirst), limit);
+        vst1q_u8(dst + i, veorq_u8(v, vandq_u8(m, flip)));
+    }
+#endif
+    for(; i < len; i++) {
+        int c = src[i];
+        if ((unsigned)(c - first) < 26)
+            c ^= 0x20;
+        dst[i] = c;
+    }
+}
+
 #if 0
 
 #if defined(EMSCRIPTEN) || defined(__ANDROID__)
@@ -294,4 +294,12 @@ void rqsort(void *base, size_t nmemb, size_t size,
             int (*cmp)(const void *, const void *, void *),
             void *arg);
 
+size_t ascii_span(const uint8_t *buf, size_t len);
+size_t latin1_span16(const uint16_t *buf, size_t len);
+size_t memchr16(const uint16_t *buf, uint16_t c, size_t len);
+size_t memdiff16(const uint16_t *a, const uint16_t *b, size_t len);
+size_t memdiff16_8(const uint16_t *a, const uint8_t *b, size_t len);
+void ascii_case_conv(uint8_t *dst, const uint8_t *src, size_t len,
+                     int to_lower);
+
 #endif  /* CUTILS_H */
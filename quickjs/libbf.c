@@ -45,13 +45,16 @@
 //#define inline __attribute__((always_inline))
 
 #ifdef __AVX2__
-#define FFT_MUL_THRESHOLD 100 /* in limbs of the smallest factor */
+#define FFT_MUL_THRESHOLD 400 /* in limbs of the smallest factor */
 #else
-#define FFT_MUL_THRESHOLD 100 /* in limbs of the smallest factor */
+#define FFT_MUL_THRESHOLD 400 /* in limbs of the smallest factor */
 #endif
 
+/* below, the schoolbook multiplication is used */
+#define KARATSUBA_MUL_THRESHOLD 24 /* in limbs of the smallest factor */
+
 /* XXX: adjust */
-#define DIVNORM_LARGE_THRESHOLD 50
+#define DIVNORM_LARGE_THRESHOLD 400
 #define UDIV1NORM_THRESHOLD 3
 
 #if LIMB_BITS == 64
@@ -1171,6 +1174,162 @@ static void mp_mul_basecase(limb_t *result,
     }
 }
 
+/* return -1, 0 or 1 */
+static int mp_cmp(const limb_t *taba, const limb_t *tabb, mp_size_t n)
+{
+    mp_size_t i;
+    for(i = n - 1; i >= 0; i--) {
+        if (taba[i] != tabb[i]) {
+            if (taba[i] < tabb[i])
+                return -1;
+            else
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* tabr[0..n-1] = |a - b| where 'a' has na limbs, 'b' has nb limbs
+   and na, nb <= n. Return 1 if a < b. */
+static int mp_sub_abs(limb_t *tabr, const limb_t *taba, limb_t na,
+                      const limb_t *tabb, limb_t nb, limb_t n)
+{
+    const limb_t *tmp;
+    limb_t i, borrow;
+    int neg;
+
+    /* compare a and b */
+    neg = 0;
+    if (na < nb) {
+        for(i = na; i < nb; i++) {
+            if (tabb[i] != 0) {
+                neg = 1;
+                goto done;
+            }
+        }
+    } else {
+        for(i = nb; i < na; i++) {
+            if (taba[i] != 0)
+                goto done;
+        }
+    }
+    neg = (mp_cmp(taba, tabb, bf_min(na, nb)) < 0);
+ done:
+    if (neg) {
+        tmp = taba;
+        taba = tabb;
+        tabb = tmp;
+        i = na;
+        na = nb;
+        nb = i;
+    }
+    memcpy(tabr, taba, na * sizeof(limb_t));
+    memset(tabr + na, 0, (n - na) * sizeof(limb_t));
+    borrow = mp_sub(tabr, tabr, tabb, nb, 0);
+    mp_sub_ui(tabr + nb, borrow, n - nb);
+    return neg;
+}
+
+/* size of the temporary buffer of mp_mul_karatsuba() */
+static limb_t mp_mul_karatsuba_tmp_size(limb_t n)
+{
+    limb_t size, h;
+    size = 0;
+    while (n >= KARATSUBA_MUL_THRESHOLD) {
+        h = n - n / 2;
+        size += 6 * h;
+        n = h;
+    }
+    return size;
+}
+
+/* tabr[0..2n-1] = taba[0..n-1] * tabb[0..n-1]. 'tmp' has
+   mp_mul_karatsuba_tmp_size(n) limbs. */
+static void mp_mul_karatsuba(limb_t *tabr, const limb_t *taba,
+                             const limb_t *tabb, limb_t n, limb_t *tmp)
+{
+    limb_t m, h, c, *da, *db, *t, *w;
+    int sa, sb;
+
+    if (n < KARATSUBA_MUL_THRESHOLD) {
+        mp_mul_basecase(tabr, taba, n, tabb, n);
+        return;
+    }
+    /* a = a1 * B^m + a0 and b = b1 * B^m + b0. a1 and b1 have h >= m
+       limbs. */
+    m = n / 2;
+    h = n - m;
+    da = tmp;
+    db = da + h;
+    t = db + h;
+    w = t + 2 * h;
+    tmp = w + 2 * h;
+    
+    /* t = |a0 - a1| * |b1 - b0| */
+    sa = mp_sub_abs(da, taba, m, taba + m, h, h);
+    sb = mp_sub_abs(db, tabb + m, h, tabb, m, h);
+    mp_mul_karatsuba(t, da, db, h, tmp);
+    
+    /* a0 * b0 and a1 * b1 */
+    mp_mul_karatsuba(tabr, taba, tabb, m, tmp);
+    mp_mul_karatsuba(tabr + 2 * m, taba + m, tabb + m, h, tmp);
+
+    /* w = a0 * b1 + a1 * b0 = a0 * b0 + a1 * b1 + (a0 - a1) * (b1 - b0) */
+    memcpy(w, tabr, 2 * m * sizeof(limb_t));
+    memset(w + 2 * m, 0, 2 * (h - m) * sizeof(limb_t));
+    c = mp_add(w, w, tabr + 2 * m, 2 * h, 0);
+    if (sa ^ sb)
+        c -= mp_sub(w, w, t, 2 * h, 0);
+    else
+        c += mp_add(w, w, t, 2 * h, 0);
+    
+    c += mp_add(tabr + m, tabr + m, w, 2 * h, 0);
+    mp_add_ui(tabr + m + 2 * h, c, m);
+}
+
+/* same as mp_mul() without FFT. Return 0 if OK, -1 if memory error */
+static int mp_mul_nofft(bf_context_t *s, limb_t *result,
+                        const limb_t *op1, limb_t op1_size,
+                        const limb_t *op2, limb_t op2_size)
+{
+    limb_t n, i, l, c, tmp_size, *tmp, *prod;
+    
+    if (op1_size < op2_size) {
+        const limb_t *t = op1;
+        op1 = op2;
+        op2 = t;
+        n = op1_size;
+        op1_size = op2_size;
+        op2_size = n;
+    }
+    n = op2_size;
+    if (n < KARATSUBA_MUL_THRESHOLD) {
+        mp_mul_basecase(result, op1, op1_size, op2, op2_size);
+        return 0;
+    }
+    tmp_size = mp_mul_karatsuba_tmp_size(n);
+    tmp = bf_malloc(s, (tmp_size + 2 * n) * sizeof(limb_t));
+    if (!tmp)
+        return -1;
+    prod = tmp + tmp_size;
+    /* op1 is cut in pieces of n limbs */
+    mp_mul_karatsuba(result, op1, op2, n, tmp);
+    for(i = n; i < op1_size; i += n) {
+        l = bf_min(n, op1_size - i);
+        if (l == n) {
+            mp_mul_karatsuba(prod, op1 + i, op2, n, tmp);
+        } else if (mp_mul_nofft(s, prod, op2, n, op1 + i, l)) {
+            bf_free(s, tmp);
+            return -1;
+        }
+        c = mp_add(result + i, result + i, prod, n, 0);
+        memcpy(result + i + n, prod + n, l * sizeof(limb_t));
+        mp_add_ui(result + i + n, c, l);
+    }
+    bf_free(s, tmp);
+    return 0;
+}
+
 /* return 0 if OK, -1 if memory error */
 /* XXX: change API so that result can be allocated */
 int mp_mul(bf_context_t *s, limb_t *result, 
@@ -1188,7 +1347,7 @@ int mp_mul(bf_context_t *s, limb_t *result,
     } else
 #endif
     {
-        mp_mul_basecase(result, op1, op1_size, op2, op2_size);
+        return mp_mul_nofft(s, result, op1, op1_size, op2, op2_size);
     }
     return 0;
 }
@@ -1411,21 +1570,6 @@ int mp_recip(bf_context_t *s, limb_t *tabr, const limb_t *taba, limb_t n)
     return -1;
 }
 
-/* return -1, 0 or 1 */
-static int mp_cmp(const limb_t *taba, const limb_t *tabb, mp_size_t n)
-{
-    mp_size_t i;
-    for(i = n - 1; i >= 0; i--) {
-        if (taba[i] != tabb[i]) {
-            if (taba[i] < tabb[i])
-                return -1;
-            else
-                return 1;
-        }
-    }
-    return 0;
-}
-
 //#define DEBUG_DIVNORM_LARGE
 //#define DEBUG_DIVNORM_LARGE2
 
@@ -1590,7 +1734,8 @@ int bf_mul(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
                 ret = BF_ST_MEM_ERROR;
                 goto done;
             }
-            mp_mul_basecase(r->tab, a_tab, a_len, b_tab, b_len);
+            if (mp_mul_nofft(r->ctx, r->tab, a_tab, a_len, b_tab, b_len))
+                goto fail;
         }
         r->sign = r_sign;
         r->expn = a->expn + b->expn;
@@ -1857,6 +2002,207 @@ int bf_remquo(slimb_t *pq, bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
     return ret;
 }
 
+/* tabr[0..n-1] = |a| where 'a' is an integer < 2^(n * LIMB_BITS) */
+static void bf_get_limbs(limb_t *tabr, limb_t n, const bf_t *a)
+{
+    slimb_t pos;
+    limb_t i;
+
+    if (a->expn == BF_EXP_ZERO) {
+        memset(tabr, 0, n * sizeof(limb_t));
+        return;
+    }
+    /* position of the bit of weight 1 */
+    pos = a->len * LIMB_BITS - a->expn;
+    for(i = 0; i < n; i++)
+        tabr[i] = get_bits(a->tab, a->len, pos + i * LIMB_BITS);
+}
+
+/* r = tab[0..n-1] */
+static int bf_set_limbs(bf_t *r, const limb_t *tab, limb_t n)
+{
+    if (bf_resize(r, n)) {
+        bf_set_nan(r);
+        return BF_ST_MEM_ERROR;
+    }
+    memcpy(r->tab, tab, n * sizeof(limb_t));
+    r->sign = 0;
+    r->expn = n * LIMB_BITS;
+    return bf_normalize_and_round(r, BF_PREC_INF, BF_RNDZ);
+}
+
+/* return -1/m mod 2^LIMB_BITS. 'm' must be odd */
+static limb_t mp_mont_inv(limb_t m)
+{
+    limb_t x;
+    int i;
+    /* x is exact on 3 bits and each iteration doubles the precision */
+    x = m;
+    for(i = 0; i < LIMB_LOG2_BITS - 1; i++)
+        x *= 2 - m * x;
+    return -x;
+}
+
+/* Montgomery multiplication: tabr[0..n-1] = a * b / 2^(n * LIMB_BITS)
+   mod m with a, b < m. 'tabt' has 2 * n + 1 limbs. Return 0 if OK, -1
+   if memory error. */
+static int mp_mont_mul(bf_context_t *s, limb_t *tabr, const limb_t *taba,
+                       const limb_t *tabb, const limb_t *tabm, limb_t n,
+                       limb_t m_inv, limb_t *tabt)
+{
+    limb_t i, u, c;
+
+    if (mp_mul(s, tabt, taba, n, tabb, n))
+        return -1;
+    tabt[2 * n] = 0;
+    for(i = 0; i < n; i++) {
+        u = tabt[i] * m_inv;
+        c = mp_add_mul1(tabt + i, tabm, n, u);
+        mp_add_ui(tabt + i + n, c, n + 1 - i);
+    }
+    /* the result is < 2 * m */
+    if (tabt[2 * n] != 0 || mp_cmp(tabt + n, tabm, n) >= 0)
+        mp_sub(tabr, tabt + n, tabm, n, 0);
+    else
+        memcpy(tabr, tabt + n, n * sizeof(limb_t));
+    return 0;
+}
+
+#define POW_MOD_WINDOW_BITS 4
+
+/* r = a^b mod m with 'a' in [0, m), 'm' odd and 'b' > 0 */
+static int bf_pow_mod_mont(bf_t *r, const bf_t *a, const bf_t *b,
+                           const bf_t *m)
+{
+    bf_context_t *s = r->ctx;
+    limb_t n, i, m_inv, w, *tabm, *tabx, *tabt, *tabp, *buf;
+    slimb_t j, b_pos;
+    int ret;
+    bf_t t_s, *t = &t_s, t1_s, *t1 = &t1_s;
+
+    n = (m->expn + LIMB_BITS - 1) / LIMB_BITS;
+    /* m, x, t and the powers of a */
+    buf = bf_malloc(s, ((4 + (1 << POW_MOD_WINDOW_BITS)) * n + 1) *
+                    sizeof(limb_t));
+    if (!buf)
+        goto fail;
+    tabm = buf;
+    tabx = tabm + n;
+    tabt = tabx + n;
+    tabp = tabt + 2 * n + 1;
+    bf_get_limbs(tabm, n, m);
+    m_inv = mp_mont_inv(tabm[0]);
+
+    /* tabp[0] = 2^(n * LIMB_BITS) mod m and tabp[1] = a * 2^(n *
+       LIMB_BITS) mod m */
+    bf_init(s, t);
+    bf_init(s, t1);
+    ret = bf_set_ui(t, 1);
+    ret |= bf_mul_2exp(t, n * LIMB_BITS, BF_PREC_INF, BF_RNDZ);
+    ret |= bf_rem(t1, t, m, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
+    bf_get_limbs(tabp, n, t1);
+    ret |= bf_set(t, a);
+    ret |= bf_mul_2exp(t, n * LIMB_BITS, BF_PREC_INF, BF_RNDZ);
+    ret |= bf_rem(t1, t, m, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
+    bf_get_limbs(tabp + n, n, t1);
+    bf_delete(t);
+    bf_delete(t1);
+    if (ret & BF_ST_MEM_ERROR)
+        goto fail;
+    for(i = 2; i < (1 << POW_MOD_WINDOW_BITS); i++) {
+        if (mp_mont_mul(s, tabp + i * n, tabp + (i - 1) * n, tabp + n,
+                        tabm, n, m_inv, tabt))
+            goto fail;
+    }
+
+    /* fixed window exponentiation from the most significant bits */
+    b_pos = b->len * LIMB_BITS - b->expn;
+    j = ((b->expn - 1) / POW_MOD_WINDOW_BITS) * POW_MOD_WINDOW_BITS;
+    w = get_bits(b->tab, b->len, b_pos + j) &
+        ((1 << POW_MOD_WINDOW_BITS) - 1);
+    memcpy(tabx, tabp + w * n, n * sizeof(limb_t));
+    for(j -= POW_MOD_WINDOW_BITS; j >= 0; j -= POW_MOD_WINDOW_BITS) {
+        for(i = 0; i < POW_MOD_WINDOW_BITS; i++) {
+            if (mp_mont_mul(s, tabx, tabx, tabx, tabm, n, m_inv, tabt))
+                goto fail;
+        }
+        w = get_bits(b->tab, b->len, b_pos + j) &
+            ((1 << POW_MOD_WINDOW_BITS) - 1);
+        if (w != 0) {
+            if (mp_mont_mul(s, tabx, tabx, tabp + w * n, tabm, n, m_inv,
+                            tabt))
+                goto fail;
+        }
+    }
+
+    /* convert back from the Montgomery representation */
+    memset(tabp, 0, n * sizeof(limb_t));
+    tabp[0] = 1;
+    if (mp_mont_mul(s, tabx, tabx, tabp, tabm, n, m_inv, tabt))
+        goto fail;
+    ret = bf_set_limbs(r, tabx, n);
+    bf_free(s, buf);
+    return ret;
+ fail:
+    bf_free(s, buf);
+    bf_set_nan(r);
+    return BF_ST_MEM_ERROR;
+}
+
+/* r = a^b mod m with 'a', 'b' and 'm' integers, b >= 0 and m >= 1. The
+   result is in [0, m). */
+int bf_pow_mod(bf_t *r, const bf_t *a, const bf_t *b, const bf_t *m)
+{
+    bf_context_t *s = r->ctx;
+    bf_t x_s, *x = &x_s, a1_s, *a1 = &a1_s, t_s, *t = &t_s;
+    slimb_t i;
+    int ret;
+
+    if (!bf_is_finite(a) || !bf_is_finite(b) || !bf_is_finite(m) ||
+        b->sign || m->sign || bf_is_zero(m)) {
+        bf_set_nan(r);
+        return BF_ST_INVALID_OP;
+    }
+    bf_init(s, a1);
+    bf_init(s, x);
+    ret = bf_rem(a1, a, m, BF_PREC_INF, BF_RNDZ, BF_DIVREM_EUCLIDIAN);
+    if (ret & BF_ST_MEM_ERROR)
+        goto done;
+    if (bf_is_zero(b)) {
+        /* 1 mod m */
+        ret = bf_set_ui(x, m->expn > 1);
+    } else if (bf_is_zero(a1)) {
+        bf_set_zero(x, 0);
+    } else if (get_bit(m->tab, m->len, m->len * LIMB_BITS - m->expn)) {
+        /* odd modulus */
+        ret = bf_pow_mod_mont(x, a1, b, m);
+    } else {
+        /* binary exponentiation with divisions */
+        bf_init(s, t);
+        ret = bf_set(x, a1);
+        for(i = b->expn - 2; i >= 0; i--) {
+            ret |= bf_mul(t, x, x, BF_PREC_INF, BF_RNDZ);
+            ret |= bf_rem(x, t, m, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
+            if (get_bit(b->tab, b->len, b->len * LIMB_BITS - b->expn + i)) {
+                ret |= bf_mul(t, x, a1, BF_PREC_INF, BF_RNDZ);
+                ret |= bf_rem(x, t, m, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
+            }
+            if (ret & BF_ST_MEM_ERROR)
+                break;
+        }
+        bf_delete(t);
+    }
+ done:
+    bf_delete(a1);
+    if (ret & BF_ST_MEM_ERROR) {
+        bf_delete(x);
+        bf_set_nan(r);
+        return BF_ST_MEM_ERROR;
+    }
+    bf_move(r, x);
+    return 0;
+}
+
 static __maybe_unused inline limb_t mul_mod(limb_t a, limb_t b, limb_t m)
 {
     dlimb_t t;
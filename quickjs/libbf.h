@@ -295,6 +295,8 @@ int bf_rem(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
            bf_flags_t flags, int rnd_mode);
 int bf_remquo(slimb_t *pq, bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
               bf_flags_t flags, int rnd_mode);
+/* r = a^b mod m for integers with b >= 0 and m >= 1 */
+int bf_pow_mod(bf_t *r, const bf_t *a, const bf_t *b, const bf_t *m);
 /* round to integer with infinite precision */
 int bf_rint(bf_t *r, int rnd_mode);
 int bf_round(bf_t *r, limb_t prec, bf_flags_t flags);
@@ -101,10 +101,29 @@ static const REOpCode reopcode_info[REOP_COUNT] = {
 };
 
 #define RE_HEADER_FLAGS         0
-#define RE_HEADER_CAPTURE_COUNT 1
-#define RE_HEADER_STACK_SIZE    2
-
-#define RE_HEADER_LEN 7
+#define RE_HEADER_CAPTURE_COUNT 2
+#define RE_HEADER_STACK_SIZE    3
+#define RE_HEADER_BYTECODE_LEN  4
+
+#define RE_HEADER_LEN 8
+
+/* length of the 'split_goto_first, any, goto' loop which starts the
+   non sticky regexps */
+#define RE_SEARCH_LOOP_LEN 11
+
+/* The prefilter follows the bytecode when LRE_FLAG_PREFILTER is set:
+   u8 literal_len, u8 high, u8 bitmap[32], u16 literal[literal_len].
+   Every match starts with a character of the bitmap ('high' is set if
+   a character >= 256 can start a match) and with 'literal' if
+   literal_len != 0. */
+#define RE_PREFILTER_LITERAL_MAX 16
+#define RE_PREFILTER_BITMAP      2
+#define RE_PREFILTER_LITERAL     34
+
+static inline int re_prefilter_size(const uint8_t *pf)
+{
+    return RE_PREFILTER_LITERAL + pf[0] * 2;
+}
 
 static inline int is_digit(int c) {
     return c >= '0' && c <= '9';
@@ -279,16 +298,22 @@ static __maybe_unused void lre_dump_bytecode(const uint8_t *buf,
     
     assert(buf_len >= RE_HEADER_LEN);
 
-    re_flags=  buf[0];
-    bc_len = get_u32(buf + 3);
+    re_flags = get_u16(buf + RE_HEADER_FLAGS);
+    bc_len = get_u32(buf + RE_HEADER_BYTECODE_LEN);
     assert(bc_len + RE_HEADER_LEN <= buf_len);
     printf("flags: 0x%x capture_count=%d stack_size=%d\n",
-           re_flags, buf[1], buf[2]);
+           re_flags, buf[RE_HEADER_CAPTURE_COUNT], buf[RE_HEADER_STACK_SIZE]);
+    if (re_flags & LRE_FLAG_PREFILTER) {
+        const uint8_t *pf = buf + RE_HEADER_LEN + bc_len;
+        printf("prefilter: high=%d literal_len=%d\n", pf[1], pf[0]);
+    }
     if (re_flags & LRE_FLAG_NAMED_GROUPS) {
         const char *p;
         p = (char *)buf + RE_HEADER_LEN + bc_len;
+        if (re_flags & LRE_FLAG_PREFILTER)
+            p += re_prefilter_size((uint8_t *)p);
         printf("named groups: ");
-        for(i = 1; i < buf[1]; i++) {
+        for(i = 1; i < buf[RE_HEADER_CAPTURE_COUNT]; i++) {
             if (i != 1)
                 printf(",");
             printf("<%s>", p);
@@ -391,6 +416,12 @@ static __maybe_unused void lre_dump_bytecode(const uint8_t *buf,
 }
 #endif
 
+static void re_set_header_flag(REParseState *s, int flag)
+{
+    uint8_t *p = s->byte_code.buf + RE_HEADER_FLAGS;
+    put_u16(p, get_u16(p) | flag);
+}
+
 static void re_emit_op(REParseState *s, int op)
 {
     dbuf_putc(&s->byte_code, op);
@@ -1814,6 +1845,218 @@ static int compute_stack_size(const uint8_t *bc_buf, int bc_buf_len)
     return stack_size_max;
 }
 
+/* return TRUE if the regexp cannot be executed by the linear time
+   engine, i.e. it has back references or lookarounds */
+static BOOL re_need_backtrack(const uint8_t *bc_buf, int bc_buf_len)
+{
+    int pos, opcode, len;
+
+    bc_buf += RE_HEADER_LEN;
+    bc_buf_len -= RE_HEADER_LEN;
+    pos = 0;
+    while (pos < bc_buf_len) {
+        opcode = bc_buf[pos];
+        len = reopcode_info[opcode].size;
+        switch(opcode) {
+        case REOP_back_reference:
+        case REOP_backward_back_reference:
+        case REOP_lookahead:
+        case REOP_negative_lookahead:
+        case REOP_prev:
+            return TRUE;
+        case REOP_range:
+            len += get_u16(bc_buf + pos + 1) * 4;
+            break;
+        case REOP_range32:
+            len += get_u16(bc_buf + pos + 1) * 8;
+            break;
+        }
+        pos += len;
+    }
+    return FALSE;
+}
+
+typedef struct {
+    BOOL is_utf16;
+    BOOL ignore_case;
+    BOOL high;
+    uint8_t bitmap[32];
+} REFirstCharSet;
+
+static void re_first_char_add(REFirstCharSet *fc, uint32_t c)
+{
+    fc->bitmap[c >> 3] |= 1 << (c & 7);
+}
+
+/* 'c' is canonicalized if ignore_case */
+static void re_first_char_add_char(REFirstCharSet *fc, uint32_t c)
+{
+    uint32_t c1;
+    if (fc->ignore_case) {
+        for(c1 = 0; c1 < 256; c1++) {
+            if (lre_canonicalize(c1, fc->is_utf16) == c)
+                re_first_char_add(fc, c1);
+        }
+        fc->high = TRUE;
+    } else if (c < 256) {
+        re_first_char_add(fc, c);
+    } else {
+        fc->high = TRUE;
+    }
+}
+
+static void re_first_char_add_range(REFirstCharSet *fc, const uint8_t *p,
+                                    int n, BOOL is_range32)
+{
+    uint32_t low, high, c, c1;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        if (is_range32) {
+            low = get_u32(p + i * 8);
+            high = get_u32(p + i * 8 + 4);
+        } else {
+            low = get_u16(p + i * 4);
+            high = get_u16(p + i * 4 + 2);
+        }
+        if (fc->ignore_case) {
+            /* the ranges contain canonicalized characters */
+            for(c1 = 0; c1 < 256; c1++) {
+                c = lre_canonicalize(c1, fc->is_utf16);
+                if (c >= low && c <= high)
+                    re_first_char_add(fc, c1);
+            }
+            fc->high = TRUE;
+        } else {
+            for(c = low; c <= high && c < 256; c++)
+                re_first_char_add(fc, c);
+            if (high >= 256)
+                fc->high = TRUE;
+        }
+    }
+}
+
+/* add to 'fc' the characters which can start a match at 'pos'. Return
+   -1 if a match can be empty or can start with any character. */
+static int re_first_char_set(REFirstCharSet *fc, const uint8_t *bc_buf,
+                             int bc_buf_len, int pos, int depth)
+{
+    int opcode, len, pos1;
+    uint32_t val;
+
+    if (depth > 8)
+        return -1;
+    for(;;) {
+        if (pos >= bc_buf_len)
+            return -1;
+        opcode = bc_buf[pos];
+        len = reopcode_info[opcode].size;
+        switch(opcode) {
+        case REOP_save_start:
+        case REOP_save_end:
+        case REOP_save_reset:
+            pos += len;
+            break;
+        case REOP_goto:
+            val = get_u32(bc_buf + pos + 1);
+            if ((int)val < 0)
+                return -1;
+            pos += len + (int)val;
+            break;
+        case REOP_split_goto_first:
+        case REOP_split_next_first:
+            val = get_u32(bc_buf + pos + 1);
+            if ((int)val < 0)
+                return -1;
+            if (re_first_char_set(fc, bc_buf, bc_buf_len, pos + len + (int)val,
+                                  depth + 1))
+                return -1;
+            pos += len;
+            break;
+        case REOP_simple_greedy_quant:
+            /* the quantified atom is followed by 'next_pos' */
+            if (get_u32(bc_buf + pos + 1 + 4) == 0) {
+                pos1 = pos + len + get_u32(bc_buf + pos + 1);
+                if (re_first_char_set(fc, bc_buf, bc_buf_len, pos1, depth + 1))
+                    return -1;
+            }
+            pos += len;
+            break;
+        case REOP_char:
+            re_first_char_add_char(fc, get_u16(bc_buf + pos + 1));
+            return 0;
+        case REOP_char32:
+            re_first_char_add_char(fc, get_u32(bc_buf + pos + 1));
+            return 0;
+        case REOP_range:
+        case REOP_range32:
+            re_first_char_add_range(fc, bc_buf + pos + 3,
+                                    get_u16(bc_buf + pos + 1),
+                                    opcode == REOP_range32);
+            return 0;
+        default:
+            return -1;
+        }
+    }
+}
+
+/* Append the prefilter of the regexp to the bytecode if it does not
+   start with a character of a small set. Only used for the non sticky
+   regexps which try to match at every position. */
+static void re_emit_prefilter(REParseState *s)
+{
+    REFirstCharSet fc_s, *fc = &fc_s;
+    uint16_t literal[RE_PREFILTER_LITERAL_MAX];
+    const uint8_t *bc_buf;
+    int bc_buf_len, pos, literal_len, i;
+    uint32_t c;
+
+    bc_buf = s->byte_code.buf + RE_HEADER_LEN;
+    bc_buf_len = s->byte_code.size - RE_HEADER_LEN;
+    memset(fc, 0, sizeof(*fc));
+    fc->is_utf16 = s->is_utf16;
+    fc->ignore_case = s->ignore_case;
+    if (re_first_char_set(fc, bc_buf, bc_buf_len, RE_SEARCH_LOOP_LEN, 0))
+        return;
+    if (fc->high) {
+        /* not selective enough to be worth it */
+        for(i = 0; i < 32; i++) {
+            if (fc->bitmap[i] != 0)
+                break;
+        }
+        if (i == 32)
+            return;
+    }
+
+    /* leading literal string */
+    literal_len = 0;
+    if (!s->ignore_case) {
+        pos = RE_SEARCH_LOOP_LEN;
+        while (pos < bc_buf_len && literal_len < RE_PREFILTER_LITERAL_MAX) {
+            if (bc_buf[pos] == REOP_save_start ||
+                bc_buf[pos] == REOP_save_end) {
+                pos += reopcode_info[bc_buf[pos]].size;
+            } else if (bc_buf[pos] == REOP_char) {
+                c = get_u16(bc_buf + pos + 1);
+                /* a surrogate may be half of a character in UTF-16 mode */
+                if (s->is_utf16 && c >= 0xd800 && c <= 0xdfff)
+                    break;
+                literal[literal_len++] = c;
+                pos += 3;
+            } else {
+                break;
+            }
+        }
+    }
+
+    dbuf_putc(&s->byte_code, literal_len);
+    dbuf_putc(&s->byte_code, fc->high);
+    dbuf_put(&s->byte_code, fc->bitmap, 32);
+    for(i = 0; i < literal_len; i++)
+        dbuf_put_u16(&s->byte_code, literal[i]);
+    re_set_header_flag(s, LRE_FLAG_PREFILTER);
+}
+
 /* 'buf' must be a zero terminated UTF-8 string of length buf_len.
    Return NULL if error and allocate an error message in *perror_msg,
    otherwise the compiled bytecode and its length in plen.
@@ -1843,7 +2086,7 @@ uint8_t *lre_compile(int *plen, char *error_msg, int error_msg_size,
     dbuf_init2(&s->byte_code, opaque, lre_realloc);
     dbuf_init2(&s->group_names, opaque, lre_realloc);
 
-    dbuf_putc(&s->byte_code, re_flags); /* first element is the flags */
+    dbuf_put_u16(&s->byte_code, re_flags); /* first element is the flags */
     dbuf_putc(&s->byte_code, 0); /* second element is the number of captures */
     dbuf_putc(&s->byte_code, 0); /* stack size */
     dbuf_put_u32(&s->byte_code, 0); /* bytecode length */
@@ -1888,14 +2131,25 @@ uint8_t *lre_compile(int *plen, char *error_msg, int error_msg_size,
         goto error;
     }
     
+    if (!re_need_backtrack(s->byte_code.buf, s->byte_code.size)) {
+        re_set_header_flag(s, LRE_FLAG_NFA);
+    } else if (re_flags & LRE_FLAG_LINEAR) {
+        re_parse_error(s, "regular expression requires backtracking");
+        goto error;
+    }
+
     s->byte_code.buf[RE_HEADER_CAPTURE_COUNT] = s->capture_count;
     s->byte_code.buf[RE_HEADER_STACK_SIZE] = stack_size;
-    put_u32(s->byte_code.buf + 3, s->byte_code.size - RE_HEADER_LEN);
+    put_u32(s->byte_code.buf + RE_HEADER_BYTECODE_LEN,
+            s->byte_code.size - RE_HEADER_LEN);
+
+    if (!is_sticky)
+        re_emit_prefilter(s);
 
     /* add the named groups if needed */
     if (s->group_names.size > (s->capture_count - 1)) {
         dbuf_put(&s->byte_code, s->group_names.buf, s->group_names.size);
-        s->byte_code.buf[RE_HEADER_FLAGS] |= LRE_FLAG_NAMED_GROUPS;
+        re_set_header_flag(s, LRE_FLAG_NAMED_GROUPS);
     }
     dbuf_free(&s->group_names);
     
@@ -2045,8 +2299,33 @@ typedef struct {
     uint8_t *state_stack;
     size_t state_stack_size;
     size_t state_stack_len;
+
+    /* when more than 'backtrack_limit' states are backtracked, the
+       execution is aborted and restarted with the linear time engine */
+    size_t backtrack_count;
+    size_t backtrack_limit;
+    BOOL backtrack_limit_hit;
+
+    int interrupt_counter; /* steps before the next lre_check_timeout() */
+    BOOL interrupted;
 } REExecContext;
 
+#define INTERRUPT_COUNTER_INIT 10000
+
+/* return TRUE if the execution must be aborted */
+static BOOL lre_poll_timeout(REExecContext *s, int steps)
+{
+    s->interrupt_counter -= steps;
+    if (likely(s->interrupt_counter > 0))
+        return FALSE;
+    s->interrupt_counter = INTERRUPT_COUNTER_INIT;
+    if (lre_check_timeout(s->opaque)) {
+        s->interrupted = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 static int push_state(REExecContext *s,
                       uint8_t **capture,
                       StackInt *stack, size_t stack_len,
@@ -2118,6 +2397,14 @@ static intptr_t lre_exec_backtrack(REExecContext *s, uint8_t **capture,
                 for(;;) {
                     if (s->state_stack_len == 0)
                         return ret;
+                    if (!ret) {
+                        if (unlikely(++s->backtrack_count > s->backtrack_limit)) {
+                            s->backtrack_limit_hit = TRUE;
+                            return -1;
+                        }
+                        if (lre_poll_timeout(s, 1))
+                            return -1;
+                    }
                     rs = (REExecState *)(s->state_stack +
                                          (s->state_stack_len - 1) * s->state_size);
                     if (rs->type == RE_EXEC_STATE_SPLIT) {
@@ -2493,18 +2780,554 @@ static intptr_t lre_exec_backtrack(REExecContext *s, uint8_t **capture,
     }
 }
 
-/* Return 1 if match, 0 if not match or -1 if error. cindex is the
-   starting position of the match and must be such as 0 <= cindex <=
-   clen. */
+/* Linear time execution (Pike VM) of the regexps without back
+   references nor lookarounds. The threads are kept in priority order
+   and only the first thread reaching a state at a given position is
+   kept, so the result is the same as with the backtracking engine. The
+   counters are stored as 'count << 1' in the stack of the threads and
+   the character positions as 'offset << 1 | 1' so that only their
+   equality with the current position is compared. A simple greedy
+   quantifier pushes its offset and its count, its atom ends with
+   REOP_match. */
+
+#define RE_BACKTRACK_LIMIT  50000 /* minimum backtracked states before fallback */
+#define RE_BACKTRACK_FACTOR 16    /* ... plus this number per character */
+
+typedef struct {
+    const uint8_t *pc;
+    int stack_len;
+    void *buf[0]; /* capture_count * 2 captures followed by the stack */
+} RENFAThread;
+
+typedef struct {
+    uint8_t *tab;
+    int len;
+    int size;
+} RENFAList;
+
+typedef struct {
+    REExecContext *s;
+    const uint8_t *bc_buf;
+    const uint8_t *match_pc; /* final REOP_match */
+    int stack_size;
+    size_t thread_size;
+    size_t state_size;
+    /* visited states at the current position: generation of the last
+       visit of each pc with an empty stack, the other states are
+       listed */
+    uint32_t *visited;
+    uint32_t gen;
+    RENFAList visited_states;
+    const uint8_t *cptr; /* current position */
+    StackInt cptr_tag;
+    RENFAList *list; /* threads at the next position */
+} RENFAContext;
+
+static void *re_nfa_list_add(RENFAContext *n, RENFAList *l, size_t elem_size)
+{
+    if (l->len >= l->size) {
+        int new_size = max_int(l->size * 3 / 2, 16);
+        uint8_t *new_tab = lre_realloc(n->s->opaque, l->tab, new_size * elem_size);
+        if (!new_tab)
+            return NULL;
+        l->tab = new_tab;
+        l->size = new_size;
+    }
+    return l->tab + (l->len++) * elem_size;
+}
+
+/* Return 1 if the state was already visited at this position, 0 if not
+   and -1 if memory error. */
+static int re_nfa_visited(RENFAContext *n, const uint8_t *pc,
+                          const StackInt *stack, int stack_len)
+{
+    RENFAThread *t;
+    StackInt *tstack, v;
+    int i, j;
+
+    if (stack_len == 0) {
+        uint32_t *p = &n->visited[pc - n->bc_buf];
+        if (*p == n->gen)
+            return 1;
+        *p = n->gen;
+        return 0;
+    }
+    for(i = 0; i < n->visited_states.len; i++) {
+        t = (RENFAThread *)(n->visited_states.tab + i * n->state_size);
+        if (t->pc != pc || t->stack_len != stack_len)
+            continue;
+        tstack = (StackInt *)t->buf;
+        for(j = 0; j < stack_len; j++) {
+            v = stack[j];
+            if (v & 1)
+                v = (v == n->cptr_tag);
+            if (tstack[j] != v)
+                break;
+        }
+        if (j == stack_len)
+            return 1;
+    }
+    t = re_nfa_list_add(n, &n->visited_states, n->state_size);
+    if (!t)
+        return -1;
+    t->pc = pc;
+    t->stack_len = stack_len;
+    tstack = (StackInt *)t->buf;
+    for(j = 0; j < stack_len; j++) {
+        v = stack[j];
+        if (v & 1)
+            v = (v == n->cptr_tag);
+        tstack[j] = v;
+    }
+    return 0;
+}
+
+static int re_nfa_add_thread(RENFAContext *n, const uint8_t *pc,
+                             uint8_t **capture, StackInt *stack, int stack_len)
+{
+    RENFAThread *t;
+    int capture_count = n->s->capture_count;
+
+    t = re_nfa_list_add(n, n->list, n->thread_size);
+    if (!t)
+        return -1;
+    t->pc = pc;
+    t->stack_len = stack_len;
+    memcpy(t->buf, capture, sizeof(capture[0]) * 2 * capture_count);
+    memcpy(t->buf + 2 * capture_count, stack, sizeof(stack[0]) * stack_len);
+    return 0;
+}
+
+static int re_nfa_add(RENFAContext *n, const uint8_t *pc,
+                      uint8_t **capture, StackInt *stack, int stack_len);
+
+/* simple greedy quantifier whose count is at the top of the stack */
+static int re_nfa_quant(RENFAContext *n, const uint8_t *pc,
+                        uint8_t **capture, StackInt *stack, int stack_len)
+{
+    uint32_t quant_min, quant_max, q;
+
+    quant_min = get_u32(pc + 5);
+    quant_max = get_u32(pc + 9);
+    q = stack[stack_len - 1] >> 1;
+    if (q < quant_max) {
+        if (re_nfa_add(n, pc + 17, capture, stack, stack_len))
+            return -1;
+    }
+    if (q >= quant_min)
+        return re_nfa_add(n, pc + 17 + (int)get_u32(pc + 1), capture, stack,
+                          stack_len - 2);
+    return 0;
+}
+
+/* follow the transitions which do not consume characters from 'pc' at
+   the current position and add the resulting threads to n->list */
+static int re_nfa_add(RENFAContext *n, const uint8_t *pc,
+                      uint8_t **capture, StackInt *stack, int stack_len)
+{
+    REExecContext *s = n->s;
+    int cbuf_type = s->cbuf_type;
+    const uint8_t *cptr = n->cptr;
+    int opcode, ret, idx;
+    uint32_t val, c;
+    StackInt old;
+
+    if (lre_check_stack_overflow(s->opaque, 0))
+        return -1;
+    for(;;) {
+        ret = re_nfa_visited(n, pc, stack, stack_len);
+        if (ret)
+            return ret < 0 ? -1 : 0;
+        opcode = *pc;
+        switch(opcode) {
+        case REOP_goto:
+            pc += 5 + (int)get_u32(pc + 1);
+            break;
+        case REOP_split_goto_first:
+        case REOP_split_next_first:
+            val = get_u32(pc + 1);
+            if (opcode == REOP_split_next_first) {
+                if (re_nfa_add(n, pc + 5, capture, stack, stack_len))
+                    return -1;
+                pc += 5 + (int)val;
+            } else {
+                if (re_nfa_add(n, pc + 5 + (int)val, capture, stack, stack_len))
+                    return -1;
+                pc += 5;
+            }
+            break;
+        case REOP_save_start:
+        case REOP_save_end:
+            {
+                uint8_t *old_capture;
+                idx = 2 * pc[1] + opcode - REOP_save_start;
+                old_capture = capture[idx];
+                capture[idx] = (uint8_t *)cptr;
+                ret = re_nfa_add(n, pc + 2, capture, stack, stack_len);
+                capture[idx] = old_capture;
+                return ret;
+            }
+        case REOP_save_reset:
+            {
+                uint8_t **saved;
+                int start = 2 * pc[1], count = 2 * (pc[2] - pc[1] + 1);
+                saved = alloca(sizeof(capture[0]) * count);
+                memcpy(saved, capture + start, sizeof(capture[0]) * count);
+                for(idx = 0; idx < count; idx++)
+                    capture[start + idx] = NULL;
+                ret = re_nfa_add(n, pc + 3, capture, stack, stack_len);
+                memcpy(capture + start, saved, sizeof(capture[0]) * count);
+                return ret;
+            }
+        case REOP_push_i32:
+        case REOP_push_char_pos:
+            old = stack[stack_len];
+            if (opcode == REOP_push_i32)
+                stack[stack_len] = (StackInt)get_u32(pc + 1) << 1;
+            else
+                stack[stack_len] = n->cptr_tag;
+            ret = re_nfa_add(n, pc + reopcode_info[opcode].size, capture, stack,
+                             stack_len + 1);
+            stack[stack_len] = old;
+            return ret;
+        case REOP_drop:
+            stack_len--;
+            pc++;
+            break;
+        case REOP_loop:
+            old = stack[stack_len - 1];
+            stack[stack_len - 1] = old - 2;
+            if (stack[stack_len - 1] != 0)
+                ret = re_nfa_add(n, pc + 5 + (int)get_u32(pc + 1), capture,
+                                 stack, stack_len);
+            else
+                ret = re_nfa_add(n, pc + 5, capture, stack, stack_len);
+            stack[stack_len - 1] = old;
+            return ret;
+        case REOP_bne_char_pos:
+            if (stack[--stack_len] != n->cptr_tag)
+                pc += 5 + (int)get_u32(pc + 1);
+            else
+                pc += 5;
+            break;
+        case REOP_line_start:
+            if (cptr != s->cbuf) {
+                if (!s->multi_line)
+                    return 0;
+                PEEK_PREV_CHAR(c, cptr, s->cbuf);
+                if (!is_line_terminator(c))
+                    return 0;
+            }
+            pc++;
+            break;
+        case REOP_line_end:
+            if (cptr != s->cbuf_end) {
+                if (!s->multi_line)
+                    return 0;
+                PEEK_CHAR(c, cptr, s->cbuf_end);
+                if (!is_line_terminator(c))
+                    return 0;
+            }
+            pc++;
+            break;
+        case REOP_word_boundary:
+        case REOP_not_word_boundary:
+            {
+                BOOL v1, v2;
+                if (cptr == s->cbuf) {
+                    v1 = FALSE;
+                } else {
+                    PEEK_PREV_CHAR(c, cptr, s->cbuf);
+                    v1 = is_word_char(c);
+                }
+                if (cptr >= s->cbuf_end) {
+                    v2 = FALSE;
+                } else {
+                    PEEK_CHAR(c, cptr, s->cbuf_end);
+                    v2 = is_word_char(c);
+                }
+                if (v1 ^ v2 ^ (REOP_not_word_boundary - opcode))
+                    return 0;
+            }
+            pc++;
+            break;
+        case REOP_simple_greedy_quant:
+            {
+                StackInt old1 = stack[stack_len + 1];
+                old = stack[stack_len];
+                stack[stack_len] = (StackInt)(pc - n->bc_buf) << 1;
+                stack[stack_len + 1] = 0;
+                ret = re_nfa_quant(n, pc, capture, stack, stack_len + 2);
+                stack[stack_len] = old;
+                stack[stack_len + 1] = old1;
+                return ret;
+            }
+        case REOP_match:
+            if (pc == n->match_pc)
+                return re_nfa_add_thread(n, pc, capture, stack, stack_len);
+            {
+                /* end of the atom of a simple greedy quantifier */
+                const uint8_t *pc1;
+                uint32_t q;
+                pc1 = n->bc_buf + (stack[stack_len - 2] >> 1);
+                q = (stack[stack_len - 1] >> 1) + 1;
+                /* the count is not needed once past the minimum */
+                if (get_u32(pc1 + 9) == INT32_MAX && q > get_u32(pc1 + 5))
+                    q = get_u32(pc1 + 5);
+                old = stack[stack_len - 1];
+                stack[stack_len - 1] = (StackInt)q << 1;
+                ret = re_nfa_quant(n, pc1, capture, stack, stack_len);
+                stack[stack_len - 1] = old;
+                return ret;
+            }
+        default:
+            /* character test or match */
+            return re_nfa_add_thread(n, pc, capture, stack, stack_len);
+        }
+    }
+}
+
+static BOOL re_nfa_test_range(const uint8_t *pc, uint32_t c, BOOL is_range32)
+{
+    int n, idx_min, idx_max, idx;
+    uint32_t low, high;
+
+    n = get_u16(pc + 1);
+    pc += 3;
+    idx_min = 0;
+    idx_max = n - 1;
+    if (!is_range32 && c >= 0xffff && get_u16(pc + idx_max * 4 + 2) == 0xffff)
+        return TRUE;
+    while (idx_min <= idx_max) {
+        idx = (idx_min + idx_max) / 2;
+        if (is_range32) {
+            low = get_u32(pc + idx * 8);
+            high = get_u32(pc + idx * 8 + 4);
+        } else {
+            low = get_u16(pc + idx * 4);
+            high = get_u16(pc + idx * 4 + 2);
+        }
+        if (c < low)
+            idx_max = idx - 1;
+        else if (c > high)
+            idx_min = idx + 1;
+        else
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* 'c1' is 'c' canonicalized if ignore_case. Return the length of the
+   character test at 'pc' if it matches, 0 otherwise. */
+static int re_nfa_test_char(const uint8_t *pc, uint32_t c, uint32_t c1)
+{
+    switch(*pc) {
+    case REOP_char:
+        return get_u16(pc + 1) == c1 ? 3 : 0;
+    case REOP_char32:
+        return get_u32(pc + 1) == c1 ? 5 : 0;
+    case REOP_dot:
+        return !is_line_terminator(c);
+    case REOP_any:
+        return 1;
+    case REOP_range:
+        return re_nfa_test_range(pc, c1, FALSE) ? 3 + get_u16(pc + 1) * 4 : 0;
+    case REOP_range32:
+        return re_nfa_test_range(pc, c1, TRUE) ? 3 + get_u16(pc + 1) * 8 : 0;
+    default:
+        abort();
+    }
+}
+
+static void re_nfa_set_pos(RENFAContext *n, const uint8_t *cptr)
+{
+    n->cptr = cptr;
+    n->cptr_tag = ((StackInt)(cptr - n->s->cbuf) << 1) | 1;
+    n->gen++;
+    n->visited_states.len = 0;
+}
+
+/* return 1 if match, 0 if not match or -1 if error. */
+static int lre_exec_nfa(REExecContext *s, uint8_t **capture,
+                        const uint8_t *bc_buf, int bc_buf_len,
+                        const uint8_t *cptr)
+{
+    RENFAContext n_s, *n = &n_s;
+    RENFAList list[2], *clist, *nlist;
+    RENFAThread *t;
+    const uint8_t *pc, *cptr1;
+    uint8_t **capture1;
+    StackInt *stack;
+    uint32_t c, c1;
+    int cbuf_type, i, len, ret;
+    BOOL matched;
+
+    cbuf_type = s->cbuf_type;
+    memset(n, 0, sizeof(*n));
+    memset(list, 0, sizeof(list));
+    n->s = s;
+    n->bc_buf = bc_buf;
+    n->match_pc = bc_buf + bc_buf_len - 1;
+    /* two more slots for a simple quantifier */
+    n->stack_size = s->stack_size_max + 2;
+    n->thread_size = sizeof(RENFAThread) + sizeof(capture[0]) * 2 * s->capture_count +
+        sizeof(StackInt) * n->stack_size;
+    n->state_size = sizeof(RENFAThread) + sizeof(StackInt) * n->stack_size;
+    n->visited = lre_realloc(s->opaque, NULL, sizeof(n->visited[0]) * bc_buf_len);
+    if (!n->visited)
+        return -1;
+    memset(n->visited, 0, sizeof(n->visited[0]) * bc_buf_len);
+
+    capture1 = alloca(sizeof(capture[0]) * 2 * s->capture_count);
+    for(i = 0; i < s->capture_count * 2; i++)
+        capture1[i] = NULL;
+    stack = alloca(sizeof(StackInt) * n->stack_size);
+
+    clist = &list[0];
+    nlist = &list[1];
+    re_nfa_set_pos(n, cptr);
+    n->list = clist;
+    ret = re_nfa_add(n, bc_buf, capture1, stack, 0);
+    if (ret < 0)
+        goto done;
+    matched = FALSE;
+    while (clist->len != 0) {
+        cptr1 = cptr;
+        c = c1 = 0;
+        if (cptr < s->cbuf_end) {
+            GET_CHAR(c, cptr1, s->cbuf_end);
+            c1 = c;
+            if (s->ignore_case)
+                c1 = lre_canonicalize(c, s->is_utf16);
+        }
+        if (lre_poll_timeout(s, clist->len)) {
+            ret = -1;
+            goto done;
+        }
+        re_nfa_set_pos(n, cptr1);
+        n->list = nlist;
+        nlist->len = 0;
+        for(i = 0; i < clist->len; i++) {
+            t = (RENFAThread *)(clist->tab + i * n->thread_size);
+            pc = t->pc;
+            if (*pc == REOP_match) {
+                /* the lower priority threads are discarded */
+                memcpy(capture, t->buf, sizeof(capture[0]) * 2 * s->capture_count);
+                matched = TRUE;
+                break;
+            }
+            if (cptr >= s->cbuf_end)
+                continue;
+            len = re_nfa_test_char(pc, c, c1);
+            if (!len)
+                continue;
+            memcpy(stack, t->buf + 2 * s->capture_count,
+                   sizeof(StackInt) * t->stack_len);
+            ret = re_nfa_add(n, pc + len, (uint8_t **)t->buf, stack, t->stack_len);
+            if (ret < 0)
+                goto done;
+        }
+        if (cptr >= s->cbuf_end)
+            break;
+        cptr = cptr1;
+        clist = nlist;
+        nlist = (clist == &list[0]) ? &list[1] : &list[0];
+    }
+    ret = matched;
+ done:
+    lre_realloc(s->opaque, list[0].tab, 0);
+    lre_realloc(s->opaque, list[1].tab, 0);
+    lre_realloc(s->opaque, n->visited_states.tab, 0);
+    lre_realloc(s->opaque, n->visited, 0);
+    return ret;
+}
+
+/* Return the first position >= pos where a match can start according
+   to the prefilter 'pf', or -1 if none. */
+static int lre_prefilter_next(const uint8_t *pf, const uint8_t *cbuf,
+                              int cindex, int pos, int clen, int cbuf_type,
+                              BOOL is_utf16)
+{
+    const uint8_t *bitmap = pf + RE_PREFILTER_BITMAP;
+    int literal_len = pf[0];
+    BOOL high = pf[1];
+    uint32_t c, c0;
+    int i;
+
+    if (cbuf_type == 0) {
+        const uint8_t *p;
+        if (literal_len != 0) {
+            c0 = get_u16(pf + RE_PREFILTER_LITERAL);
+            if (c0 >= 256)
+                return -1;
+            for(;;) {
+                if (clen - pos < literal_len)
+                    return -1;
+                p = memchr(cbuf + pos, c0, clen - pos - literal_len + 1);
+                if (!p)
+                    return -1;
+                pos = p - cbuf;
+                for(i = 1; i < literal_len; i++) {
+                    if (cbuf[pos + i] != get_u16(pf + RE_PREFILTER_LITERAL + i * 2))
+                        break;
+                }
+                if (i == literal_len)
+                    return pos;
+                pos++;
+            }
+        }
+        for(; pos < clen; pos++) {
+            c = cbuf[pos];
+            if (bitmap[c >> 3] & (1 << (c & 7)))
+                return pos;
+        }
+    } else {
+        const uint16_t *cbuf16 = (const uint16_t *)cbuf;
+        if (literal_len != 0) {
+            c0 = get_u16(pf + RE_PREFILTER_LITERAL);
+            for(; pos <= clen - literal_len; pos++) {
+                if (cbuf16[pos] != c0)
+                    continue;
+                for(i = 1; i < literal_len; i++) {
+                    if (cbuf16[pos + i] != get_u16(pf + RE_PREFILTER_LITERAL + i * 2))
+                        break;
+                }
+                if (i == literal_len)
+                    return pos;
+            }
+            return -1;
+        }
+        for(; pos < clen; pos++) {
+            c = cbuf16[pos];
+            if (c < 256) {
+                if (bitmap[c >> 3] & (1 << (c & 7)))
+                    return pos;
+            } else if (high) {
+                /* never start in the middle of a surrogate pair */
+                if (is_utf16 && c >= 0xdc00 && c <= 0xdfff && pos > cindex &&
+                    cbuf16[pos - 1] >= 0xd800 && cbuf16[pos - 1] <= 0xdbff)
+                    continue;
+                return pos;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Return 1 if match, 0 if not match, LRE_RET_MEMORY_ERROR or
+   LRE_RET_TIMEOUT if error. cindex is the starting position of the
+   match and must be such as 0 <= cindex <= clen. */
 int lre_exec(uint8_t **capture,
              const uint8_t *bc_buf, const uint8_t *cbuf, int cindex, int clen,
              int cbuf_type, void *opaque)
 {
     REExecContext s_s, *s = &s_s;
-    int re_flags, i, alloca_size, ret;
+    int re_flags, i, alloca_size, ret, start, pos;
+    uint32_t bc_len;
+    const uint8_t *pf = NULL;
     StackInt *stack_buf;
     
-    re_flags = bc_buf[RE_HEADER_FLAGS];
+    re_flags = lre_get_flags(bc_buf);
     s->multi_line = (re_flags & LRE_FLAG_MULTILINE) != 0;
     s->ignore_case = (re_flags & LRE_FLAG_IGNORECASE) != 0;
     s->is_utf16 = (re_flags & LRE_FLAG_UTF16) != 0;
@@ -2523,14 +3346,65 @@ int lre_exec(uint8_t **capture,
     s->state_stack = NULL;
     s->state_stack_len = 0;
     s->state_stack_size = 0;
+    s->interrupt_counter = INTERRUPT_COUNTER_INIT;
+    s->interrupted = FALSE;
     
     for(i = 0; i < s->capture_count * 2; i++)
         capture[i] = NULL;
+    bc_len = get_u32(bc_buf + RE_HEADER_BYTECODE_LEN);
+    start = cindex;
+    if (re_flags & LRE_FLAG_PREFILTER) {
+        /* skip the search loop and only try the candidate positions */
+        pf = bc_buf + RE_HEADER_LEN + bc_len;
+        start = lre_prefilter_next(pf, cbuf, cindex, cindex, clen, cbuf_type,
+                                   s->is_utf16);
+        if (start < 0)
+            return 0;
+    }
+    if (re_flags & LRE_FLAG_LINEAR) {
+        ret = lre_exec_nfa(s, capture, bc_buf + RE_HEADER_LEN, bc_len,
+                           cbuf + (start << cbuf_type));
+        goto done;
+    }
+
+    s->backtrack_count = 0;
+    s->backtrack_limit_hit = FALSE;
+    if (re_flags & LRE_FLAG_NFA)
+        s->backtrack_limit = RE_BACKTRACK_LIMIT + RE_BACKTRACK_FACTOR * (size_t)(clen - cindex);
+    else
+        s->backtrack_limit = SIZE_MAX;
     alloca_size = s->stack_size_max * sizeof(stack_buf[0]);
     stack_buf = alloca(alloca_size);
-    ret = lre_exec_backtrack(s, capture, stack_buf, 0, bc_buf + RE_HEADER_LEN,
-                             cbuf + (cindex << cbuf_type), FALSE);
+    if (re_flags & LRE_FLAG_PREFILTER) {
+        pos = start;
+        for(;;) {
+            ret = lre_exec_backtrack(s, capture, stack_buf, 0,
+                                     bc_buf + RE_HEADER_LEN + RE_SEARCH_LOOP_LEN,
+                                     cbuf + (pos << cbuf_type), FALSE);
+            if (ret != 0)
+                break;
+            for(i = 0; i < s->capture_count * 2; i++)
+                capture[i] = NULL;
+            pos = lre_prefilter_next(pf, cbuf, cindex, pos + 1, clen, cbuf_type,
+                                     s->is_utf16);
+            if (pos < 0)
+                break;
+        }
+    } else {
+        ret = lre_exec_backtrack(s, capture, stack_buf, 0, bc_buf + RE_HEADER_LEN,
+                                 cbuf + (cindex << cbuf_type), FALSE);
+    }
     lre_realloc(s->opaque, s->state_stack, 0);
+    if (ret < 0 && s->backtrack_limit_hit) {
+        /* too much backtracking: restart with the linear time engine */
+        for(i = 0; i < s->capture_count * 2; i++)
+            capture[i] = NULL;
+        ret = lre_exec_nfa(s, capture, bc_buf + RE_HEADER_LEN, bc_len,
+                           cbuf + (start << cbuf_type));
+    }
+ done:
+    if (ret < 0 && s->interrupted)
+        ret = LRE_RET_TIMEOUT;
     return ret;
 }
 
@@ -2541,7 +3415,7 @@ int lre_get_capture_count(const uint8_t *bc_buf)
 
 int lre_get_flags(const uint8_t *bc_buf)
 {
-    return bc_buf[RE_HEADER_FLAGS];
+    return get_u16(bc_buf + RE_HEADER_FLAGS);
 }
 
 /* Return NULL if no group names. Otherwise, return a pointer to
@@ -2551,8 +3425,11 @@ const char *lre_get_groupnames(const uint8_t *bc_buf)
     uint32_t re_bytecode_len;
     if ((lre_get_flags(bc_buf) & LRE_FLAG_NAMED_GROUPS) == 0)
         return NULL;
-    re_bytecode_len = get_u32(bc_buf + 3);
-    return (const char *)(bc_buf + 7 + re_bytecode_len);
+    re_bytecode_len = get_u32(bc_buf + RE_HEADER_BYTECODE_LEN);
+    bc_buf += RE_HEADER_LEN + re_bytecode_len;
+    if (lre_get_flags(bc_buf - RE_HEADER_LEN - re_bytecode_len) & LRE_FLAG_PREFILTER)
+        bc_buf += re_prefilter_size(bc_buf);
+    return (const char *)bc_buf;
 }
 
 #ifdef TEST
@@ -2562,6 +3439,11 @@ BOOL lre_check_stack_overflow(void *opaque, size_t alloca_size)
     return FALSE;
 }
 
+BOOL lre_check_timeout(void *opaque)
+{
+    return FALSE;
+}
+
 void *lre_realloc(void *opaque, void *ptr, size_t size)
 {
     return realloc(ptr, size);
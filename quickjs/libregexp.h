@@ -36,8 +36,11 @@
 #define LRE_FLAG_DOTALL     (1 << 3)
 #define LRE_FLAG_UTF16      (1 << 4)
 #define LRE_FLAG_STICKY     (1 << 5)
+#define LRE_FLAG_LINEAR     (1 << 8) /* only use the linear time engine */
 
+#define LRE_FLAG_PREFILTER    (1 << 6) /* a first character prefilter follows the bytecode */
 #define LRE_FLAG_NAMED_GROUPS (1 << 7) /* named groups are present in the regexp */
+#define LRE_FLAG_NFA          (1 << 9) /* the linear time engine can be used */
 
 uint8_t *lre_compile(int *plen, char *error_msg, int error_msg_size,
                      const char *buf, size_t buf_len, int re_flags,
@@ -45,6 +48,10 @@ uint8_t *lre_compile(int *plen, char *error_msg, int error_msg_size,
 int lre_get_capture_count(const uint8_t *bc_buf);
 int lre_get_flags(const uint8_t *bc_buf);
 const char *lre_get_groupnames(const uint8_t *bc_buf);
+/* lre_exec() return values in case of error */
+#define LRE_RET_MEMORY_ERROR (-1)
+#define LRE_RET_TIMEOUT      (-2)
+
 int lre_exec(uint8_t **capture,
              const uint8_t *bc_buf, const uint8_t *cbuf, int cindex, int clen,
              int cbuf_type, void *opaque);
@@ -54,6 +61,8 @@ LRE_BOOL lre_is_space(int c);
 
 /* must be provided by the user */
 LRE_BOOL lre_check_stack_overflow(void *opaque, size_t alloca_size); 
+/* called periodically during the execution, return TRUE to abort it */
+LRE_BOOL lre_check_timeout(void *opaque);
 void *lre_realloc(void *opaque, void *ptr, size_t size);
 
 /* JS identifier test */
@@ -0,0 +1,177 @@
+/* NFC_Quick_Check tables */
+/*
+ * Generated by unicode_gen_nfc_qc.c from the tables of
+ * libunicode-table.h so that they agree with unicode_normalize():
+ *
+ * - unicode_nfc_qc_table/unicode_nfc_qc_index: the characters with
+ *   NFC_Quick_Check = No or Maybe. Maybe is the second character of
+ *   each pair of unicode_comp_table plus the Hangul V and T jamos
+ *   (U+1161-U+1175, U+11A7-U+11C2). No is every other character that
+ *   unicode_normalize(UNICODE_NFC) does not map to itself. They use the
+ *   same compressed format as the unicode_prop_* tables, read by
+ *   lre_is_in_table().
+ *
+ * - unicode_nfc_qc_bmp_index/unicode_nfc_qc_bmp_table: a two level
+ *   bitmap of the BMP characters for which unicode_nfc_quick_check()
+ *   is not 0. unicode_nfc_qc_bmp_index gives the 1 based 256 bit page
+ *   of each 256 character block, or 0 when the block has none.
+ *
+ * Regenerate them when libunicode-table.h is updated and check them
+ * with 'unicode_gen_nfc_qc -check'.
+ */
+
+#ifdef CONFIG_ALL_UNICODE
+
+static const uint8_t unicode_nfc_qc_table[193] = {
+    0x42, 0xff, 0x84, 0x06, 0x08, 0x00, 0x01, 0x28,
+    0x35, 0x19, 0x01, 0x28, 0x35, 0xad, 0x80, 0x88,
+    0x80, 0x38, 0x42, 0xca, 0x82, 0x42, 0xe5, 0x80,
+    0x9a, 0x87, 0xdd, 0x80, 0x97, 0x80, 0x19, 0x00,
+    0xd2, 0x80, 0x08, 0xa1, 0x82, 0x08, 0x40, 0xde,
+    0x80, 0x96, 0x81, 0x19, 0xdf, 0x80, 0x97, 0x80,
+    0xfd, 0x80, 0xea, 0x80, 0x91, 0x81, 0xe6, 0x80,
+    0x97, 0x80, 0xf1, 0x80, 0x18, 0x8e, 0x80, 0x41,
+    0x62, 0x80, 0x88, 0x80, 0x18, 0x18, 0x18, 0x8b,
+    0x80, 0x3c, 0x00, 0x31, 0x90, 0x80, 0x88, 0x80,
+    0x18, 0x18, 0x18, 0x8b, 0x80, 0xf3, 0x80, 0x41,
+    0x31, 0x94, 0xb0, 0x9b, 0x49, 0x71, 0x80, 0x44,
+    0x3a, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xbc, 0x80, 0x08, 0x89, 0x80, 0x00, 0x30, 0x30,
+    0x30, 0x30, 0x09, 0x88, 0x80, 0x00, 0x00, 0x09,
+    0x41, 0x23, 0x80, 0x11, 0x41, 0xfc, 0x81, 0x47,
+    0xb0, 0x80, 0x45, 0xbb, 0x81, 0x60, 0xc8, 0x64,
+    0x41, 0x0d, 0x08, 0x00, 0x81, 0x89, 0x00, 0x00,
+    0x09, 0x82, 0xc3, 0x81, 0xe9, 0xc2, 0x80, 0x00,
+    0x89, 0x8c, 0x04, 0x00, 0x01, 0x01, 0x80, 0x88,
+    0x55, 0x6a, 0x80, 0xeb, 0x80, 0x42, 0x15, 0x80,
+    0x97, 0x80, 0x41, 0x57, 0x80, 0x88, 0x80, 0x08,
+    0x40, 0xf0, 0x80, 0x43, 0x7f, 0x80, 0x60, 0xb8,
+    0x2c, 0x86, 0xd5, 0x85, 0x61, 0x26, 0x3e, 0x42,
+    0x1d,
+};
+
+static const uint8_t unicode_nfc_qc_index[18] = {
+    0xe0, 0x09, 0x00, 0x44, 0x0f, 0x40, 0x72, 0x1f,
+    0x40, 0xdd, 0x2a, 0x40, 0x4f, 0xfb, 0x00, 0x1e,
+    0xfa, 0x02,
+};
+
+static const uint8_t unicode_nfc_qc_bmp_index[256] = {
+    0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+    0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+    0x0e, 0x0f, 0x00, 0x10, 0x00, 0x00, 0x00, 0x11,
+    0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x00, 0x18,
+    0x19, 0x1a, 0x00, 0x1b, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x1c, 0x00, 0x1d, 0x1e, 0x00, 0x00,
+    0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00,
+    0x21, 0x22, 0x23, 0x24, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x25, 0x26, 0x27, 0x00, 0x00, 0x28, 0x00,
+};
+
+static const uint32_t unicode_nfc_qc_bmp_table[320] = {
+    0xffffffff, 0xffffffff, 0xffff7fff, 0x4010ffff,
+    0x00000080, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x000000f8, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0xfffe0000, 0xbfffffff, 0x000000b6, 0x00000000,
+    0x07ff0000, 0x00000000, 0xfffff800, 0x00010000,
+    0x00000000, 0x00000000, 0x9fc00000, 0x00003d9f,
+    0x00020000, 0xffff0000, 0x000007ff, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x200ff800,
+    0xfbc00000, 0x00003eef, 0x0e000000, 0x00000000,
+    0x00000000, 0x00000000, 0xfff80000, 0xfffffffb,
+    0x00000000, 0x10000000, 0xff1e2000, 0x00000000,
+    0x00000000, 0x50000000, 0xb0802000, 0x40000000,
+    0x00000000, 0x10480000, 0x4e002000, 0x00000000,
+    0x00000000, 0x10000000, 0x00002000, 0x00000000,
+    0x00000000, 0x50000000, 0x30c02000, 0x00000000,
+    0x00000000, 0x40000000, 0x00802000, 0x00000000,
+    0x00000000, 0x00000000, 0x00602000, 0x00000000,
+    0x00000000, 0x10000000, 0x00602004, 0x00000000,
+    0x00000000, 0x58000000, 0x00802000, 0x00000000,
+    0x00000000, 0x00000000, 0x80008400, 0x00000000,
+    0x00000000, 0x07000000, 0x00000f00, 0x00000000,
+    0x00000000, 0x07000000, 0x00000f00, 0x00000000,
+    0x03000000, 0x02a00000, 0x10842008, 0x3d7e0200,
+    0x200800df, 0x02001084, 0x00000040, 0x00000000,
+    0x00000000, 0x06804000, 0x00000000, 0x00000000,
+    0x00002000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x003ffffe,
+    0x00000000, 0xffffff80, 0x00000007, 0x00000000,
+    0x00000000, 0x00000000, 0xe0000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00100000, 0x00100000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x20040000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000200, 0x00000000, 0x00000000,
+    0x00000000, 0x0e000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x01800000, 0x00000000, 0x00000000, 0x9fe00001,
+    0x00000000, 0xbfff0000, 0x00000001, 0x00000000,
+    0x00000000, 0x00300000, 0x00000010, 0x000ff800,
+    0x00000000, 0x00000c00, 0x00000000, 0x000c0040,
+    0x00000000, 0x00800000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0xfff70000, 0x031021fd,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0xffffffff, 0xfbffffff,
+    0x00000000, 0x00000000, 0x00000000, 0x2aaa0000,
+    0x00000000, 0x48000000, 0x08080a00, 0x2a00c808,
+    0x00000003, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x1fff0000, 0x0001ffe2,
+    0x00000000, 0x00000c40, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000600, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x10000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00038000,
+    0x00000000, 0x00000000, 0x00000000, 0x80000000,
+    0x00000000, 0x00000000, 0x00000000, 0xffffffff,
+    0x00000000, 0x0000fc00, 0x00000000, 0x00000000,
+    0x06000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x3ff08000,
+    0xc0000000, 0x00000000, 0x00000000, 0x00030000,
+    0x00000040, 0x00001000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000010, 0x0003ffff,
+    0x00000000, 0x00003800, 0x00080000, 0x00000000,
+    0x00000000, 0x00080000, 0x00000001, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0xc19d0000, 0x00000002, 0x00400000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00002000,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x7fe53fff, 0xfffffc65, 0xffffffff, 0xffff3fff,
+    0xffffffff, 0xffffffff, 0x03ffffff, 0x00000000,
+    0xe0000000, 0x5f7ffc00, 0x00007fdb, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x0000ffff, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+};
+
+#endif /* CONFIG_ALL_UNICODE */
@@ -30,6 +30,7 @@
 #include "cutils.h"
 #include "libunicode.h"
 #include "libunicode-table.h"
+#include "libunicode-nfc-qc.h"
 
 enum {
     RUN_TYPE_U,
@@ -65,6 +66,27 @@ int lre_case_conv(uint32_t *res, uint32_t c, int conv_type)
                 c = c - 'a' + 'A';
             }
         }
+    } else if (c < 256) {
+        /* Latin-1 */
+        if (conv_type) {
+            if (c >= 0xc0 && c <= 0xde && c != 0xd7) {
+                c += 0x20;
+            } else if (c == 0xb5 && conv_type == 2) {
+                c = 0x3bc;
+            }
+        } else {
+            if (c >= 0xe0 && c <= 0xfe && c != 0xf7) {
+                c -= 0x20;
+            } else if (c == 0xb5) {
+                c = 0x39c;
+            } else if (c == 0xff) {
+                c = 0x178;
+            } else if (c == 0xdf) {
+                res[0] = 'S';
+                res[1] = 'S';
+                return 2;
+            }
+        }
     } else {
         uint32_t v, code, data, type, len, a, is_lower;
         int idx, idx_min, idx_max;
@@ -237,11 +259,29 @@ static BOOL lre_is_in_table(uint32_t c, const uint8_t *table,
     }
 }
 
+/* Latin-1 subsets of the properties tested below */
+static const uint32_t unicode_latin1_cased[8] = {
+    0x00000000, 0x00000000, 0x07FFFFFE, 0x07FFFFFE,
+    0x00000000, 0x04200400, 0xFF7FFFFF, 0xFF7FFFFF,
+};
+
+static const uint32_t unicode_latin1_case_ignorable[8] = {
+    0x00000000, 0x04004080, 0x40000000, 0x00000001,
+    0x00000000, 0x0190A100, 0x00000000, 0x00000000,
+};
+
+static inline BOOL lre_is_in_latin1(uint32_t c, const uint32_t *bitmap)
+{
+    return (bitmap[c >> 5] >> (c & 31)) & 1;
+}
+
 BOOL lre_is_cased(uint32_t c)
 {
     uint32_t v, code, len;
     int idx, idx_min, idx_max;
         
+    if (c < 256)
+        return lre_is_in_latin1(c, unicode_latin1_cased);
     idx_min = 0;
     idx_max = countof(case_conv_table1) - 1;
     while (idx_min <= idx_max) {
@@ -264,6 +304,8 @@ BOOL lre_is_cased(uint32_t c)
 
 BOOL lre_is_case_ignorable(uint32_t c)
 {
+    if (c < 256)
+        return lre_is_in_latin1(c, unicode_latin1_case_ignorable);
     return lre_is_in_table(c, unicode_prop_Case_Ignorable_table,
                            unicode_prop_Case_Ignorable_index,
                            sizeof(unicode_prop_Case_Ignorable_index) / 3);
@@ -432,8 +474,20 @@ int cr_invert(CharRange *cr)
 
 #ifdef CONFIG_ALL_UNICODE
 
+static const uint32_t unicode_latin1_id_start[8] = {
+    0x00000000, 0x00000000, 0x07FFFFFE, 0x07FFFFFE,
+    0x00000000, 0x04200400, 0xFF7FFFFF, 0xFF7FFFFF,
+};
+
+static const uint32_t unicode_latin1_id_continue[8] = {
+    0x00000000, 0x03FF0000, 0x87FFFFFE, 0x07FFFFFE,
+    0x00000000, 0x04A00400, 0xFF7FFFFF, 0xFF7FFFFF,
+};
+
 BOOL lre_is_id_start(uint32_t c)
 {
+    if (c < 256)
+        return lre_is_in_latin1(c, unicode_latin1_id_start);
     return lre_is_in_table(c, unicode_prop_ID_Start_table,
                            unicode_prop_ID_Start_index,
                            sizeof(unicode_prop_ID_Start_index) / 3);
@@ -441,6 +495,8 @@ BOOL lre_is_id_start(uint32_t c)
 
 BOOL lre_is_id_continue(uint32_t c)
 {
+    if (c < 256)
+        return lre_is_in_latin1(c, unicode_latin1_id_continue);
     return lre_is_id_start(c) ||
         lre_is_in_table(c, unicode_prop_ID_Continue1_table,
                         unicode_prop_ID_Continue1_index,
@@ -725,6 +781,9 @@ static int unicode_get_cc(uint32_t c)
     int pos;
     const uint8_t *p;
     
+    /* the first combining character is U+0300 */
+    if (c < 0x300)
+        return 0;
     pos = get_index_pos(&code, c,
                         unicode_cc_index, sizeof(unicode_cc_index) / 3);
     if (pos < 0)
@@ -923,6 +982,29 @@ int unicode_normalize(uint32_t **pdst, const uint32_t *src, int src_len,
     return out_len;
 }
 
+/* NFC quick check of the character 'c' (UAX #15): return its combining
+   class if NFC_Quick_Check = Yes, otherwise -1. A string is in NFC if
+   all its characters pass and the non zero combining classes are in
+   increasing order. */
+int unicode_nfc_quick_check(uint32_t c)
+{
+    int page;
+
+    /* direct lookup of the BMP characters with NFC_Quick_Check = Yes
+       and a zero combining class */
+    if (c < 0x10000) {
+        page = unicode_nfc_qc_bmp_index[c >> 8];
+        if (page == 0 ||
+            !((unicode_nfc_qc_bmp_table[(page - 1) * 8 + ((c >> 5) & 7)] >>
+               (c & 31)) & 1))
+            return 0;
+    }
+    if (lre_is_in_table(c, unicode_nfc_qc_table, unicode_nfc_qc_index,
+                        sizeof(unicode_nfc_qc_index) / 3))
+        return -1;
+    return unicode_get_cc(c);
+}
+
 /* char ranges for various unicode properties */
 
 static int unicode_find_name(const char *name_table, const char *name)
@@ -109,6 +109,7 @@ LRE_BOOL lre_is_id_continue(uint32_t c);
 int unicode_normalize(uint32_t **pdst, const uint32_t *src, int src_len,
                       UnicodeNormalizationEnum n_type,
                       void *opaque, void *(*realloc_func)(void *opaque, void *ptr, size_t size));
+int unicode_nfc_quick_check(uint32_t c);
 
 /* Unicode character range functions */
 
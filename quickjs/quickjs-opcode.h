@@ -147,6 +147,7 @@ DEF(   put_array_el, 1, 3, 0, none)
 DEF(get_super_value, 1, 3, 1, none) /* this obj prop -> value */
 DEF(put_super_value, 1, 4, 0, none) /* this obj prop value -> */
 DEF(   define_field, 5, 2, 1, atom)
+DEF(object_template, 5, 0, 1, npop_u16) /* values... -> obj. values are not counted in n_pop */
 DEF(       set_name, 5, 1, 1, atom)
 DEF(set_name_computed, 1, 2, 2, none)
 DEF(      set_proto, 1, 2, 1, none)
@@ -240,6 +240,38 @@ typedef struct {
 } JSNumericOperations;
 #endif
 
+typedef enum {
+    JS_ALLOC_KIND_OTHER,
+    JS_ALLOC_KIND_OBJECT,
+    JS_ALLOC_KIND_STRING,
+    JS_ALLOC_KIND_ARRAY, /* fast array elements */
+    JS_ALLOC_KIND_BYTECODE,
+    JS_ALLOC_KIND_COUNT,
+} JSAllocKindEnum;
+
+#define JS_REGEXP_CACHE_DEFAULT_SIZE 64
+#define JS_REGEXP_CACHE_MAX_SIZE (1 << 16)
+#define JS_BIGINT_CELL_CACHE_SIZE 64
+
+typedef struct JSRegExpCacheEntry {
+    struct list_head link; /* LRU order, most recent first */
+    struct JSRegExpCacheEntry *hash_next;
+    JSAtom source;
+    int flags;
+    JSString *bytecode;
+} JSRegExpCacheEntry;
+
+/* compiled RegExp bytecode by source and flags */
+typedef struct JSRegExpCache {
+    struct list_head lru;
+    JSRegExpCacheEntry **hash; /* NULL if not allocated yet */
+    int hash_size; /* power of two */
+    int count;
+    int size; /* maximum number of entries, 0 = disabled */
+    int64_t hits;
+    int64_t misses;
+} JSRegExpCache;
+
 struct JSRuntime {
     JSMallocFunctions mf;
     JSMallocState malloc_state;
@@ -260,11 +292,24 @@ struct JSRuntime {
     /* list of JSGCObjectHeader.link. List of allocated GC objects (used
        by the garbage collector) */
     struct list_head gc_obj_list;
+    /* list of JSGCObjectHeader.link. GC objects allocated since the
+       last collection. They are moved to gc_obj_list by the GC. */
+    struct list_head gc_young_list;
     /* list of JSGCObjectHeader.link. Used during JS_FreeValueRT() */
     struct list_head gc_zero_ref_count_list; 
     struct list_head tmp_obj_list; /* used during GC */
     JSGCPhaseEnum gc_phase : 8;
     size_t malloc_gc_threshold;
+    /* if > 0, the automatic GC runs slices of at most gc_slice_budget
+       us until malloc_gc_full_threshold is reached */
+    int64_t gc_slice_budget;
+    size_t malloc_gc_full_threshold;
+    int64_t gc_object_cost_ns; /* estimated GC time per object */
+    /* if > 0, a minor GC is run when gc_nursery_size bytes were
+       allocated since the last collection */
+    size_t gc_nursery_size;
+    size_t malloc_gc_minor_threshold;
+    JSGCStats gc_stats;
 #ifdef DUMP_LEAKS
     struct list_head string_list; /* list of JSString.link */
 #endif
@@ -277,6 +322,14 @@ struct JSRuntime {
     BOOL in_out_of_memory : 8;
 
     struct JSStackFrame *current_stack_frame;
+    struct JSProfiler *profiler; /* non NULL while profiling */
+    /* non NULL while sampling the allocations */
+    struct JSAllocProfiler *alloc_profiler;
+    /* kind of the next allocation, only used by the allocation
+       profiler */
+    JSAllocKindEnum alloc_kind : 8;
+    struct JSHeapSnapshot *heap_snapshot; /* used by the mark function */
+    JSRegExpCache regexp_cache;
 
     JSInterruptHandler *interrupt_handler;
     void *interrupt_opaque;
@@ -305,6 +358,9 @@ struct JSRuntime {
     JSNumericOperations bigfloat_ops;
     JSNumericOperations bigdecimal_ops;
     uint32_t operator_count;
+    /* freed single limb BigInt cells, reused by JS_NewBigInt64_1() */
+    int bigint_cell_count;
+    struct JSBigFloat *bigint_cells[JS_BIGINT_CELL_CACHE_SIZE];
 #endif
     void *user_opaque;
 };
@@ -495,7 +551,9 @@ struct JSString {
        XXX: could change encoding to have one more bit in hash */
     uint32_t hash : 30;
     uint8_t atom_type : 2; /* != 0 if atom, JS_ATOM_TYPE_x */
-    uint32_t hash_next; /* atom_index for JS_ATOM_TYPE_SYMBOL */
+    /* atom_index for JS_ATOM_TYPE_SYMBOL. If atom_type = 0, allocated
+       length of a string reserving room for appends or 0 */
+    uint32_t hash_next;
 #ifdef DUMP_LEAKS
     struct list_head link; /* string list */
 #endif
@@ -642,6 +700,7 @@ typedef struct JSForInIterator {
     BOOL is_array;
     uint32_t array_length;
     uint32_t idx;
+    struct JSEnumKeys *keys; /* if not NULL, the keys to enumerate */
 } JSForInIterator;
 
 typedef struct JSRegExp {
@@ -861,9 +920,33 @@ struct JSShape {
     int deleted_prop_count;
     JSShape *shape_hash_next; /* in JSRuntime.shape_hash[h] list */
     JSObject *proto;
+    /* enumerable own string keys of the objects having this shape,
+       NULL if not computed. Cleared when the shape is modified. */
+    struct JSEnumKeys *enum_keys;
     JSShapeProperty prop[0]; /* prop_size elements */
 };
 
+/* immutable list of the enumerable own string keys of a shape, in
+   enumeration order */
+typedef struct JSEnumKeys {
+    int ref_count;
+    uint32_t count;
+    JSAtom atoms[0];
+} JSEnumKeys;
+
+/* element storage of a fast JS_CLASS_ARRAY object. Arrays holding only
+   numbers are stored unboxed and are converted to JS_ARRAY_KIND_VALUE
+   on the first write of another value. JS_CLASS_ARGUMENTS objects
+   always use JS_ARRAY_KIND_VALUE. */
+typedef enum {
+    JS_ARRAY_KIND_VALUE,   /* u.array.u.values */
+    JS_ARRAY_KIND_INT32,   /* u.array.u.int32_ptr */
+    JS_ARRAY_KIND_FLOAT64, /* u.array.u.double_ptr */
+} JSArrayKindEnum;
+
+/* maximum number of elements of the storage of a fast array */
+#define JS_ARRAY_FAST_SIZE_MAX ((1U << 30) - 1)
+
 struct JSObject {
     union {
         JSGCObjectHeader header;
@@ -886,7 +969,7 @@ struct JSObject {
     JSShape *shape; /* prototype and property names + flag */
     JSProperty *prop; /* array of properties */
     /* byte offsets: 24/40 */
-    struct JSMapRecord *first_weak_ref; /* XXX: use a bit and an external hash table? */
+    struct JSMapWeakRef *first_weak_ref; /* XXX: use a bit and an external hash table? */
     /* byte offsets: 28/48 */
     union {
         void *opaque;
@@ -926,7 +1009,10 @@ struct JSObject {
         /* array part for fast arrays and typed arrays */
         struct { /* JS_CLASS_ARRAY, JS_CLASS_ARGUMENTS, JS_CLASS_UINT8C_ARRAY..JS_CLASS_FLOAT64_ARRAY */
             union {
-                uint32_t size;          /* JS_CLASS_ARRAY, JS_CLASS_ARGUMENTS */
+                struct {
+                    uint32_t size : 30; /* JS_CLASS_ARRAY, JS_CLASS_ARGUMENTS */
+                    uint32_t kind : 2;  /* JS_CLASS_ARRAY: JSArrayKindEnum */
+                };
                 struct JSTypedArray *typed_array; /* JS_CLASS_UINT8C_ARRAY..JS_CLASS_FLOAT64_ARRAY */
             } u1;
             union {
@@ -936,12 +1022,12 @@ struct JSObject {
                 uint8_t *uint8_ptr;     /* JS_CLASS_UINT8_ARRAY, JS_CLASS_UINT8C_ARRAY */
                 int16_t *int16_ptr;     /* JS_CLASS_INT16_ARRAY */
                 uint16_t *uint16_ptr;   /* JS_CLASS_UINT16_ARRAY */
-                int32_t *int32_ptr;     /* JS_CLASS_INT32_ARRAY */
+                int32_t *int32_ptr;     /* JS_CLASS_INT32_ARRAY, JS_ARRAY_KIND_INT32 */
                 uint32_t *uint32_ptr;   /* JS_CLASS_UINT32_ARRAY */
                 int64_t *int64_ptr;     /* JS_CLASS_INT64_ARRAY */
                 uint64_t *uint64_ptr;   /* JS_CLASS_UINT64_ARRAY */
                 float *float_ptr;       /* JS_CLASS_FLOAT32_ARRAY */
-                double *double_ptr;     /* JS_CLASS_FLOAT64_ARRAY */
+                double *double_ptr;     /* JS_CLASS_FLOAT64_ARRAY, JS_ARRAY_KIND_FLOAT64 */
             } u;
             uint32_t count; /* <= 2^31-1. 0 for a detached typed array */
         } array;    /* 12/20 bytes */
@@ -1001,6 +1087,10 @@ static JSAtom __JS_NewAtomInit(JSRuntime *rt, const char *str, int len,
                                int atom_type);
 static void JS_FreeAtomStruct(JSRuntime *rt, JSAtomStruct *p);
 static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b);
+static void js_profiler_free(JSRuntime *rt, struct JSProfiler *prof);
+static void js_alloc_profiler_malloc(JSRuntime *rt, void *ptr, size_t size);
+static void js_alloc_profiler_free(JSRuntime *rt, void *ptr);
+static void *js_alloc_profiler_realloc(JSRuntime *rt, void *ptr, size_t size);
 static JSValue js_call_c_function(JSContext *ctx, JSValueConst func_obj,
                                   JSValueConst this_obj,
                                   int argc, JSValueConst *argv, int flags);
@@ -1099,7 +1189,7 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
                                  JSValueConst flags);
 static JSValue js_regexp_constructor_internal(JSContext *ctx, JSValueConst ctor,
                                               JSValue pattern, JSValue bc);
-static void gc_decref(JSRuntime *rt);
+static int64_t gc_decref(JSRuntime *rt);
 static int JS_NewClass1(JSRuntime *rt, JSClassID class_id,
                         const JSClassDef *class_def, JSAtom name);
 
@@ -1244,6 +1334,7 @@ static JSAtom js_symbol_to_atom(JSContext *ctx, JSValue val);
 static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
                           JSGCObjectTypeEnum type);
 static void remove_gc_object(JSGCObjectHeader *h);
+static void gc_promote_young(JSRuntime *rt);
 static void js_async_function_free0(JSRuntime *rt, JSAsyncFunctionData *s);
 static JSValue js_instantiate_prototype(JSContext *ctx, JSObject *p, JSAtom atom, void *opaque);
 static JSValue js_module_ns_autoinit(JSContext *ctx, JSObject *p, JSAtom atom,
@@ -1272,9 +1363,25 @@ static void js_trigger_gc(JSRuntime *rt, size_t size)
         printf("GC: size=%" PRIu64 "\n",
                (uint64_t)rt->malloc_state.malloc_size);
 #endif
-        JS_RunGC(rt);
+        if (rt->gc_slice_budget > 0 &&
+            (rt->malloc_state.malloc_size + size) <=
+            rt->malloc_gc_full_threshold) {
+            /* the cycles crossing the slices are collected by the
+               next full GC */
+            JS_RunGCSlice(rt, rt->gc_slice_budget);
+        } else {
+            JS_RunGC(rt);
+        }
         rt->malloc_gc_threshold = rt->malloc_state.malloc_size +
             (rt->malloc_state.malloc_size >> 1);
+        rt->malloc_gc_minor_threshold = rt->malloc_state.malloc_size +
+            rt->gc_nursery_size;
+    } else if (rt->gc_nursery_size > 0 &&
+               (rt->malloc_state.malloc_size + size) >
+               rt->malloc_gc_minor_threshold) {
+        JS_RunMinorGC(rt);
+        rt->malloc_gc_minor_threshold = rt->malloc_state.malloc_size +
+            rt->gc_nursery_size;
     }
 }
 
@@ -1285,16 +1392,24 @@ static size_t js_malloc_usable_size_unknown(const void *ptr)
 
 void *js_malloc_rt(JSRuntime *rt, size_t size)
 {
-    return rt->mf.js_malloc(&rt->malloc_state, size);
+    void *ptr;
+    ptr = rt->mf.js_malloc(&rt->malloc_state, size);
+    if (unlikely(rt->alloc_profiler != NULL) && ptr)
+        js_alloc_profiler_malloc(rt, ptr, size);
+    return ptr;
 }
 
 void js_free_rt(JSRuntime *rt, void *ptr)
 {
+    if (unlikely(rt->alloc_profiler != NULL) && ptr)
+        js_alloc_profiler_free(rt, ptr);
     rt->mf.js_free(&rt->malloc_state, ptr);
 }
 
 void *js_realloc_rt(JSRuntime *rt, void *ptr, size_t size)
 {
+    if (unlikely(rt->alloc_profiler != NULL))
+        return js_alloc_profiler_realloc(rt, ptr, size);
     return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
 }
 
@@ -1617,6 +1732,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     }
     rt->malloc_state = ms;
     rt->malloc_gc_threshold = 256 * 1024;
+    rt->gc_object_cost_ns = 100;
 
 #ifdef CONFIG_BIGNUM
     bf_context_init(&rt->bf_ctx, js_bf_realloc, rt);
@@ -1627,6 +1743,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
 
     init_list_head(&rt->context_list);
     init_list_head(&rt->gc_obj_list);
+    init_list_head(&rt->gc_young_list);
     init_list_head(&rt->gc_zero_ref_count_list);
     rt->gc_phase = JS_GC_PHASE_NONE;
     
@@ -1634,6 +1751,8 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     init_list_head(&rt->string_list);
 #endif
     init_list_head(&rt->job_list);
+    init_list_head(&rt->regexp_cache.lru);
+    rt->regexp_cache.size = JS_REGEXP_CACHE_DEFAULT_SIZE;
 
     if (JS_InitAtoms(rt))
         goto fail;
@@ -1780,6 +1899,20 @@ void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold)
     rt->malloc_gc_threshold = gc_threshold;
 }
 
+/* use 0 to disable the minor GC */
+void JS_SetGCNurserySize(JSRuntime *rt, size_t size)
+{
+    rt->gc_nursery_size = size;
+    rt->malloc_gc_minor_threshold = rt->malloc_state.malloc_size + size;
+}
+
+/* use 0 to disable the incremental GC */
+void JS_SetGCSliceBudget(JSRuntime *rt, int64_t budget_us)
+{
+    rt->gc_slice_budget = max_int64(budget_us, 0);
+    rt->malloc_gc_full_threshold = rt->malloc_state.malloc_size * 2;
+}
+
 #define malloc(s) malloc_is_forbidden(s)
 #define free(p) free_is_forbidden(p)
 #define realloc(p,s) realloc_is_forbidden(p,s)
@@ -1877,6 +2010,7 @@ static inline JSAtomStruct *atom_set_free(uint32_t v)
 static JSString *js_alloc_string_rt(JSRuntime *rt, int max_len, int is_wide_char)
 {
     JSString *str;
+    rt->alloc_kind = JS_ALLOC_KIND_STRING;
     str = js_malloc_rt(rt, sizeof(JSString) + (max_len << is_wide_char) + 1 - is_wide_char);
     if (unlikely(!str))
         return NULL;
@@ -1885,7 +2019,7 @@ static JSString *js_alloc_string_rt(JSRuntime *rt, int max_len, int is_wide_char
     str->len = max_len;
     str->atom_type = 0;
     str->hash = 0;          /* optional but costless */
-    str->hash_next = 0;     /* optional */
+    str->hash_next = 0;     /* no room reserved for appends */
 #ifdef DUMP_LEAKS
     list_add_tail(&str->link, &rt->string_list);
 #endif
@@ -1929,6 +2063,11 @@ void JS_FreeRuntime(JSRuntime *rt)
     struct list_head *el, *el1;
     int i;
 
+    if (rt->profiler) {
+        js_profiler_free(rt, rt->profiler);
+        rt->profiler = NULL;
+    }
+    JS_StopAllocProfiling(rt);
     JS_FreeValueRT(rt, rt->current_exception);
 
     list_for_each_safe(el, el1, &rt->job_list) {
@@ -1939,6 +2078,8 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
     init_list_head(&rt->job_list);
 
+    JS_SetRegExpCacheSize(rt, 0);
+
     JS_RunGC(rt);
 
 #ifdef DUMP_LEAKS
@@ -1950,6 +2091,7 @@ void JS_FreeRuntime(JSRuntime *rt)
 
         /* remove the internal refcounts to display only the object
            referenced externally */
+        gc_promote_young(rt);
         list_for_each(el, &rt->gc_obj_list) {
             p = list_entry(el, JSGCObjectHeader, link);
             p->mark = 0;
@@ -1981,6 +2123,7 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
 #endif
     assert(list_empty(&rt->gc_obj_list));
+    assert(list_empty(&rt->gc_young_list));
 
     /* free the classes */
     for(i = 0; i < rt->class_count; i++) {
@@ -1992,6 +2135,10 @@ void JS_FreeRuntime(JSRuntime *rt)
     js_free_rt(rt, rt->class_array);
 
 #ifdef CONFIG_BIGNUM
+    for(i = 0; i < rt->bigint_cell_count; i++) {
+        bf_delete(&rt->bigint_cells[i]->num);
+        js_free_rt(rt, rt->bigint_cells[i]);
+    }
     bf_context_end(&rt->bf_ctx);
 #endif
 
@@ -2291,6 +2438,7 @@ void JS_FreeContext(JSContext *ctx)
         JSGCObjectHeader *p;
         printf("JSObjects: {\n");
         JS_DumpObjectHeader(ctx->rt);
+        gc_promote_young(rt);
         list_for_each(el, &rt->gc_obj_list) {
             p = list_entry(el, JSGCObjectHeader, link);
             JS_DumpGCObject(rt, p);
@@ -2440,13 +2588,24 @@ static inline BOOL is_num_string(uint32_t *pval, const JSString *p)
     }
 }
 
-/* XXX: could use faster version ? */
+/* h = h * 263 + c for each character. Four characters are combined at
+   a time with the powers of 263 (modulo 2^32) to shorten the
+   dependency chain. */
+#define HASH_MUL1 263U
+#define HASH_MUL2 69169U
+#define HASH_MUL3 18191447U
+#define HASH_MUL4 489383265U
+
 static inline uint32_t hash_string8(const uint8_t *str, size_t len, uint32_t h)
 {
     size_t i;
 
-    for(i = 0; i < len; i++)
-        h = h * 263 + str[i];
+    for(i = 0; i + 4 <= len; i += 4) {
+        h = h * HASH_MUL4 + str[i] * HASH_MUL3 + str[i + 1] * HASH_MUL2 +
+            str[i + 2] * HASH_MUL1 + str[i + 3];
+    }
+    for(; i < len; i++)
+        h = h * HASH_MUL1 + str[i];
     return h;
 }
 
@@ -2455,8 +2614,12 @@ static inline uint32_t hash_string16(const uint16_t *str,
 {
     size_t i;
 
-    for(i = 0; i < len; i++)
-        h = h * 263 + str[i];
+    for(i = 0; i + 4 <= len; i += 4) {
+        h = h * HASH_MUL4 + str[i] * HASH_MUL3 + str[i + 1] * HASH_MUL2 +
+            str[i + 2] * HASH_MUL1 + str[i + 3];
+    }
+    for(; i < len; i++)
+        h = h * HASH_MUL1 + str[i];
     return h;
 }
 
@@ -2919,9 +3082,8 @@ static void __JS_FreeAtom(JSRuntime *rt, uint32_t i)
 }
 
 /* Warning: 'p' is freed */
-static JSAtom JS_NewAtomStr(JSContext *ctx, JSString *p)
+static JSAtom JS_NewAtomStrRT(JSRuntime *rt, JSString *p)
 {
-    JSRuntime *rt = ctx->rt;
     uint32_t n;
     if (is_num_string(&n, p)) {
         if (n <= JS_ATOM_MAX_INT) {
@@ -2933,6 +3095,12 @@ static JSAtom JS_NewAtomStr(JSContext *ctx, JSString *p)
     return __JS_NewAtom(rt, p, JS_ATOM_TYPE_STRING);
 }
 
+/* Warning: 'p' is freed */
+static JSAtom JS_NewAtomStr(JSContext *ctx, JSString *p)
+{
+    return JS_NewAtomStrRT(ctx->rt, p);
+}
+
 JSAtom JS_NewAtomLen(JSContext *ctx, const char *str, size_t len)
 {
     JSValue val;
@@ -3483,11 +3651,7 @@ static JSValue js_sub_string(JSContext *ctx, JSString *p, int start, int end)
     if (p->is_wide_char && len > 0) {
         JSString *str;
         int i;
-        uint16_t c = 0;
-        for (i = start; i < end; i++) {
-            c |= p->u.str16[i];
-        }
-        if (c > 0xFF)
+        if (latin1_span16(p->u.str16 + start, len) != len)
             return js_new_string16(ctx, p->u.str16 + start, len);
 
         str = js_alloc_string(ctx, len, 0);
@@ -3565,6 +3729,7 @@ static no_inline int string_buffer_widen(StringBuffer *s, int size)
     if (s->error_status)
         return -1;
 
+    s->ctx->rt->alloc_kind = JS_ALLOC_KIND_STRING;
     str = js_realloc2(s->ctx, s->str, sizeof(JSString) + (size << 1), &slack);
     if (!str)
         return string_buffer_set_error(s);
@@ -3596,6 +3761,7 @@ static no_inline int string_buffer_realloc(StringBuffer *s, int new_len, int c)
         return string_buffer_widen(s, new_size);
     }
     new_size_bytes = sizeof(JSString) + (new_size << s->is_wide_char) + 1 - s->is_wide_char;
+    s->ctx->rt->alloc_kind = JS_ALLOC_KIND_STRING;
     new_str = js_realloc2(s->ctx, s->str, new_size_bytes, &slack);
     if (!new_str)
         return string_buffer_set_error(s);
@@ -3639,7 +3805,7 @@ static int string_buffer_putc8(StringBuffer *s, uint32_t c)
 }
 
 /* 0 <= c <= 0xffff */
-static int string_buffer_putc16(StringBuffer *s, uint32_t c)
+static inline int string_buffer_putc16(StringBuffer *s, uint32_t c)
 {
     if (likely(s->len < s->size)) {
         if (s->is_wide_char) {
@@ -3853,10 +4019,8 @@ JSValue JS_NewStringLen(JSContext *ctx, const char *buf, size_t buf_len)
     
     p_start = (const uint8_t *)buf;
     p_end = p_start + buf_len;
-    p = p_start;
-    while (p < p_end && *p < 128)
-        p++;
-    len1 = p - p_start;
+    len1 = ascii_span(p_start, buf_len);
+    p = p_start + len1;
     if (len1 > JS_STRING_LEN_MAX)
         return JS_ThrowInternalError(ctx, "string too long");
     if (p == p_end) {
@@ -3974,21 +4138,18 @@ const char *JS_ToCStringLen2(JSContext *ctx, size_t *plen, JSValueConst val1, BO
         const uint8_t *src = str->u.str8;
         int count;
 
-        /* count the number of non-ASCII characters */
-        /* Scanning the whole string is required for ASCII strings,
-           and computing the number of non-ASCII bytes is less expensive
-           than testing each byte, hence this method is faster for ASCII
-           strings, which is the most common case.
-         */
-        count = 0;
-        for (pos = 0; pos < len; pos++) {
-            count += src[pos] >> 7;
-        }
-        if (count == 0) {
+        /* ASCII strings, which are the most common case, are returned
+           as is. Otherwise count the number of non-ASCII characters. */
+        pos = ascii_span(src, len);
+        if (pos == len) {
             if (plen)
                 *plen = len;
             return (const char *)src;
         }
+        count = 0;
+        for (; pos < len; pos++) {
+            count += src[pos] >> 7;
+        }
         str_new = js_alloc_string(ctx, len + count, 0);
         if (!str_new)
             goto fail;
@@ -4062,24 +4223,20 @@ void JS_FreeCString(JSContext *ctx, const char *ptr)
 
 static int memcmp16_8(const uint16_t *src1, const uint8_t *src2, int len)
 {
-    int c, i;
-    for(i = 0; i < len; i++) {
-        c = src1[i] - src2[i];
-        if (c != 0)
-            return c;
-    }
-    return 0;
+    int i;
+    i = memdiff16_8(src1, src2, len);
+    if (i == len)
+        return 0;
+    return src1[i] - src2[i];
 }
 
 static int memcmp16(const uint16_t *src1, const uint16_t *src2, int len)
 {
-    int c, i;
-    for(i = 0; i < len; i++) {
-        c = src1[i] - src2[i];
-        if (c != 0)
-            return c;
-    }
-    return 0;
+    int i;
+    i = memdiff16(src1, src2, len);
+    if (i == len)
+        return 0;
+    return src1[i] - src2[i];
 }
 
 static int js_string_memcmp(const JSString *p1, const JSString *p2, int len)
@@ -4131,8 +4288,11 @@ static void copy_str16(uint16_t *dst, const JSString *p, int offset, int len)
     }
 }
 
+/* 'max_len' >= p1->len + p2->len is the allocated length of the
+   result: the extra room is used to append in place. */
 static JSValue JS_ConcatString1(JSContext *ctx,
-                                const JSString *p1, const JSString *p2)
+                                const JSString *p1, const JSString *p2,
+                                uint32_t max_len)
 {
     JSString *p;
     uint32_t len;
@@ -4142,9 +4302,12 @@ static JSValue JS_ConcatString1(JSContext *ctx,
     if (len > JS_STRING_LEN_MAX)
         return JS_ThrowInternalError(ctx, "string too long");
     is_wide_char = p1->is_wide_char | p2->is_wide_char;
-    p = js_alloc_string(ctx, len, is_wide_char);
+    p = js_alloc_string(ctx, max_len, is_wide_char);
     if (!p)
         return JS_EXCEPTION;
+    p->len = len;
+    if (max_len > len)
+        p->hash_next = max_len;
     if (!is_wide_char) {
         memcpy(p->u.str8, p1->u.str8, p1->len);
         memcpy(p->u.str8 + p1->len, p2->u.str8, p2->len);
@@ -4156,12 +4319,24 @@ static JSValue JS_ConcatString1(JSContext *ctx,
     return JS_MKPTR(JS_TAG_STRING, p);
 }
 
+/* minimum length of a string built by appending before room is
+   reserved for the next appends */
+#define JS_STRING_APPEND_MIN 256
+
 /* op1 and op2 are converted to strings. For convience, op1 or op2 =
-   JS_EXCEPTION are accepted and return JS_EXCEPTION.  */
-static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
+   JS_EXCEPTION are accepted and return JS_EXCEPTION. If 'pv' is not
+   NULL, it is the variable holding op1 which is overwritten by the
+   result ('s += x'): op1 is then modified in place even if the
+   variable holds a reference to it, and when it is too small it is
+   reallocated with room for the next appends so that building a
+   string by repeated concatenation takes linear time. */
+static JSValue js_concat_string(JSContext *ctx, JSValue op1, JSValue op2,
+                                JSValueConst *pv)
 {
     JSValue ret;
     JSString *p1, *p2;
+    uint32_t len, max_len;
+    int ref_count;
 
     if (unlikely(JS_VALUE_GET_TAG(op1) != JS_TAG_STRING)) {
         op1 = JS_ToStringFree(ctx, op1);
@@ -4184,27 +4359,43 @@ static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
     if (p2->len == 0) {
         goto ret_op1;
     }
-    if (p1->header.ref_count == 1 && p1->is_wide_char == p2->is_wide_char
-    &&  js_malloc_usable_size(ctx, p1) >= sizeof(*p1) + ((p1->len + p2->len) << p2->is_wide_char) + 1 - p1->is_wide_char) {
+    ref_count = 1;
+    if (pv && JS_VALUE_GET_TAG(*pv) == JS_TAG_STRING &&
+        JS_VALUE_GET_PTR(*pv) == p1)
+        ref_count = 2;
+    len = p1->len + p2->len;
+    if (p1->header.ref_count == ref_count && p1->atom_type == 0 &&
+        p1->is_wide_char >= p2->is_wide_char &&
+        len <= JS_STRING_LEN_MAX &&
+        (len <= p1->hash_next ||
+         js_malloc_usable_size(ctx, p1) >= sizeof(*p1) + (len << p1->is_wide_char) + 1 - p1->is_wide_char)) {
         /* Concatenate in place in available space at the end of p1 */
         if (p1->is_wide_char) {
-            memcpy(p1->u.str16 + p1->len, p2->u.str16, p2->len << 1);
-            p1->len += p2->len;
+            copy_str16(p1->u.str16 + p1->len, p2, 0, p2->len);
+            p1->len = len;
         } else {
             memcpy(p1->u.str8 + p1->len, p2->u.str8, p2->len);
-            p1->len += p2->len;
-            p1->u.str8[p1->len] = '\0';
+            p1->len = len;
+            p1->u.str8[len] = '\0';
         }
     ret_op1:
         JS_FreeValue(ctx, op2);
         return op1;
     }
-    ret = JS_ConcatString1(ctx, p1, p2);
+    max_len = len;
+    if (pv && len >= JS_STRING_APPEND_MIN && len <= JS_STRING_LEN_MAX)
+        max_len = min_uint32(len + len / 2, JS_STRING_LEN_MAX);
+    ret = JS_ConcatString1(ctx, p1, p2, max_len);
     JS_FreeValue(ctx, op1);
     JS_FreeValue(ctx, op2);
     return ret;
 }
 
+static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
+{
+    return js_concat_string(ctx, op1, op2, NULL);
+}
+
 /* Shape support */
 
 static inline size_t get_shape_size(size_t hash_size, size_t prop_size)
@@ -4342,6 +4533,7 @@ static no_inline JSShape *js_new_shape2(JSContext *ctx, JSObject *proto,
     sh->prop_size = prop_size;
     sh->prop_count = 0;
     sh->deleted_prop_count = 0;
+    sh->enum_keys = NULL;
     
     /* insert in the hash table */
     sh->hash = shape_initial_hash(proto);
@@ -4378,6 +4570,7 @@ static JSShape *js_clone_shape(JSContext *ctx, JSShape *sh1)
     sh->header.ref_count = 1;
     add_gc_object(ctx->rt, &sh->header, JS_GC_OBJ_TYPE_SHAPE);
     sh->is_hashed = FALSE;
+    sh->enum_keys = NULL;
     if (sh->proto) {
         JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
     }
@@ -4393,6 +4586,26 @@ static JSShape *js_dup_shape(JSShape *sh)
     return sh;
 }
 
+static void js_free_enum_keys(JSRuntime *rt, JSEnumKeys *keys)
+{
+    uint32_t i;
+
+    if (--keys->ref_count == 0) {
+        for(i = 0; i < keys->count; i++)
+            JS_FreeAtomRT(rt, keys->atoms[i]);
+        js_free_rt(rt, keys);
+    }
+}
+
+/* must be called before modifying the properties of 'sh' in place */
+static inline void js_shape_clear_enum_keys(JSRuntime *rt, JSShape *sh)
+{
+    if (sh->enum_keys) {
+        js_free_enum_keys(rt, sh->enum_keys);
+        sh->enum_keys = NULL;
+    }
+}
+
 static void js_free_shape0(JSRuntime *rt, JSShape *sh)
 {
     uint32_t i;
@@ -4401,6 +4614,7 @@ static void js_free_shape0(JSRuntime *rt, JSShape *sh)
     assert(sh->header.ref_count == 0);
     if (sh->is_hashed)
         js_shape_hash_unlink(rt, sh);
+    js_shape_clear_enum_keys(rt, sh);
     if (sh->proto != NULL) {
         JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
     }
@@ -4435,6 +4649,7 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
     JSShapeProperty *pr;
     void *sh_alloc;
     intptr_t h;
+    struct list_head *prev;
 
     sh = *psh;
     new_size = max_int(count, sh->prop_size * 3 / 2);
@@ -4458,11 +4673,13 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         if (!sh_alloc)
             return -1;
         sh = get_shape_from_alloc(sh_alloc, new_hash_size);
+        /* keep the position in the GC list (young or old) */
+        prev = old_sh->header.link.prev;
         list_del(&old_sh->header.link);
         /* copy all the fields and the properties */
         memcpy(sh, old_sh,
                sizeof(JSShape) + sizeof(sh->prop[0]) * old_sh->prop_count);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add(&sh->header.link, prev);
         new_hash_mask = new_hash_size - 1;
         sh->prop_hash_mask = new_hash_mask;
         memset(prop_hash_end(sh) - new_hash_size, 0,
@@ -4477,16 +4694,17 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         js_free(ctx, get_alloc_from_shape(old_sh));
     } else {
         /* only resize the properties */
+        prev = sh->header.link.prev;
         list_del(&sh->header.link);
         sh_alloc = js_realloc(ctx, get_alloc_from_shape(sh),
                               get_shape_size(new_hash_size, new_size));
         if (unlikely(!sh_alloc)) {
             /* insert again in the GC list */
-            list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+            list_add(&sh->header.link, prev);
             return -1;
         }
         sh = get_shape_from_alloc(sh_alloc, new_hash_size);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add(&sh->header.link, prev);
     }
     *psh = sh;
     sh->prop_size = new_size;
@@ -4502,6 +4720,7 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     uint32_t new_hash_size, i, j, new_hash_mask, new_size;
     JSShapeProperty *old_pr, *pr;
     JSProperty *prop, *new_prop;
+    struct list_head *prev;
     
     sh = p->shape;
     assert(!sh->is_hashed);
@@ -4521,9 +4740,10 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     if (!sh_alloc)
         return -1;
     sh = get_shape_from_alloc(sh_alloc, new_hash_size);
+    prev = old_sh->header.link.prev;
     list_del(&old_sh->header.link);
     memcpy(sh, old_sh, sizeof(JSShape));
-    list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+    list_add(&sh->header.link, prev);
     
     memset(prop_hash_end(sh) - new_hash_size, 0,
            sizeof(prop_hash_end(sh)[0]) * new_hash_size);
@@ -4570,6 +4790,7 @@ static int add_shape_property(JSContext *ctx, JSShape **psh,
     uint32_t hash_mask, new_shape_hash = 0;
     intptr_t h;
 
+    js_shape_clear_enum_keys(rt, sh);
     /* update the shape hash */
     if (sh->is_hashed) {
         js_shape_hash_unlink(rt, sh);
@@ -4690,6 +4911,7 @@ static __maybe_unused void JS_DumpShapes(JSRuntime *rt)
         }
     }
     /* dump non-hashed shapes */
+    gc_promote_young(rt);
     list_for_each(el, &rt->gc_obj_list) {
         gp = list_entry(el, JSGCObjectHeader, link);
         if (gp->gc_obj_type == JS_GC_OBJ_TYPE_JS_OBJECT) {
@@ -4707,6 +4929,7 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
     JSObject *p;
 
     js_trigger_gc(ctx->rt, sizeof(JSObject));
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_OBJECT;
     p = js_malloc(ctx, sizeof(JSObject));
     if (unlikely(!p))
         goto fail;
@@ -4722,6 +4945,7 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
     p->first_weak_ref = NULL;
     p->u.opaque = NULL;
     p->shape = sh;
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_OBJECT;
     p->prop = js_malloc(ctx, sizeof(JSProperty) * sh->prop_size);
     if (unlikely(!p->prop)) {
         js_free(ctx, p);
@@ -4741,6 +4965,7 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
             p->u.array.u.values = NULL;
             p->u.array.count = 0;
             p->u.array.u1.size = 0;
+            p->u.array.u1.kind = JS_ARRAY_KIND_VALUE;
             /* the length property is always the first one */
             if (likely(sh == ctx->array_shape)) {
                 pr = &p->prop[0];
@@ -4757,6 +4982,13 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
         p->prop[0].u.value = JS_UNDEFINED;
         break;
     case JS_CLASS_ARGUMENTS:
+        p->is_exotic = 1;
+        p->fast_array = 1;
+        p->u.array.u.values = NULL;
+        p->u.array.count = 0;
+        p->u.array.u1.size = 0;
+        p->u.array.u1.kind = JS_ARRAY_KIND_VALUE;
+        break;
     case JS_CLASS_UINT8C_ARRAY:
     case JS_CLASS_INT8_ARRAY:
     case JS_CLASS_UINT8_ARRAY:
@@ -5242,15 +5474,44 @@ static void free_var_ref(JSRuntime *rt, JSVarRef *var_ref)
     }
 }
 
+static inline size_t js_array_kind_size(JSArrayKindEnum kind)
+{
+    switch(kind) {
+    case JS_ARRAY_KIND_INT32:
+        return sizeof(int32_t);
+    case JS_ARRAY_KIND_FLOAT64:
+        return sizeof(double);
+    default:
+        return sizeof(JSValue);
+    }
+}
+
+/* return the element 'idx' of the fast array 'p'. The value is not
+   duplicated. */
+static inline JSValue js_fast_array_get(JSContext *ctx, JSObject *p,
+                                        uint32_t idx)
+{
+    switch(p->u.array.u1.kind) {
+    case JS_ARRAY_KIND_INT32:
+        return JS_NewInt32(ctx, p->u.array.u.int32_ptr[idx]);
+    case JS_ARRAY_KIND_FLOAT64:
+        return JS_NewFloat64(ctx, p->u.array.u.double_ptr[idx]);
+    default:
+        return p->u.array.u.values[idx];
+    }
+}
+
 static void js_array_finalizer(JSRuntime *rt, JSValue val)
 {
     JSObject *p = JS_VALUE_GET_OBJ(val);
     int i;
 
-    for(i = 0; i < p->u.array.count; i++) {
-        JS_FreeValueRT(rt, p->u.array.u.values[i]);
+    if (p->u.array.u1.kind == JS_ARRAY_KIND_VALUE) {
+        for(i = 0; i < p->u.array.count; i++) {
+            JS_FreeValueRT(rt, p->u.array.u.values[i]);
+        }
     }
-    js_free_rt(rt, p->u.array.u.values);
+    js_free_rt(rt, p->u.array.u.ptr);
 }
 
 static void js_array_mark(JSRuntime *rt, JSValueConst val,
@@ -5259,6 +5520,8 @@ static void js_array_mark(JSRuntime *rt, JSValueConst val,
     JSObject *p = JS_VALUE_GET_OBJ(val);
     int i;
 
+    if (p->u.array.u1.kind != JS_ARRAY_KIND_VALUE)
+        return;
     for(i = 0; i < p->u.array.count; i++) {
         JS_MarkValue(rt, p->u.array.u.values[i], mark_func);
     }
@@ -5377,6 +5640,8 @@ static void js_for_in_iterator_finalizer(JSRuntime *rt, JSValue val)
     JSObject *p = JS_VALUE_GET_OBJ(val);
     JSForInIterator *it = p->u.for_in_iterator;
     JS_FreeValueRT(rt, it->obj);
+    if (it->keys)
+        js_free_enum_keys(rt, it->keys);
     js_free_rt(rt, it);
 }
 
@@ -5507,6 +5772,12 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
                 if (rt->gc_phase == JS_GC_PHASE_NONE) {
                     free_zero_refcount(rt);
                 }
+            } else if (p->mark == 0) {
+                /* not part of the freed cycles: only referenced from
+                   them, which happens when a GC slice did not scan
+                   this object. It is freed with the cycles. */
+                list_del(&p->link);
+                list_add_tail(&p->link, &rt->tmp_obj_list);
             }
         }
         break;
@@ -5515,6 +5786,18 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
         break;
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_INT:
+        {
+            JSBigFloat *bf = JS_VALUE_GET_PTR(v);
+            /* keep the small BigInts with their limb for reuse */
+            if (bf->num.len == 1 &&
+                rt->bigint_cell_count < JS_BIGINT_CELL_CACHE_SIZE) {
+                rt->bigint_cells[rt->bigint_cell_count++] = bf;
+            } else {
+                bf_delete(&bf->num);
+                js_free_rt(rt, bf);
+            }
+        }
+        break;
     case JS_TAG_BIG_FLOAT:
         {
             JSBigFloat *bf = JS_VALUE_GET_PTR(v);
@@ -5554,7 +5837,13 @@ static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
 {
     h->mark = 0;
     h->gc_obj_type = type;
-    list_add_tail(&h->link, &rt->gc_obj_list);
+    list_add_tail(&h->link, &rt->gc_young_list);
+}
+
+/* move the young objects to gc_obj_list */
+static void gc_promote_young(JSRuntime *rt)
+{
+    list_splice_tail(&rt->gc_young_list, &rt->gc_obj_list);
 }
 
 static void remove_gc_object(JSGCObjectHeader *h)
@@ -5681,10 +5970,12 @@ static void gc_decref_child(JSRuntime *rt, JSGCObjectHeader *p)
     }
 }
 
-static void gc_decref(JSRuntime *rt)
+/* return the number of scanned objects */
+static int64_t gc_decref(JSRuntime *rt)
 {
     struct list_head *el, *el1;
     JSGCObjectHeader *p;
+    int64_t count = 0;
     
     init_list_head(&rt->tmp_obj_list);
 
@@ -5700,7 +5991,9 @@ static void gc_decref(JSRuntime *rt)
             list_del(&p->link);
             list_add_tail(&p->link, &rt->tmp_obj_list);
         }
+        count++;
     }
+    return count;
 }
 
 static void gc_scan_incref_child(JSRuntime *rt, JSGCObjectHeader *p)
@@ -5789,17 +6082,236 @@ static void gc_free_cycles(JSRuntime *rt)
     init_list_head(&rt->gc_zero_ref_count_list);
 }
 
+#if defined(__linux__) || defined(__APPLE__)
+static int64_t get_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + (ts.tv_nsec / 1000);
+}
+#else
+/* more portable, but does not work if the date is updated */
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+#endif
+
+typedef enum {
+    JS_GC_KIND_FULL,
+    JS_GC_KIND_SLICE,
+    JS_GC_KIND_MINOR,
+} JSGCKindEnum;
+
+static void gc_update_stats(JSRuntime *rt, int64_t start_time,
+                            int64_t count, JSGCKindEnum kind)
+{
+    JSGCStats *s = &rt->gc_stats;
+    int64_t pause;
+    int i;
+
+    pause = max_int64(get_time_us() - start_time, 0);
+    switch(kind) {
+    case JS_GC_KIND_FULL:
+        s->full_count++;
+        break;
+    case JS_GC_KIND_SLICE:
+        s->slice_count++;
+        break;
+    case JS_GC_KIND_MINOR:
+        s->minor_count++;
+        break;
+    }
+    s->total_pause_us += pause;
+    s->max_pause_us = max_int64(s->max_pause_us, pause);
+    i = pause > 0 ? 63 - clz64(pause) : 0;
+    s->pause_histogram[min_int(i, JS_GC_PAUSE_HISTOGRAM_SIZE - 1)]++;
+
+    /* smoothed cost used to size the next slices */
+    if (count > 0) {
+        rt->gc_object_cost_ns = max_int64((rt->gc_object_cost_ns * 3 +
+                                           pause * 1000 / count) / 4, 1);
+    }
+}
+
 void JS_RunGC(JSRuntime *rt)
 {
+    int64_t start_time, count;
+
+    start_time = get_time_us();
+    gc_promote_young(rt);
+
     /* decrement the reference of the children of each object. mark =
        1 after this pass. */
-    gc_decref(rt);
+    count = gc_decref(rt);
 
     /* keep the GC objects with a non zero refcount and their childs */
     gc_scan(rt);
 
     /* free the GC objects in a cycle */
     gc_free_cycles(rt);
+
+    rt->malloc_gc_full_threshold = rt->malloc_state.malloc_size * 2;
+    gc_update_stats(rt, start_time, count, JS_GC_KIND_FULL);
+}
+
+/* Incremental GC: a slice runs the cycle detection on a window of
+   objects taken at the head of gc_obj_list. The objects of the window
+   have mark = 2 before being visited. The objects outside of the
+   window (mark = 0) are not modified and are considered as live, so a
+   slice only frees the cycles entirely contained in its window. The
+   minor GC uses the young objects as window. */
+
+static void gc_decref_child_window(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark == 0)
+        return;
+    gc_decref_child(rt, p);
+}
+
+static void gc_scan_incref_child_window(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark == 0)
+        return;
+    p->ref_count++;
+    if (p->ref_count == 1) {
+        /* ref_count was 0: back in the window. The mark is reset
+           once the scan is done. */
+        list_del(&p->link);
+        list_add_tail(&p->link, &rt->gc_obj_list);
+    }
+}
+
+static void gc_scan_incref_child2_window(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark == 0)
+        return;
+    p->ref_count++;
+}
+
+/* move the elements of 'head' from 'el' to the end into 'list' */
+static void gc_list_cut(struct list_head *list, struct list_head *head,
+                        struct list_head *el)
+{
+    struct list_head *last;
+
+    init_list_head(list);
+    if (el == head)
+        return;
+    last = head->prev;
+    head->prev = el->prev;
+    el->prev->next = head;
+    list->next = el;
+    el->prev = list;
+    list->prev = last;
+    last->next = list;
+}
+
+/* run the cycle detection on the objects of gc_obj_list, the objects
+   of 'rest' are not scanned. gc_obj_list is then made of 'rest'
+   followed by the survivors. Return the number of scanned objects. */
+static int64_t gc_collect_window(JSRuntime *rt, struct list_head *rest)
+{
+    struct list_head *el, *el1;
+    JSGCObjectHeader *p;
+    int64_t count;
+
+    count = 0;
+    list_for_each(el, &rt->gc_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->mark == 0);
+        p->mark = 2;
+        count++;
+    }
+
+    init_list_head(&rt->tmp_obj_list);
+    list_for_each_safe(el, el1, &rt->gc_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_decref_child_window);
+        p->mark = 1;
+        if (p->ref_count == 0) {
+            list_del(&p->link);
+            list_add_tail(&p->link, &rt->tmp_obj_list);
+        }
+    }
+
+    list_for_each(el, &rt->gc_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->ref_count > 0);
+        mark_children(rt, p, gc_scan_incref_child_window);
+    }
+    list_for_each(el, &rt->tmp_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_scan_incref_child2_window);
+    }
+    list_for_each(el, &rt->gc_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        p->mark = 0;
+    }
+
+    list_splice_tail(&rt->gc_obj_list, rest);
+    list_splice_tail(rest, &rt->gc_obj_list);
+
+    gc_free_cycles(rt);
+    return count;
+}
+
+JS_BOOL JS_RunGCSlice(JSRuntime *rt, int64_t budget_us)
+{
+    struct list_head *el, rest;
+    int64_t start_time, count, max_count;
+    BOOL is_full;
+
+    start_time = get_time_us();
+    max_count = max_int64(budget_us, 1) * 1000 / rt->gc_object_cost_ns;
+    max_count = max_int64(max_count, 64);
+
+    gc_promote_young(rt);
+    /* the window stays in gc_obj_list, the other objects are moved
+       to 'rest'. The survivors go after them so that the next slice
+       starts with the objects which were not scanned. */
+    count = 0;
+    for(el = rt->gc_obj_list.next; el != &rt->gc_obj_list && count < max_count;
+        el = el->next) {
+        count++;
+    }
+    is_full = (el == &rt->gc_obj_list);
+    gc_list_cut(&rest, &rt->gc_obj_list, el);
+    count = gc_collect_window(rt, &rest);
+
+    if (is_full)
+        rt->malloc_gc_full_threshold = rt->malloc_state.malloc_size * 2;
+    gc_update_stats(rt, start_time, count, JS_GC_KIND_SLICE);
+    return is_full;
+}
+
+/* Generational GC: the minor GC only scans the objects allocated since
+   the last collection. No remembered set is needed because the
+   references from the old objects are counted in the reference count
+   of the young objects, which are then seen as live. The survivors are
+   promoted. */
+void JS_RunMinorGC(JSRuntime *rt)
+{
+    struct list_head rest;
+    int64_t start_time, count;
+
+    start_time = get_time_us();
+    gc_list_cut(&rest, &rt->gc_obj_list, rt->gc_obj_list.next);
+    list_splice_tail(&rt->gc_young_list, &rt->gc_obj_list);
+    count = gc_collect_window(rt, &rest);
+    gc_update_stats(rt, start_time, count, JS_GC_KIND_MINOR);
+}
+
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s)
+{
+    *s = rt->gc_stats;
+}
+
+void JS_ResetGCStats(JSRuntime *rt)
+{
+    memset(&rt->gc_stats, 0, sizeof(rt->gc_stats));
 }
 
 /* Return false if not an object or if the object has already been
@@ -5956,6 +6468,7 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
         }
     }
 
+    gc_promote_young(rt);
     list_for_each(el, &rt->gc_obj_list) {
         JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
         JSObject *p;
@@ -5998,13 +6511,15 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
             s->array_count++;
             if (p->fast_array) {
                 s->fast_array_count++;
-                if (p->u.array.u.values) {
+                if (p->u.array.u.ptr) {
                     s->memory_used_count++;
                     s->memory_used_size += p->u.array.count *
-                        sizeof(*p->u.array.u.values);
+                        js_array_kind_size(p->u.array.u1.kind);
                     s->fast_array_elements += p->u.array.count;
-                    for (i = 0; i < p->u.array.count; i++) {
-                        compute_value_size(p->u.array.u.values[i], hp);
+                    if (p->u.array.u1.kind == JS_ARRAY_KIND_VALUE) {
+                        for (i = 0; i < p->u.array.count; i++) {
+                            compute_value_size(p->u.array.u.values[i], hp);
+                        }
                     }
                 }
             }
@@ -6225,6 +6740,7 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
             int obj_classes[JS_CLASS_INIT_COUNT + 1] = { 0 };
             int class_id;
             struct list_head *el;
+            gc_promote_young(rt);
             list_for_each(el, &rt->gc_obj_list) {
                 JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
                 JSObject *p;
@@ -6543,6 +7059,1474 @@ static void build_backtrace(JSContext *ctx, JSValueConst error_obj,
                            JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
 }
 
+/* Stack frames interned by the profilers */
+
+typedef struct JSProfileNode {
+    JSAtom func_name;
+    JSAtom filename; /* JS_ATOM_NULL for native functions */
+    int line_num; /* line of the function definition */
+    uint32_t hash_next; /* index + 1 of the next node in the bucket */
+} JSProfileNode;
+
+typedef struct JSProfileFrames {
+    JSProfileNode *nodes;
+    uint32_t node_count;
+    uint32_t node_size;
+    uint32_t *node_hash; /* node_size * 2 entries, index + 1, 0 = none */
+} JSProfileFrames;
+
+static uint32_t js_profile_node_hash(JSAtom func_name, JSAtom filename,
+                                     int line_num)
+{
+    uint32_t h;
+    h = func_name * 0x9e3779b1;
+    h = (h ^ filename) * 0x9e3779b1;
+    h = (h ^ line_num) * 0x9e3779b1;
+    return h ^ (h >> 16);
+}
+
+static int js_profile_frames_resize(JSRuntime *rt, JSProfileFrames *pf)
+{
+    uint32_t new_size, hash_size, i, h;
+    JSProfileNode *new_nodes, *n;
+    uint32_t *new_hash;
+
+    new_size = max_int(64, pf->node_size * 2);
+    hash_size = new_size * 2;
+    new_nodes = js_realloc_rt(rt, pf->nodes, sizeof(pf->nodes[0]) * new_size);
+    if (!new_nodes)
+        return -1;
+    pf->nodes = new_nodes;
+    new_hash = js_mallocz_rt(rt, sizeof(new_hash[0]) * hash_size);
+    if (!new_hash)
+        return -1;
+    for(i = 0; i < pf->node_count; i++) {
+        n = &pf->nodes[i];
+        h = js_profile_node_hash(n->func_name, n->filename, n->line_num) &
+            (hash_size - 1);
+        n->hash_next = new_hash[h];
+        new_hash[h] = i + 1;
+    }
+    js_free_rt(rt, pf->node_hash);
+    pf->node_hash = new_hash;
+    pf->node_size = new_size;
+    return 0;
+}
+
+/* return the index of the node or -1 if memory error */
+static int js_profile_frames_get_node(JSRuntime *rt, JSProfileFrames *pf,
+                                      JSAtom func_name, JSAtom filename,
+                                      int line_num)
+{
+    uint32_t h, i;
+    JSProfileNode *n;
+
+    h = js_profile_node_hash(func_name, filename, line_num);
+    if (pf->node_hash) {
+        for(i = pf->node_hash[h & (pf->node_size * 2 - 1)]; i != 0;
+            i = n->hash_next) {
+            n = &pf->nodes[i - 1];
+            if (n->func_name == func_name && n->filename == filename &&
+                n->line_num == line_num)
+                return i - 1;
+        }
+    }
+    if (pf->node_count >= pf->node_size) {
+        if (js_profile_frames_resize(rt, pf))
+            return -1;
+    }
+    i = pf->node_count++;
+    n = &pf->nodes[i];
+    n->func_name = JS_DupAtomRT(rt, func_name);
+    n->filename = JS_DupAtomRT(rt, filename);
+    n->line_num = line_num;
+    h &= pf->node_size * 2 - 1;
+    n->hash_next = pf->node_hash[h];
+    pf->node_hash[h] = i + 1;
+    return i;
+}
+
+/* return the node of the function of a stack frame or -1 if memory
+   error */
+static int js_profile_frames_get(JSRuntime *rt, JSProfileFrames *pf,
+                                 JSValueConst func)
+{
+    JSObject *p;
+    JSFunctionBytecode *b;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSAtom name;
+    int ret;
+
+    if (JS_VALUE_GET_TAG(func) != JS_TAG_OBJECT)
+        return js_profile_frames_get_node(rt, pf, JS_ATOM_NULL, JS_ATOM_NULL, 0);
+    p = JS_VALUE_GET_OBJ(func);
+    if (js_class_has_bytecode(p->class_id)) {
+        b = p->u.func.function_bytecode;
+        if (b->has_debug) {
+            return js_profile_frames_get_node(rt, pf, b->func_name,
+                                              b->debug.filename,
+                                              b->debug.line_num);
+        } else {
+            return js_profile_frames_get_node(rt, pf, b->func_name,
+                                              JS_ATOM_NULL, 0);
+        }
+    }
+    /* native function: use its 'name' property if it was not modified */
+    name = JS_ATOM_NULL;
+    prs = find_own_property(&pr, p, JS_ATOM_name);
+    if (prs && (prs->flags & JS_PROP_TMASK) == JS_PROP_NORMAL &&
+        JS_VALUE_GET_TAG(pr->u.value) == JS_TAG_STRING) {
+        name = JS_NewAtomStrRT(rt, JS_VALUE_GET_STRING(JS_DupValueRT(rt, pr->u.value)));
+    }
+    ret = js_profile_frames_get_node(rt, pf, name, JS_ATOM_NULL, 0);
+    JS_FreeAtomRT(rt, name);
+    return ret;
+}
+
+static void js_profile_frames_free(JSRuntime *rt, JSProfileFrames *pf)
+{
+    uint32_t i;
+
+    for(i = 0; i < pf->node_count; i++) {
+        JS_FreeAtomRT(rt, pf->nodes[i].func_name);
+        JS_FreeAtomRT(rt, pf->nodes[i].filename);
+    }
+    js_free_rt(rt, pf->nodes);
+    js_free_rt(rt, pf->node_hash);
+}
+
+/* Sampling profiler. The samples are taken from the interrupt poll
+   points, so no timer thread is needed: while profiling, the interrupt
+   counter is reset to a small value and the current stack is recorded
+   each time at least 'interval_us' elapsed since the last sample. */
+
+#define JS_PROFILER_COUNTER_INIT 1000
+
+typedef struct JSProfiler {
+    int64_t interval_us;
+    int64_t start_time; /* in us */
+    int64_t next_sample_time;
+    JSProfileFrames frames;
+    /* each sample is the 64 bit time relative to start_time, the stack
+       depth and 'depth' node indexes from the innermost frame. An empty
+       stack means that no JS code was running. */
+    DynBuf samples;
+    BOOL idle; /* TRUE if the last sample has an empty stack */
+} JSProfiler;
+
+static void js_profiler_add_sample(JSContext *ctx, JSProfiler *prof,
+                                   int64_t time)
+{
+    JSStackFrame *sf;
+    size_t depth_pos;
+    uint32_t depth;
+    int64_t t;
+    int node;
+
+    t = time - prof->start_time;
+    dbuf_put(&prof->samples, (const uint8_t *)&t, sizeof(t));
+    depth_pos = prof->samples.size;
+    depth = 0;
+    dbuf_put_u32(&prof->samples, depth);
+    for(sf = ctx->rt->current_stack_frame; sf != NULL; sf = sf->prev_frame) {
+        node = js_profile_frames_get(ctx->rt, &prof->frames, sf->cur_func);
+        if (node < 0)
+            break;
+        dbuf_put_u32(&prof->samples, node);
+        depth++;
+    }
+    if (!dbuf_error(&prof->samples))
+        memcpy(prof->samples.buf + depth_pos, &depth, sizeof(depth));
+    prof->idle = (depth == 0);
+}
+
+static void js_profiler_poll(JSContext *ctx)
+{
+    JSProfiler *prof = ctx->rt->profiler;
+    int64_t now;
+
+    ctx->interrupt_counter = JS_PROFILER_COUNTER_INIT;
+    now = get_time_us();
+    if (now >= prof->next_sample_time) {
+        js_profiler_add_sample(ctx, prof, now);
+        prof->next_sample_time = now + prof->interval_us;
+    }
+}
+
+/* called when the outermost stack frame is removed */
+static void js_profiler_leave(JSRuntime *rt)
+{
+    JSProfiler *prof = rt->profiler;
+    int64_t t;
+    uint32_t depth;
+
+    if (prof->idle)
+        return;
+    t = get_time_us() - prof->start_time;
+    depth = 0;
+    dbuf_put(&prof->samples, (const uint8_t *)&t, sizeof(t));
+    dbuf_put_u32(&prof->samples, depth);
+    prof->idle = TRUE;
+}
+
+static void js_profiler_free(JSRuntime *rt, JSProfiler *prof)
+{
+    js_profile_frames_free(rt, &prof->frames);
+    dbuf_free(&prof->samples);
+    js_free_rt(rt, prof);
+}
+
+int JS_StartProfiling(JSRuntime *rt, int64_t interval_us)
+{
+    JSProfiler *prof;
+
+    if (rt->profiler)
+        return -1;
+    prof = js_mallocz_rt(rt, sizeof(*prof));
+    if (!prof)
+        return -1;
+    prof->interval_us = max_int64(interval_us, 1);
+    prof->start_time = get_time_us();
+    prof->next_sample_time = prof->start_time;
+    dbuf_init2(&prof->samples, rt, (DynBufReallocFunc *)js_realloc_rt);
+    prof->idle = TRUE;
+    rt->profiler = prof;
+    return 0;
+}
+
+static void js_profiler_put_json_str(FILE *f, const char *str)
+{
+    const uint8_t *p;
+    int c;
+
+    fputc('"', f);
+    for(p = (const uint8_t *)str; *p != '\0'; p++) {
+        c = *p;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void js_profiler_put_event(JSRuntime *rt, FILE *f, JSProfiler *prof,
+                                  uint32_t node, int64_t start, int64_t end,
+                                  BOOL *pfirst)
+{
+    JSProfileNode *n = &prof->frames.nodes[node];
+    char buf[256];
+
+    fputs(*pfirst ? "\n" : ",\n", f);
+    *pfirst = FALSE;
+    fputs("{\"name\":", f);
+    if (n->func_name == JS_ATOM_NULL || n->func_name == JS_ATOM_empty_string)
+        js_profiler_put_json_str(f, "(anonymous)");
+    else
+        js_profiler_put_json_str(f, JS_AtomGetStrRT(rt, buf, sizeof(buf), n->func_name));
+    fprintf(f, ",\"cat\":\"js\",\"ph\":\"X\",\"ts\":%" PRId64
+            ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":1,\"args\":{",
+            start, end - start);
+    if (n->filename != JS_ATOM_NULL) {
+        fputs("\"url\":", f);
+        js_profiler_put_json_str(f, JS_AtomGetStrRT(rt, buf, sizeof(buf), n->filename));
+        fprintf(f, ",\"line\":%d", n->line_num);
+    } else {
+        fputs("\"native\":true", f);
+    }
+    fputs("}}", f);
+}
+
+/* Write the samples in the Chrome trace event format. Consecutive
+   samples sharing the same outer frames are merged into one complete
+   ("X") event per frame. */
+static int js_profiler_write_trace(JSRuntime *rt, JSProfiler *prof,
+                                   const char *filename)
+{
+    const uint8_t *ptr, *end;
+    uint32_t *stack, *start_stack, *open_stack;
+    int64_t *open_time, t, last_time;
+    uint32_t depth, open_depth, max_depth, i, j, node;
+    BOOL first;
+    FILE *f;
+    int ret;
+
+    if (dbuf_error(&prof->samples))
+        return -1;
+    /* the stack depth is bounded by the number of sampled frames */
+    max_depth = 0;
+    for(ptr = prof->samples.buf, end = ptr + prof->samples.size; ptr < end;) {
+        memcpy(&depth, ptr + sizeof(int64_t), sizeof(depth));
+        max_depth = max_uint32(max_depth, depth);
+        ptr += sizeof(int64_t) + sizeof(uint32_t) * (depth + 1);
+    }
+    open_stack = js_malloc_rt(rt, sizeof(open_stack[0]) * (max_depth + 1));
+    open_time = js_malloc_rt(rt, sizeof(open_time[0]) * (max_depth + 1));
+    start_stack = js_malloc_rt(rt, sizeof(start_stack[0]) * (max_depth + 1));
+    f = NULL;
+    ret = -1;
+    if (!open_stack || !open_time || !start_stack)
+        goto done;
+    f = fopen(filename, "w");
+    if (!f)
+        goto done;
+    fputs("{\"traceEvents\":[", f);
+    first = TRUE;
+    open_depth = 0;
+    last_time = 0;
+    for(ptr = prof->samples.buf; ptr < end;) {
+        memcpy(&t, ptr, sizeof(t));
+        memcpy(&depth, ptr + sizeof(t), sizeof(depth));
+        /* the nodes are stored from the innermost frame */
+        stack = (uint32_t *)(ptr + sizeof(t) + sizeof(depth));
+        for(i = 0; i < depth; i++)
+            memcpy(&start_stack[i], &stack[depth - 1 - i], sizeof(uint32_t));
+        ptr += sizeof(t) + sizeof(depth) * (depth + 1);
+        /* common prefix with the open frames */
+        for(i = 0; i < open_depth && i < depth; i++) {
+            if (open_stack[i] != start_stack[i])
+                break;
+        }
+        /* close the frames which are no longer on the stack */
+        for(j = open_depth; j > i; j--) {
+            js_profiler_put_event(rt, f, prof, open_stack[j - 1],
+                                  open_time[j - 1], t, &first);
+        }
+        for(; i < depth; i++) {
+            node = start_stack[i];
+            open_stack[i] = node;
+            open_time[i] = t;
+        }
+        open_depth = depth;
+        last_time = t;
+    }
+    for(j = open_depth; j > 0; j--) {
+        js_profiler_put_event(rt, f, prof, open_stack[j - 1],
+                              open_time[j - 1], last_time, &first);
+    }
+    fputs(first ? "" : "\n", f);
+    fputs("],\"displayTimeUnit\":\"ms\"}\n", f);
+    ret = 0;
+ done:
+    if (f && fclose(f) != 0)
+        ret = -1;
+    js_free_rt(rt, start_stack);
+    js_free_rt(rt, open_time);
+    js_free_rt(rt, open_stack);
+    return ret;
+}
+
+int JS_StopProfiling(JSRuntime *rt, const char *filename)
+{
+    JSProfiler *prof = rt->profiler;
+    int ret;
+
+    if (!prof)
+        return -1;
+    rt->profiler = NULL;
+    ret = 0;
+    if (filename)
+        ret = js_profiler_write_trace(rt, prof, filename);
+    js_profiler_free(rt, prof);
+    return ret;
+}
+
+/* Allocation sampling profiler. Each time 'interval' bytes were
+   allocated, the current allocation is recorded with its kind and the
+   JS stack. The sample is removed when the memory is freed, so a dump
+   shows where the sampled live memory was allocated. */
+
+#define JS_ALLOC_STACK_HASH_SIZE 1024
+
+static const char * const js_alloc_kind_names[JS_ALLOC_KIND_COUNT] = {
+    "other", "object", "string", "array", "bytecode",
+};
+
+typedef struct JSAllocSample {
+    void *ptr;
+    size_t size; /* allocated bytes represented by the sample */
+    size_t block_size; /* requested size of the block */
+    /* index + 1 of the next sample in the hash bucket or in the free
+       list */
+    uint32_t hash_next;
+    uint32_t stack; /* offset of the stack in JSAllocProfiler.stacks */
+    JSAllocKindEnum kind;
+} JSAllocSample;
+
+typedef struct JSAllocProfiler {
+    size_t interval;
+    size_t bytes_until_sample;
+    BOOL busy; /* TRUE while the profiler allocates its own memory */
+    JSProfileFrames frames;
+    /* interned stacks: offset + 1 of the next stack in the hash bucket,
+       the depth and 'depth' node indexes from the innermost frame */
+    DynBuf stacks;
+    uint32_t stack_hash[JS_ALLOC_STACK_HASH_SIZE]; /* offset + 1 */
+    JSAllocSample *samples;
+    uint32_t sample_count; /* number of used entries in 'samples' */
+    uint32_t sample_size; /* power of two */
+    uint32_t free_sample; /* index + 1 of the first free entry */
+    uint32_t *sample_hash; /* sample_size entries, index + 1 */
+} JSAllocProfiler;
+
+static inline uint32_t js_alloc_sample_hash(JSAllocProfiler *prof,
+                                            const void *ptr)
+{
+    uint32_t h = (uint32_t)((uintptr_t)ptr >> 3) * 0x9e3779b1;
+    return (h ^ (h >> 16)) & (prof->sample_size - 1);
+}
+
+/* return the link to the sample of 'ptr' or NULL if not sampled */
+static uint32_t *js_alloc_profiler_find(JSAllocProfiler *prof,
+                                        const void *ptr)
+{
+    uint32_t *plink;
+    JSAllocSample *s;
+
+    if (prof->sample_size == 0)
+        return NULL;
+    plink = &prof->sample_hash[js_alloc_sample_hash(prof, ptr)];
+    while (*plink != 0) {
+        s = &prof->samples[*plink - 1];
+        if (s->ptr == ptr)
+            return plink;
+        plink = &s->hash_next;
+    }
+    return NULL;
+}
+
+static int js_alloc_profiler_resize(JSRuntime *rt, JSAllocProfiler *prof)
+{
+    uint32_t new_size, i, h;
+    JSAllocSample *new_samples;
+    uint32_t *new_hash;
+
+    new_size = max_int(256, prof->sample_size * 2);
+    new_samples = js_realloc_rt(rt, prof->samples,
+                                sizeof(prof->samples[0]) * new_size);
+    if (!new_samples)
+        return -1;
+    prof->samples = new_samples;
+    new_hash = js_mallocz_rt(rt, sizeof(new_hash[0]) * new_size);
+    if (!new_hash)
+        return -1;
+    js_free_rt(rt, prof->sample_hash);
+    prof->sample_hash = new_hash;
+    prof->sample_size = new_size;
+    /* only called when there is no free entry */
+    for(i = 0; i < prof->sample_count; i++) {
+        h = js_alloc_sample_hash(prof, prof->samples[i].ptr);
+        prof->samples[i].hash_next = new_hash[h];
+        new_hash[h] = i + 1;
+    }
+    return 0;
+}
+
+/* return the offset of the interned current stack or -1 if memory
+   error */
+static int js_alloc_profiler_get_stack(JSRuntime *rt, JSAllocProfiler *prof)
+{
+    DynBuf *d = &prof->stacks;
+    JSStackFrame *sf;
+    uint32_t depth, h, pos, next, *stack, *other;
+    int node;
+
+    pos = d->size;
+    dbuf_put_u32(d, 0);
+    dbuf_put_u32(d, 0);
+    depth = 0;
+    h = 0;
+    for(sf = rt->current_stack_frame; sf != NULL; sf = sf->prev_frame) {
+        node = js_profile_frames_get(rt, &prof->frames, sf->cur_func);
+        if (node < 0)
+            break;
+        dbuf_put_u32(d, node);
+        h = (h + node) * 0x9e3779b1;
+        depth++;
+    }
+    if (dbuf_error(d))
+        return -1;
+    stack = (uint32_t *)(d->buf + pos);
+    stack[1] = depth;
+    h = (h ^ (h >> 16)) & (JS_ALLOC_STACK_HASH_SIZE - 1);
+    for(next = prof->stack_hash[h]; next != 0; next = other[0]) {
+        other = (uint32_t *)(d->buf + next - 1);
+        if (other[1] == depth &&
+            !memcmp(other + 2, stack + 2, sizeof(uint32_t) * depth)) {
+            d->size = pos;
+            return next - 1;
+        }
+    }
+    stack[0] = prof->stack_hash[h];
+    prof->stack_hash[h] = pos + 1;
+    return pos;
+}
+
+static void js_alloc_profiler_sample(JSRuntime *rt, JSAllocProfiler *prof,
+                                     void *ptr, size_t block_size,
+                                     size_t size, JSAllocKindEnum kind)
+{
+    JSAllocSample *s;
+    uint32_t i, h;
+    int stack;
+
+    prof->busy = TRUE;
+    stack = js_alloc_profiler_get_stack(rt, prof);
+    if (stack < 0)
+        goto done;
+    if (prof->free_sample != 0) {
+        i = prof->free_sample - 1;
+        prof->free_sample = prof->samples[i].hash_next;
+    } else {
+        if (prof->sample_count >= prof->sample_size &&
+            js_alloc_profiler_resize(rt, prof))
+            goto done;
+        i = prof->sample_count++;
+    }
+    s = &prof->samples[i];
+    s->ptr = ptr;
+    s->size = size;
+    s->block_size = block_size;
+    s->stack = stack;
+    s->kind = kind;
+    h = js_alloc_sample_hash(prof, ptr);
+    s->hash_next = prof->sample_hash[h];
+    prof->sample_hash[h] = i + 1;
+ done:
+    prof->busy = FALSE;
+}
+
+/* count 'size' newly allocated bytes and return the number of bytes
+   to attribute to their sample, 0 if they are not sampled */
+static size_t js_alloc_profiler_count(JSAllocProfiler *prof, size_t size)
+{
+    size_t n;
+
+    if (size < prof->bytes_until_sample) {
+        prof->bytes_until_sample -= size;
+        return 0;
+    }
+    /* number of sampling points crossed by the allocation */
+    n = (size - prof->bytes_until_sample) / prof->interval + 1;
+    prof->bytes_until_sample = prof->interval -
+        (size - prof->bytes_until_sample) % prof->interval;
+    return n * prof->interval;
+}
+
+/* account 'size' newly allocated bytes of the 'block_size' bytes block
+   at 'ptr' */
+static void js_alloc_profiler_add(JSRuntime *rt, void *ptr,
+                                  size_t block_size, size_t size)
+{
+    JSAllocProfiler *prof = rt->alloc_profiler;
+    JSAllocKindEnum kind;
+
+    kind = rt->alloc_kind;
+    rt->alloc_kind = JS_ALLOC_KIND_OTHER;
+    if (prof->busy)
+        return;
+    size = js_alloc_profiler_count(prof, size);
+    if (size != 0)
+        js_alloc_profiler_sample(rt, prof, ptr, block_size, size, kind);
+}
+
+static void js_alloc_profiler_malloc(JSRuntime *rt, void *ptr, size_t size)
+{
+    js_alloc_profiler_add(rt, ptr, size, size);
+}
+
+static void js_alloc_profiler_free(JSRuntime *rt, void *ptr)
+{
+    JSAllocProfiler *prof = rt->alloc_profiler;
+    uint32_t *plink, i;
+
+    if (prof->busy)
+        return;
+    plink = js_alloc_profiler_find(prof, ptr);
+    if (plink) {
+        i = *plink - 1;
+        *plink = prof->samples[i].hash_next;
+        prof->samples[i].ptr = NULL;
+        prof->samples[i].hash_next = prof->free_sample;
+        prof->free_sample = i + 1;
+    }
+}
+
+/* size of the block at 'ptr' or 0 if unknown. The default allocator
+   gives 0 when EMSCRIPTEN is defined, which the native builds of the
+   bridge also define, so ask the C library where it can tell. */
+static size_t js_alloc_profiler_usable_size(JSRuntime *rt, void *ptr)
+{
+    size_t size;
+
+    size = rt->mf.js_malloc_usable_size(ptr);
+#if defined(EMSCRIPTEN) && defined(__linux__)
+    if (size == 0 && rt->mf.js_malloc == js_def_malloc)
+        size = malloc_usable_size(ptr);
+#endif
+    return size;
+}
+
+static void *js_alloc_profiler_realloc(JSRuntime *rt, void *ptr, size_t size)
+{
+    JSAllocProfiler *prof = rt->alloc_profiler;
+    JSAllocSample *s;
+    uint32_t *plink, i, h;
+    size_t old_size;
+    void *ret;
+
+    plink = NULL;
+    old_size = 0;
+    if (ptr && !prof->busy) {
+        plink = js_alloc_profiler_find(prof, ptr);
+        if (!plink)
+            old_size = js_alloc_profiler_usable_size(rt, ptr);
+    }
+    ret = rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+    if (!ret && size != 0)
+        return NULL;
+    if (!ptr) {
+        if (ret)
+            js_alloc_profiler_malloc(rt, ret, size);
+        else
+            rt->alloc_kind = JS_ALLOC_KIND_OTHER;
+        return ret;
+    }
+    if (plink) {
+        i = *plink - 1;
+        s = &prof->samples[i];
+        if (!ret) {
+            js_alloc_profiler_free(rt, ptr);
+        } else {
+            if (ptr != ret) {
+                /* the sample follows the moved block */
+                *plink = s->hash_next;
+                s->ptr = ret;
+                h = js_alloc_sample_hash(prof, ret);
+                s->hash_next = prof->sample_hash[h];
+                prof->sample_hash[h] = i + 1;
+            }
+            /* a block has at most one sample: it takes the sampled
+               bytes of the growth */
+            if (size > s->block_size)
+                s->size += js_alloc_profiler_count(prof, size - s->block_size);
+            s->block_size = size;
+        }
+    } else if (ret && size > old_size && old_size != 0) {
+        js_alloc_profiler_add(rt, ret, size, size - old_size);
+        return ret;
+    }
+    /* the growth of an unsampled block of unknown size is not counted */
+    rt->alloc_kind = JS_ALLOC_KIND_OTHER;
+    return ret;
+}
+
+static void js_alloc_profiler_free_all(JSRuntime *rt, JSAllocProfiler *prof)
+{
+    prof->busy = TRUE;
+    js_profile_frames_free(rt, &prof->frames);
+    dbuf_free(&prof->stacks);
+    js_free_rt(rt, prof->samples);
+    js_free_rt(rt, prof->sample_hash);
+    js_free_rt(rt, prof);
+}
+
+int JS_StartAllocProfiling(JSRuntime *rt, size_t sample_interval)
+{
+    JSAllocProfiler *prof;
+
+    if (rt->alloc_profiler)
+        return -1;
+    prof = js_mallocz_rt(rt, sizeof(*prof));
+    if (!prof)
+        return -1;
+    prof->interval = sample_interval > 0 ? sample_interval : 1;
+    prof->bytes_until_sample = prof->interval;
+    dbuf_init2(&prof->stacks, rt, (DynBufReallocFunc *)js_realloc_rt);
+    rt->alloc_kind = JS_ALLOC_KIND_OTHER;
+    rt->alloc_profiler = prof;
+    return 0;
+}
+
+void JS_StopAllocProfiling(JSRuntime *rt)
+{
+    JSAllocProfiler *prof = rt->alloc_profiler;
+
+    if (prof) {
+        rt->alloc_profiler = NULL;
+        js_alloc_profiler_free_all(rt, prof);
+    }
+}
+
+static int js_alloc_sample_cmp(const void *a, const void *b, void *opaque)
+{
+    const JSAllocSample *s1 = a, *s2 = b;
+    if (s1->stack != s2->stack)
+        return (s1->stack > s2->stack) - (s1->stack < s2->stack);
+    return (int)s1->kind - (int)s2->kind;
+}
+
+static void js_alloc_profiler_put_frame(JSRuntime *rt, FILE *f,
+                                        JSProfileNode *n)
+{
+    char buf[256];
+    const char *p;
+
+    fputc(';', f);
+    if (n->func_name == JS_ATOM_NULL || n->func_name == JS_ATOM_empty_string)
+        p = "(anonymous)";
+    else
+        p = JS_AtomGetStrRT(rt, buf, sizeof(buf), n->func_name);
+    /* ';' separates the frames and the line ends with the count */
+    for(; *p != '\0'; p++)
+        fputc((*p == ';' || *p == '\n') ? ',' : *p, f);
+    if (n->filename != JS_ATOM_NULL) {
+        fprintf(f, " (%s:%d)",
+                JS_AtomGetStrRT(rt, buf, sizeof(buf), n->filename),
+                n->line_num);
+    }
+}
+
+/* Write the sampled live memory in the "folded stacks" format read by
+   flamegraph.pl and speedscope: one line per allocation kind and stack
+   from the outermost frame, followed by the number of bytes. */
+int JS_DumpAllocProfile(JSRuntime *rt, const char *filename)
+{
+    JSAllocProfiler *prof = rt->alloc_profiler;
+    JSAllocSample *tab, *s;
+    uint32_t i, j, count, depth, *stack;
+    size_t size;
+    FILE *f;
+    int ret;
+
+    if (!prof || dbuf_error(&prof->stacks))
+        return -1;
+    prof->busy = TRUE;
+    ret = -1;
+    f = NULL;
+    tab = js_malloc_rt(rt, sizeof(tab[0]) * max_int(prof->sample_count, 1));
+    if (!tab)
+        goto done;
+    count = 0;
+    for(i = 0; i < prof->sample_count; i++) {
+        if (prof->samples[i].ptr)
+            tab[count++] = prof->samples[i];
+    }
+    rqsort(tab, count, sizeof(tab[0]), js_alloc_sample_cmp, NULL);
+    f = fopen(filename, "w");
+    if (!f)
+        goto done;
+    for(i = 0; i < count; i = j) {
+        s = &tab[i];
+        size = 0;
+        for(j = i; j < count && tab[j].stack == s->stack &&
+                tab[j].kind == s->kind; j++) {
+            size += tab[j].size;
+        }
+        fputs(js_alloc_kind_names[s->kind], f);
+        stack = (uint32_t *)(prof->stacks.buf + s->stack);
+        depth = stack[1];
+        while (depth > 0) {
+            depth--;
+            js_alloc_profiler_put_frame(rt, f, &prof->frames.nodes[stack[2 + depth]]);
+        }
+        fprintf(f, " %" PRIu64 "\n", (uint64_t)size);
+    }
+    ret = 0;
+ done:
+    if (f && fclose(f) != 0)
+        ret = -1;
+    js_free_rt(rt, tab);
+    prof->busy = FALSE;
+    return ret;
+}
+
+/* Heap snapshot in the V8 .heapsnapshot format, which can be loaded
+   in the Memory panel of the Chrome DevTools. The nodes are the GC
+   objects, the strings referenced by the object properties and the
+   native data of the user classes. The edges are the ones visited by
+   the GC, so the retained sizes computed by the viewer match what the
+   cycle collector would free. */
+
+enum {
+    JS_SNAPSHOT_NODE_HIDDEN,
+    JS_SNAPSHOT_NODE_ARRAY,
+    JS_SNAPSHOT_NODE_STRING,
+    JS_SNAPSHOT_NODE_OBJECT,
+    JS_SNAPSHOT_NODE_CODE,
+    JS_SNAPSHOT_NODE_CLOSURE,
+    JS_SNAPSHOT_NODE_REGEXP,
+    JS_SNAPSHOT_NODE_NUMBER,
+    JS_SNAPSHOT_NODE_NATIVE,
+    JS_SNAPSHOT_NODE_SYNTHETIC,
+};
+
+enum {
+    JS_SNAPSHOT_EDGE_CONTEXT,
+    JS_SNAPSHOT_EDGE_ELEMENT,
+    JS_SNAPSHOT_EDGE_PROPERTY,
+    JS_SNAPSHOT_EDGE_INTERNAL,
+    JS_SNAPSHOT_EDGE_HIDDEN,
+    JS_SNAPSHOT_EDGE_SHORTCUT,
+    JS_SNAPSHOT_EDGE_WEAK,
+};
+
+/* fixed nodes */
+enum {
+    JS_SNAPSHOT_ROOT,
+    JS_SNAPSHOT_GC_ROOTS,
+    JS_SNAPSHOT_HOST_HANDLES,
+    JS_SNAPSHOT_FIXED_COUNT,
+};
+
+typedef struct JSSnapshotNode {
+    const void *ptr; /* GC object, JSString or native data */
+    uint32_t hash_next; /* index + 1 */
+    uint8_t type;
+    uint32_t name;
+    size_t self_size;
+    uint32_t edge_count;
+    uint32_t ref_count; /* number of incoming GC edges */
+} JSSnapshotNode;
+
+typedef struct JSHeapSnapshot {
+    JSRuntime *rt;
+    JSSnapshotNode *nodes;
+    uint32_t node_count;
+    uint32_t node_size; /* power of two */
+    uint32_t *node_hash; /* node_size entries, index + 1 */
+    /* edges of the nodes >= JS_SNAPSHOT_FIXED_COUNT in node order:
+       type, name or index, target node index */
+    DynBuf edges;
+    DynBuf root_edges; /* edges of JS_SNAPSHOT_GC_ROOTS */
+    DynBuf handle_edges; /* edges of JS_SNAPSHOT_HOST_HANDLES */
+    DynBuf *cur_edges; /* where the edges of the current node go */
+    uint32_t cur_node;
+    uint32_t cur_edge_name; /* name of the edges added by mark_children */
+    /* string table: NUL terminated strings */
+    DynBuf str_buf;
+    uint32_t *str_offsets;
+    uint32_t str_count;
+    uint32_t str_size; /* power of two */
+    uint32_t *str_hash; /* str_size entries, index + 1 */
+    DynBuf tmp; /* used to build the names */
+    BOOL error;
+} JSHeapSnapshot;
+
+static void *js_snapshot_realloc(JSHeapSnapshot *hs, void *ptr, size_t size)
+{
+    ptr = js_realloc_rt(hs->rt, ptr, size);
+    if (!ptr)
+        hs->error = TRUE;
+    return ptr;
+}
+
+/* return the index of 'str' in the string table */
+static uint32_t js_snapshot_str(JSHeapSnapshot *hs, const char *str, size_t len)
+{
+    uint32_t h, i, *tab, new_size;
+
+    h = 0;
+    for(i = 0; i < len; i++)
+        h = h * 263 + (uint8_t)str[i];
+    if (hs->str_count * 2 >= hs->str_size) {
+        new_size = max_int(1024, hs->str_size * 2);
+        tab = js_snapshot_realloc(hs, hs->str_offsets,
+                                  sizeof(tab[0]) * new_size);
+        if (!tab)
+            return 0;
+        hs->str_offsets = tab;
+        tab = js_snapshot_realloc(hs, hs->str_hash, sizeof(tab[0]) * new_size);
+        if (!tab)
+            return 0;
+        hs->str_hash = tab;
+        hs->str_size = new_size;
+        /* rehash */
+        memset(tab, 0, sizeof(tab[0]) * new_size);
+        for(i = 0; i < hs->str_count; i++) {
+            const char *s = (const char *)hs->str_buf.buf + hs->str_offsets[i];
+            uint32_t h1 = 0;
+            for(; *s != '\0'; s++)
+                h1 = h1 * 263 + (uint8_t)*s;
+            h1 &= new_size - 1;
+            while (tab[h1] != 0)
+                h1 = (h1 + 1) & (new_size - 1);
+            tab[h1] = i + 1;
+        }
+    }
+    h &= hs->str_size - 1;
+    while ((i = hs->str_hash[h]) != 0) {
+        const char *s = (const char *)hs->str_buf.buf + hs->str_offsets[i - 1];
+        if (!strncmp(s, str, len) && s[len] == '\0')
+            return i - 1;
+        h = (h + 1) & (hs->str_size - 1);
+    }
+    i = hs->str_count++;
+    hs->str_offsets[i] = hs->str_buf.size;
+    if (len != 0)
+        dbuf_put(&hs->str_buf, (const uint8_t *)str, len);
+    dbuf_putc(&hs->str_buf, '\0');
+    hs->str_hash[h] = i + 1;
+    return i;
+}
+
+static uint32_t js_snapshot_cstr(JSHeapSnapshot *hs, const char *str)
+{
+    return js_snapshot_str(hs, str, strlen(str));
+}
+
+static uint32_t js_snapshot_atom(JSHeapSnapshot *hs, JSAtom atom)
+{
+    char buf[ATOM_GET_STR_BUF_SIZE];
+    if (atom == JS_ATOM_NULL)
+        return js_snapshot_cstr(hs, "(anonymous)");
+    return js_snapshot_cstr(hs, JS_AtomGetStrRT(hs->rt, buf, sizeof(buf),
+                                                atom));
+}
+
+/* the first 'max_len' characters of 'p' */
+static uint32_t js_snapshot_jsstring(JSHeapSnapshot *hs, JSString *p,
+                                     uint32_t max_len)
+{
+    uint8_t buf[UTF8_CHAR_LEN_MAX];
+    uint32_t i, len;
+
+    hs->tmp.size = 0;
+    len = min_uint32(p->len, max_len);
+    for(i = 0; i < len; i++) {
+        if (p->is_wide_char) {
+            dbuf_put(&hs->tmp, buf, unicode_to_utf8(buf, p->u.str16[i]));
+        } else if (p->u.str8[i] < 0x80) {
+            dbuf_putc(&hs->tmp, p->u.str8[i]);
+        } else {
+            dbuf_put(&hs->tmp, buf, unicode_to_utf8(buf, p->u.str8[i]));
+        }
+    }
+    return js_snapshot_str(hs, (const char *)hs->tmp.buf, hs->tmp.size);
+}
+
+static uint32_t js_snapshot_ptr_hash(JSHeapSnapshot *hs, const void *ptr)
+{
+    uint32_t h = (uint32_t)((uintptr_t)ptr >> 3) * 0x9e3779b1;
+    return (h ^ (h >> 16)) & (hs->node_size - 1);
+}
+
+/* return the index of the node of 'ptr' or -1 if none */
+static int js_snapshot_find(JSHeapSnapshot *hs, const void *ptr)
+{
+    uint32_t i;
+    for(i = hs->node_hash[js_snapshot_ptr_hash(hs, ptr)]; i != 0;
+        i = hs->nodes[i - 1].hash_next) {
+        if (hs->nodes[i - 1].ptr == ptr)
+            return i - 1;
+    }
+    return -1;
+}
+
+/* return the index of the new node or -1 if memory error */
+static int js_snapshot_add_node(JSHeapSnapshot *hs, const void *ptr,
+                                int type, uint32_t name, size_t self_size)
+{
+    JSSnapshotNode *n, *tab;
+    uint32_t i, h, *hash, new_size;
+
+    if (hs->node_count >= hs->node_size) {
+        new_size = max_int(1024, hs->node_size * 2);
+        tab = js_snapshot_realloc(hs, hs->nodes, sizeof(tab[0]) * new_size);
+        if (!tab)
+            return -1;
+        hs->nodes = tab;
+        hash = js_snapshot_realloc(hs, hs->node_hash, sizeof(hash[0]) * new_size);
+        if (!hash)
+            return -1;
+        memset(hash, 0, sizeof(hash[0]) * new_size);
+        hs->node_hash = hash;
+        hs->node_size = new_size;
+        for(i = 0; i < hs->node_count; i++) {
+            if (hs->nodes[i].ptr) {
+                h = js_snapshot_ptr_hash(hs, hs->nodes[i].ptr);
+                hs->nodes[i].hash_next = hash[h];
+                hash[h] = i + 1;
+            }
+        }
+    }
+    i = hs->node_count++;
+    n = &hs->nodes[i];
+    n->ptr = ptr;
+    n->type = type;
+    n->name = name;
+    n->self_size = self_size;
+    n->edge_count = 0;
+    n->ref_count = 0;
+    n->hash_next = 0;
+    if (ptr) {
+        h = js_snapshot_ptr_hash(hs, ptr);
+        n->hash_next = hs->node_hash[h];
+        hs->node_hash[h] = i + 1;
+    }
+    return i;
+}
+
+static void js_snapshot_add_edge(JSHeapSnapshot *hs, int type, uint32_t name,
+                                 int to)
+{
+    uint32_t e[3];
+
+    if (to < 0)
+        return;
+    e[0] = type;
+    e[1] = name;
+    e[2] = to;
+    dbuf_put(hs->cur_edges, (const uint8_t *)e, sizeof(e));
+    hs->nodes[hs->cur_node].edge_count++;
+}
+
+/* edge to a GC object as visited by the GC */
+static void js_snapshot_add_gc_edge(JSHeapSnapshot *hs, int type,
+                                    uint32_t name, JSGCObjectHeader *gp)
+{
+    int to = js_snapshot_find(hs, gp);
+    if (to >= 0) {
+        hs->nodes[to].ref_count++;
+        js_snapshot_add_edge(hs, type, name, to);
+    }
+}
+
+static void js_snapshot_mark_func(JSRuntime *rt, JSGCObjectHeader *gp)
+{
+    JSHeapSnapshot *hs = rt->heap_snapshot;
+    js_snapshot_add_gc_edge(hs, JS_SNAPSHOT_EDGE_INTERNAL,
+                            hs->cur_edge_name, gp);
+}
+
+/* edge to a value referenced by a property or an element */
+static void js_snapshot_add_value_edge(JSHeapSnapshot *hs, int type,
+                                       uint32_t name, JSValueConst val)
+{
+    JSString *p;
+    int to;
+
+    switch(JS_VALUE_GET_TAG(val)) {
+    case JS_TAG_STRING:
+        p = JS_VALUE_GET_STRING(val);
+        to = js_snapshot_find(hs, p);
+        if (to < 0) {
+            to = js_snapshot_add_node(hs, p, JS_SNAPSHOT_NODE_STRING,
+                                      js_snapshot_jsstring(hs, p, 256),
+                                      sizeof(JSString) +
+                                      (p->len << p->is_wide_char) + 1 -
+                                      p->is_wide_char);
+        }
+        js_snapshot_add_edge(hs, type, name, to);
+        break;
+    case JS_TAG_OBJECT:
+    case JS_TAG_FUNCTION_BYTECODE:
+        js_snapshot_add_gc_edge(hs, type, name, JS_VALUE_GET_PTR(val));
+        break;
+    default:
+        break;
+    }
+}
+
+static void js_snapshot_object_edges(JSHeapSnapshot *hs, JSObject *p)
+{
+    JSRuntime *rt = hs->rt;
+    JSShape *sh = p->shape;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSClassGCMark *gc_mark;
+    JSValue val;
+    uint32_t i, name;
+    char buf[ATOM_GET_STR_BUF_SIZE + 8];
+
+    js_snapshot_add_gc_edge(hs, JS_SNAPSHOT_EDGE_HIDDEN,
+                            js_snapshot_cstr(hs, "map"), &sh->header);
+    prs = get_shape_prop(sh);
+    for(i = 0; i < sh->prop_count; i++, prs++) {
+        pr = &p->prop[i];
+        if (prs->atom == JS_ATOM_NULL)
+            continue;
+        name = js_snapshot_atom(hs, prs->atom);
+        switch(prs->flags & JS_PROP_TMASK) {
+        case JS_PROP_NORMAL:
+            js_snapshot_add_value_edge(hs, JS_SNAPSHOT_EDGE_PROPERTY, name,
+                                       pr->u.value);
+            break;
+        case JS_PROP_GETSET:
+            if (pr->u.getset.getter) {
+                snprintf(buf, sizeof(buf), "get %s",
+                         JS_AtomGetStrRT(rt, buf + 4, sizeof(buf) - 4, prs->atom));
+                js_snapshot_add_gc_edge(hs, JS_SNAPSHOT_EDGE_INTERNAL,
+                                        js_snapshot_cstr(hs, buf),
+                                        &pr->u.getset.getter->header);
+            }
+            if (pr->u.getset.setter) {
+                snprintf(buf, sizeof(buf), "set %s",
+                         JS_AtomGetStrRT(rt, buf + 4, sizeof(buf) - 4, prs->atom));
+                js_snapshot_add_gc_edge(hs, JS_SNAPSHOT_EDGE_INTERNAL,
+                                        js_snapshot_cstr(hs, buf),
+                                        &pr->u.getset.setter->header);
+            }
+            break;
+        case JS_PROP_VARREF:
+            if (pr->u.var_ref->is_detached) {
+                js_snapshot_add_gc_edge(hs, JS_SNAPSHOT_EDGE_CONTEXT, name,
+                                        &pr->u.var_ref->header);
+            }
+            break;
+        case JS_PROP_AUTOINIT:
+            hs->cur_edge_name = name;
+            js_autoinit_mark(rt, pr, js_snapshot_mark_func);
+            break;
+        }
+    }
+    if (p->class_id == JS_CLASS_ARRAY || p->class_id == JS_CLASS_ARGUMENTS) {
+        /* replaces js_array_mark() */
+        if (p->fast_array) {
+            for(i = 0; i < p->u.array.count; i++) {
+                val = js_fast_array_get(NULL, p, i);
+                js_snapshot_add_value_edge(hs, JS_SNAPSHOT_EDGE_ELEMENT, i, val);
+            }
+        }
+    } else if (p->class_id != JS_CLASS_OBJECT) {
+        gc_mark = rt->class_array[p->class_id].gc_mark;
+        if (gc_mark) {
+            hs->cur_edge_name = js_snapshot_cstr(hs, "(internal)");
+            gc_mark(rt, JS_MKPTR(JS_TAG_OBJECT, p), js_snapshot_mark_func);
+        }
+    }
+    /* native data of the user classes. The opaque pointer may be
+       anything, so it is not used as a key. */
+    if (p->class_id >= JS_CLASS_INIT_COUNT && p->u.opaque) {
+        int to;
+        snprintf(buf, sizeof(buf), "(native) %s",
+                 JS_AtomGetStrRT(rt, buf + 9, sizeof(buf) - 9,
+                                 rt->class_array[p->class_id].class_name));
+        to = js_snapshot_add_node(hs, NULL, JS_SNAPSHOT_NODE_NATIVE,
+                                  js_snapshot_cstr(hs, buf), 0);
+        js_snapshot_add_edge(hs, JS_SNAPSHOT_EDGE_INTERNAL,
+                             js_snapshot_cstr(hs, "(native data)"), to);
+    }
+}
+
+/* return the name of a function from its 'name' property or 0 if
+   none */
+static uint32_t js_snapshot_function_name(JSHeapSnapshot *hs, JSObject *p)
+{
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSFunctionBytecode *b;
+
+    if (js_class_has_bytecode(p->class_id)) {
+        b = p->u.func.function_bytecode;
+        if (b && b->func_name != JS_ATOM_NULL &&
+            b->func_name != JS_ATOM_empty_string)
+            return js_snapshot_atom(hs, b->func_name);
+    }
+    prs = find_own_property(&pr, p, JS_ATOM_name);
+    if (prs && (prs->flags & JS_PROP_TMASK) == JS_PROP_NORMAL &&
+        JS_VALUE_GET_TAG(pr->u.value) == JS_TAG_STRING &&
+        JS_VALUE_GET_STRING(pr->u.value)->len != 0)
+        return js_snapshot_jsstring(hs, JS_VALUE_GET_STRING(pr->u.value), 256);
+    return 0;
+}
+
+/* name plain objects after their constructor as the V8 snapshots do */
+static uint32_t js_snapshot_object_name(JSHeapSnapshot *hs, JSObject *p)
+{
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSObject *proto;
+    uint32_t name;
+
+    proto = p->shape->proto;
+    if (proto) {
+        prs = find_own_property(&pr, proto, JS_ATOM_constructor);
+        if (prs && (prs->flags & JS_PROP_TMASK) == JS_PROP_NORMAL &&
+            JS_VALUE_GET_TAG(pr->u.value) == JS_TAG_OBJECT) {
+            name = js_snapshot_function_name(hs, JS_VALUE_GET_OBJ(pr->u.value));
+            if (name != 0)
+                return name;
+        }
+    }
+    return js_snapshot_atom(hs, hs->rt->class_array[p->class_id].class_name);
+}
+
+/* add the node of a GC object, its edges are added later */
+static void js_snapshot_add_gc_node(JSHeapSnapshot *hs, JSGCObjectHeader *gp)
+{
+    JSRuntime *rt = hs->rt;
+    int type;
+    uint32_t name;
+    size_t size;
+
+    switch(gp->gc_obj_type) {
+    case JS_GC_OBJ_TYPE_JS_OBJECT:
+        {
+            JSObject *p = (JSObject *)gp;
+            uint32_t func_name;
+            size = sizeof(JSObject) + sizeof(JSProperty) * p->shape->prop_size;
+            type = JS_SNAPSHOT_NODE_OBJECT;
+            name = js_snapshot_atom(hs, rt->class_array[p->class_id].class_name);
+            switch(p->class_id) {
+            case JS_CLASS_OBJECT:
+                name = js_snapshot_object_name(hs, p);
+                break;
+            case JS_CLASS_ARRAY:
+            case JS_CLASS_ARGUMENTS:
+                if (p->fast_array) {
+                    size += js_array_kind_size(p->u.array.u1.kind) *
+                        p->u.array.u1.size;
+                }
+                break;
+            case JS_CLASS_ARRAY_BUFFER:
+            case JS_CLASS_SHARED_ARRAY_BUFFER:
+                if (p->u.array_buffer)
+                    size += sizeof(JSArrayBuffer) + p->u.array_buffer->byte_length;
+                break;
+            case JS_CLASS_REGEXP:
+                type = JS_SNAPSHOT_NODE_REGEXP;
+                break;
+            case JS_CLASS_BYTECODE_FUNCTION:
+            case JS_CLASS_GENERATOR_FUNCTION:
+            case JS_CLASS_ASYNC_FUNCTION:
+            case JS_CLASS_ASYNC_GENERATOR_FUNCTION:
+            case JS_CLASS_C_FUNCTION:
+            case JS_CLASS_C_FUNCTION_DATA:
+            case JS_CLASS_BOUND_FUNCTION:
+                type = JS_SNAPSHOT_NODE_CLOSURE;
+                func_name = js_snapshot_function_name(hs, p);
+                if (func_name != 0)
+                    name = func_name;
+                break;
+            }
+        }
+        break;
+    case JS_GC_OBJ_TYPE_FUNCTION_BYTECODE:
+        {
+            JSFunctionBytecode *b = (JSFunctionBytecode *)gp;
+            type = JS_SNAPSHOT_NODE_CODE;
+            name = js_snapshot_atom(hs, b->func_name);
+            size = sizeof(*b) + b->cpool_count * sizeof(*b->cpool) +
+                b->closure_var_count * sizeof(*b->closure_var);
+            if (b->vardefs)
+                size += (b->arg_count + b->var_count) * sizeof(*b->vardefs);
+            if (!b->read_only_bytecode)
+                size += b->byte_code_len;
+            if (b->has_debug)
+                size += b->debug.pc2line_len + b->debug.source_len;
+        }
+        break;
+    case JS_GC_OBJ_TYPE_SHAPE:
+        {
+            JSShape *sh = (JSShape *)gp;
+            type = JS_SNAPSHOT_NODE_HIDDEN;
+            name = js_snapshot_cstr(hs, "(object shape)");
+            size = get_shape_size(sh->prop_hash_mask + 1, sh->prop_size);
+        }
+        break;
+    case JS_GC_OBJ_TYPE_VAR_REF:
+        type = JS_SNAPSHOT_NODE_HIDDEN;
+        name = js_snapshot_cstr(hs, "(closure variable)");
+        size = sizeof(JSVarRef);
+        break;
+    case JS_GC_OBJ_TYPE_ASYNC_FUNCTION:
+        type = JS_SNAPSHOT_NODE_HIDDEN;
+        name = js_snapshot_cstr(hs, "(async function state)");
+        size = sizeof(JSAsyncFunctionData);
+        break;
+    case JS_GC_OBJ_TYPE_JS_CONTEXT:
+        type = JS_SNAPSHOT_NODE_SYNTHETIC;
+        name = js_snapshot_cstr(hs, "(context)");
+        size = sizeof(JSContext);
+        break;
+    default:
+        abort();
+    }
+    js_snapshot_add_node(hs, gp, type, name, size);
+}
+
+static void js_snapshot_put_json_str(FILE *f, const char *str)
+{
+    const uint8_t *p;
+    int c;
+
+    fputc('"', f);
+    for(p = (const uint8_t *)str; *p != '\0'; p++) {
+        c = *p;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void js_snapshot_put_edges(FILE *f, DynBuf *d, BOOL *pfirst)
+{
+    const uint32_t *e = (const uint32_t *)d->buf;
+    size_t i, n = d->size / (3 * sizeof(uint32_t));
+
+    for(i = 0; i < n; i++, e += 3) {
+        /* to_node is the index of the first field of the node */
+        fprintf(f, "%s%u,%u,%u", *pfirst ? "" : ",\n",
+                e[0], e[1], e[2] * 7);
+        *pfirst = FALSE;
+    }
+}
+
+static int js_snapshot_write(JSHeapSnapshot *hs, const char *filename)
+{
+    static const char meta[] =
+        "{\"snapshot\":{\"meta\":{"
+        "\"node_fields\":[\"type\",\"name\",\"id\",\"self_size\",\"edge_count\",\"trace_node_id\",\"detachedness\"],"
+        "\"node_types\":[[\"hidden\",\"array\",\"string\",\"object\",\"code\",\"closure\",\"regexp\",\"number\",\"native\",\"synthetic\",\"concatenated string\",\"sliced string\",\"symbol\",\"bigint\"],"
+        "\"string\",\"number\",\"number\",\"number\",\"number\",\"number\"],"
+        "\"edge_fields\":[\"type\",\"name_or_index\",\"to_node\"],"
+        "\"edge_types\":[[\"context\",\"element\",\"property\",\"internal\",\"hidden\",\"shortcut\",\"weak\"],"
+        "\"string_or_number\",\"node\"],"
+        "\"trace_function_info_fields\":[],\"trace_node_fields\":[],"
+        "\"sample_fields\":[],\"location_fields\":[]},";
+    JSSnapshotNode *n;
+    size_t edge_count;
+    uint32_t i;
+    BOOL first;
+    FILE *f;
+
+    f = fopen(filename, "w");
+    if (!f)
+        return -1;
+    edge_count = (hs->root_edges.size + hs->handle_edges.size +
+                  hs->edges.size) / (3 * sizeof(uint32_t)) + 2;
+    fputs(meta, f);
+    fprintf(f, "\"node_count\":%u,\"edge_count\":%" PRIu64
+            ",\"trace_function_count\":0},\n\"nodes\":[",
+            hs->node_count, (uint64_t)edge_count);
+    for(i = 0; i < hs->node_count; i++) {
+        n = &hs->nodes[i];
+        fprintf(f, "%s%u,%u,%u,%" PRIu64 ",%u,0,0", i == 0 ? "" : ",\n",
+                n->type, n->name, i * 2 + 1, (uint64_t)n->self_size,
+                n->edge_count);
+    }
+    fputs("],\n\"edges\":[", f);
+    /* edges of the root node */
+    fprintf(f, "%u,%u,%u,\n%u,%u,%u", JS_SNAPSHOT_EDGE_SHORTCUT,
+            hs->nodes[JS_SNAPSHOT_GC_ROOTS].name, JS_SNAPSHOT_GC_ROOTS * 7,
+            JS_SNAPSHOT_EDGE_SHORTCUT, hs->nodes[JS_SNAPSHOT_HOST_HANDLES].name,
+            JS_SNAPSHOT_HOST_HANDLES * 7);
+    first = FALSE;
+    js_snapshot_put_edges(f, &hs->root_edges, &first);
+    js_snapshot_put_edges(f, &hs->handle_edges, &first);
+    js_snapshot_put_edges(f, &hs->edges, &first);
+    fputs("],\n\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],"
+          "\"locations\":[],\n\"strings\":[", f);
+    for(i = 0; i < hs->str_count; i++) {
+        if (i != 0)
+            fputs(",\n", f);
+        js_snapshot_put_json_str(f, (const char *)hs->str_buf.buf +
+                                 hs->str_offsets[i]);
+    }
+    fputs("]}\n", f);
+    if (fclose(f) != 0)
+        return -1;
+    return 0;
+}
+
+int JS_WriteHeapSnapshot(JSRuntime *rt, const char *filename,
+                         const JSHeapSnapshotHandle *handles,
+                         int handle_count)
+{
+    JSHeapSnapshot hs_s, *hs = &hs_s;
+    struct list_head *el;
+    JSGCObjectHeader *gp;
+    JSSnapshotNode *n;
+    uint32_t i, count;
+    int ret;
+
+    /* only keep the reachable objects */
+    JS_RunGC(rt);
+
+    memset(hs, 0, sizeof(*hs));
+    hs->rt = rt;
+    dbuf_init2(&hs->edges, rt, (DynBufReallocFunc *)js_realloc_rt);
+    dbuf_init2(&hs->root_edges, rt, (DynBufReallocFunc *)js_realloc_rt);
+    dbuf_init2(&hs->handle_edges, rt, (DynBufReallocFunc *)js_realloc_rt);
+    dbuf_init2(&hs->str_buf, rt, (DynBufReallocFunc *)js_realloc_rt);
+    dbuf_init2(&hs->tmp, rt, (DynBufReallocFunc *)js_realloc_rt);
+    rt->heap_snapshot = hs;
+    ret = -1;
+
+    js_snapshot_cstr(hs, "");
+    js_snapshot_add_node(hs, NULL, JS_SNAPSHOT_NODE_SYNTHETIC,
+                         js_snapshot_cstr(hs, ""), 0);
+    js_snapshot_add_node(hs, NULL, JS_SNAPSHOT_NODE_SYNTHETIC,
+                         js_snapshot_cstr(hs, "(GC roots)"), 0);
+    js_snapshot_add_node(hs, NULL, JS_SNAPSHOT_NODE_SYNTHETIC,
+                         js_snapshot_cstr(hs, "(Host handles)"), 0);
+    hs->nodes[JS_SNAPSHOT_ROOT].edge_count = 2;
+    list_for_each(el, &rt->gc_obj_list) {
+        gp = list_entry(el, JSGCObjectHeader, link);
+        js_snapshot_add_gc_node(hs, gp);
+    }
+    if (hs->error)
+        goto done;
+
+    /* the GC objects are followed by the nodes created for their
+       edges, which have no edges */
+    count = hs->node_count;
+    hs->cur_edges = &hs->edges;
+    for(i = JS_SNAPSHOT_FIXED_COUNT; i < count; i++) {
+        gp = (JSGCObjectHeader *)hs->nodes[i].ptr;
+        hs->cur_node = i;
+        if (gp->gc_obj_type == JS_GC_OBJ_TYPE_JS_OBJECT) {
+            js_snapshot_object_edges(hs, (JSObject *)gp);
+        } else {
+            hs->cur_edge_name = js_snapshot_cstr(hs, "(internal)");
+            mark_children(rt, gp, js_snapshot_mark_func);
+        }
+    }
+
+    hs->cur_edges = &hs->handle_edges;
+    hs->cur_node = JS_SNAPSHOT_HOST_HANDLES;
+    for(i = 0; i < handle_count; i++) {
+        js_snapshot_add_value_edge(hs, JS_SNAPSHOT_EDGE_PROPERTY,
+                                   js_snapshot_cstr(hs, handles[i].name),
+                                   handles[i].value);
+    }
+
+    /* the objects with references from outside of the heap */
+    hs->cur_edges = &hs->root_edges;
+    hs->cur_node = JS_SNAPSHOT_GC_ROOTS;
+    for(i = JS_SNAPSHOT_FIXED_COUNT; i < count; i++) {
+        n = &hs->nodes[i];
+        gp = (JSGCObjectHeader *)n->ptr;
+        if (gp->ref_count > n->ref_count)
+            js_snapshot_add_edge(hs, JS_SNAPSHOT_EDGE_ELEMENT,
+                                 hs->nodes[JS_SNAPSHOT_GC_ROOTS].edge_count, i);
+    }
+    if (hs->error || dbuf_error(&hs->edges) || dbuf_error(&hs->root_edges) ||
+        dbuf_error(&hs->handle_edges) || dbuf_error(&hs->str_buf))
+        goto done;
+    ret = js_snapshot_write(hs, filename);
+ done:
+    rt->heap_snapshot = NULL;
+    js_free_rt(rt, hs->nodes);
+    js_free_rt(rt, hs->node_hash);
+    js_free_rt(rt, hs->str_offsets);
+    js_free_rt(rt, hs->str_hash);
+    dbuf_free(&hs->edges);
+    dbuf_free(&hs->root_edges);
+    dbuf_free(&hs->handle_edges);
+    dbuf_free(&hs->str_buf);
+    dbuf_free(&hs->tmp);
+    return ret;
+}
+
 /* Note: it is important that no exception is returned by this function */
 static BOOL is_backtrace_needed(JSContext *ctx, JSValueConst obj)
 {
@@ -6770,6 +8754,8 @@ static no_inline __exception int __js_poll_interrupts(JSContext *ctx)
 {
     JSRuntime *rt = ctx->rt;
     ctx->interrupt_counter = JS_INTERRUPT_COUNTER_INIT;
+    if (unlikely(rt->profiler != NULL))
+        js_profiler_poll(ctx);
     if (rt->interrupt_handler) {
         if (rt->interrupt_handler(rt, rt->interrupt_opaque)) {
             /* XXX: should set a specific flag to avoid catching */
@@ -7632,6 +9618,81 @@ static int __exception JS_GetOwnPropertyNamesInternal(JSContext *ctx,
     return 0;
 }
 
+static int enum_keys_num_cmp(const void *p1, const void *p2, void *opaque)
+{
+    JSContext *ctx = opaque;
+    uint32_t v1, v2;
+
+    JS_AtomIsArrayIndex(ctx, &v1, *(const JSAtom *)p1);
+    JS_AtomIsArrayIndex(ctx, &v2, *(const JSAtom *)p2);
+    if (v1 < v2)
+        return -1;
+    else if (v1 == v2)
+        return 0;
+    else
+        return 1;
+}
+
+/* Return the enumerable own string keys of 'p' (same result as
+   JS_GetOwnPropertyNamesInternal() with JS_GPN_STRING_MASK |
+   JS_GPN_ENUM_ONLY). They are computed once per shape. Return NULL if
+   the keys of 'p' do not only depend on its shape or if memory
+   error. No exception is raised. */
+static JSEnumKeys *js_get_enum_keys(JSContext *ctx, JSObject *p)
+{
+    JSShape *sh;
+    JSShapeProperty *prs;
+    JSEnumKeys *keys;
+    JSAtom atom;
+    uint32_t i, count, num_count, num_index, str_index, num_key;
+
+    if (p->is_exotic &&
+        !(p->class_id == JS_CLASS_ARRAY && p->fast_array &&
+          p->u.array.count == 0))
+        return NULL;
+    sh = p->shape;
+    if (sh->enum_keys)
+        return sh->enum_keys;
+
+    count = 0;
+    num_count = 0;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        atom = prs->atom;
+        if (atom != JS_ATOM_NULL && (prs->flags & JS_PROP_ENUMERABLE) &&
+            JS_AtomGetKind(ctx, atom) == JS_ATOM_KIND_STRING) {
+            /* an uninitialized module variable raises an exception */
+            if ((prs->flags & JS_PROP_TMASK) == JS_PROP_VARREF)
+                return NULL;
+            if (JS_AtomIsArrayIndex(ctx, &num_key, atom))
+                num_count++;
+            count++;
+        }
+    }
+    keys = js_malloc_rt(ctx->rt, sizeof(*keys) + sizeof(keys->atoms[0]) * count);
+    if (!keys)
+        return NULL;
+    keys->ref_count = 1;
+    keys->count = count;
+    num_index = 0;
+    str_index = num_count;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        atom = prs->atom;
+        if (atom != JS_ATOM_NULL && (prs->flags & JS_PROP_ENUMERABLE) &&
+            JS_AtomGetKind(ctx, atom) == JS_ATOM_KIND_STRING) {
+            if (JS_AtomIsArrayIndex(ctx, &num_key, atom))
+                keys->atoms[num_index++] = JS_DupAtom(ctx, atom);
+            else
+                keys->atoms[str_index++] = JS_DupAtom(ctx, atom);
+        }
+    }
+    if (num_count > 1) {
+        rqsort(keys->atoms, num_count, sizeof(keys->atoms[0]),
+               enum_keys_num_cmp, ctx);
+    }
+    sh->enum_keys = keys;
+    return keys;
+}
+
 int JS_GetOwnPropertyNames(JSContext *ctx, JSPropertyEnum **ptab,
                            uint32_t *plen, JSValueConst obj, int flags)
 {
@@ -7858,7 +9919,7 @@ static JSValue JS_GetPropertyValue(JSContext *ctx, JSValueConst this_obj,
         switch(p->class_id) {
         case JS_CLASS_ARRAY:
         case JS_CLASS_ARGUMENTS:
-            return JS_DupValue(ctx, p->u.array.u.values[idx]);
+            return JS_DupValue(ctx, js_fast_array_get(ctx, p, idx));
         case JS_CLASS_INT8_ARRAY:
             return JS_NewInt32(ctx, p->u.array.u.int8_ptr[idx]);
         case JS_CLASS_UINT8C_ARRAY:
@@ -8018,7 +10079,6 @@ static no_inline __exception int convert_fast_array_to_array(JSContext *ctx,
 {
     JSProperty *pr;
     JSShape *sh;
-    JSValue *tab;
     uint32_t i, len, new_count;
 
     if (js_shape_prepare_update(ctx, p, NULL))
@@ -8032,17 +10092,17 @@ static no_inline __exception int convert_fast_array_to_array(JSContext *ctx,
             return -1;
     }
 
-    tab = p->u.array.u.values;
     for(i = 0; i < len; i++) {
         /* add_property cannot fail here but
            __JS_AtomFromUInt32(i) fails for i > INT32_MAX */
         pr = add_property(ctx, p, __JS_AtomFromUInt32(i), JS_PROP_C_W_E);
-        pr->u.value = *tab++;
+        pr->u.value = js_fast_array_get(ctx, p, i);
     }
-    js_free(ctx, p->u.array.u.values);
+    js_free(ctx, p->u.array.u.ptr);
     p->u.array.count = 0;
     p->u.array.u.values = NULL; /* fail safe */
     p->u.array.u1.size = 0;
+    p->u.array.u1.kind = JS_ARRAY_KIND_VALUE;
     p->fast_array = 0;
     return 0;
 }
@@ -8111,7 +10171,8 @@ static int delete_property(JSContext *ctx, JSObject *p, JSAtom atom)
                     p->class_id == JS_CLASS_ARGUMENTS) {
                     /* Special case deleting the last element of a fast Array */
                     if (idx == p->u.array.count - 1) {
-                        JS_FreeValue(ctx, p->u.array.u.values[idx]);
+                        if (p->u.array.u1.kind == JS_ARRAY_KIND_VALUE)
+                            JS_FreeValue(ctx, p->u.array.u.values[idx]);
                         p->u.array.count = idx;
                         return TRUE;
                     }
@@ -8176,8 +10237,10 @@ static int set_array_length(JSContext *ctx, JSObject *p, JSValue val,
     if (likely(p->fast_array)) {
         uint32_t old_len = p->u.array.count;
         if (len < old_len) {
-            for(i = len; i < old_len; i++) {
-                JS_FreeValue(ctx, p->u.array.u.values[i]);
+            if (p->u.array.u1.kind == JS_ARRAY_KIND_VALUE) {
+                for(i = len; i < old_len; i++) {
+                    JS_FreeValue(ctx, p->u.array.u.values[i]);
+                }
             }
             p->u.array.count = len;
         }
@@ -8249,12 +10312,121 @@ static int set_array_length(JSContext *ctx, JSObject *p, JSValue val,
     return TRUE;
 }
 
+static inline JSArrayKindEnum js_array_value_kind(JSValueConst val)
+{
+    uint32_t tag = JS_VALUE_GET_TAG(val);
+    if (tag == JS_TAG_INT)
+        return JS_ARRAY_KIND_INT32;
+    else if (JS_TAG_IS_FLOAT64(tag))
+        return JS_ARRAY_KIND_FLOAT64;
+    else
+        return JS_ARRAY_KIND_VALUE;
+}
+
+/* convert the element storage of the fast array 'p' from
+   JS_ARRAY_KIND_INT32 to JS_ARRAY_KIND_FLOAT64 or from a packed kind
+   to JS_ARRAY_KIND_VALUE. An empty array can take any kind. Return -1
+   if memory error. */
+static no_inline int js_array_set_kind(JSContext *ctx, JSObject *p,
+                                       JSArrayKindEnum new_kind)
+{
+    uint32_t i, len;
+    void *tab;
+
+    len = p->u.array.count;
+    if (len == 0) {
+        js_free(ctx, p->u.array.u.ptr);
+        p->u.array.u.ptr = NULL;
+        p->u.array.u1.size = 0;
+        p->u.array.u1.kind = new_kind;
+        return 0;
+    }
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_ARRAY;
+    tab = js_malloc(ctx, js_array_kind_size(new_kind) * p->u.array.u1.size);
+    if (!tab)
+        return -1;
+    if (new_kind == JS_ARRAY_KIND_FLOAT64) {
+        double *tab_d = tab;
+        for(i = 0; i < len; i++)
+            tab_d[i] = p->u.array.u.int32_ptr[i];
+    } else {
+        JSValue *tab_v = tab;
+        for(i = 0; i < len; i++)
+            tab_v[i] = js_fast_array_get(ctx, p, i);
+    }
+    js_free(ctx, p->u.array.u.ptr);
+    p->u.array.u.ptr = tab;
+    p->u.array.u1.kind = new_kind;
+    return 0;
+}
+
+/* store 'val' in the element 'idx' < p->u.array.count of the fast
+   array 'p', converting its storage if needed. 'val' is freed. Return
+   -1 if memory error. */
+static int js_fast_array_set(JSContext *ctx, JSObject *p, uint32_t idx,
+                             JSValue val)
+{
+    JSArrayKindEnum kind = p->u.array.u1.kind;
+
+    if (kind != JS_ARRAY_KIND_VALUE) {
+        switch(js_array_value_kind(val)) {
+        case JS_ARRAY_KIND_INT32:
+            if (kind == JS_ARRAY_KIND_INT32)
+                p->u.array.u.int32_ptr[idx] = JS_VALUE_GET_INT(val);
+            else
+                p->u.array.u.double_ptr[idx] = JS_VALUE_GET_INT(val);
+            return 0;
+        case JS_ARRAY_KIND_FLOAT64:
+            if (kind == JS_ARRAY_KIND_INT32 &&
+                js_array_set_kind(ctx, p, JS_ARRAY_KIND_FLOAT64))
+                return -1;
+            p->u.array.u.double_ptr[idx] = JS_VALUE_GET_FLOAT64(val);
+            return 0;
+        default:
+            if (js_array_set_kind(ctx, p, JS_ARRAY_KIND_VALUE)) {
+                JS_FreeValue(ctx, val);
+                return -1;
+            }
+            break;
+        }
+    }
+    set_value(ctx, &p->u.array.u.values[idx], val);
+    return 0;
+}
+
+/* grow the element storage of the fast array 'p' to at least
+   'new_len' elements. Return -1 if memory error. */
+static no_inline int expand_fast_array(JSContext *ctx, JSObject *p,
+                                       uint32_t new_len)
+{
+    uint32_t new_size;
+    size_t slack, elem_size;
+    void *new_array_prop;
+
+    if (unlikely(new_len > JS_ARRAY_FAST_SIZE_MAX)) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    elem_size = js_array_kind_size(p->u.array.u1.kind);
+    new_size = max_uint32(new_len, p->u.array.u1.size * 3 / 2);
+    new_size = min_uint32(new_size, JS_ARRAY_FAST_SIZE_MAX);
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_ARRAY;
+    new_array_prop = js_realloc2(ctx, p->u.array.u.ptr, elem_size * new_size, &slack);
+    if (!new_array_prop)
+        return -1;
+    new_size = min_uint32(new_size + slack / elem_size, JS_ARRAY_FAST_SIZE_MAX);
+    p->u.array.u.ptr = new_array_prop;
+    p->u.array.u1.size = new_size;
+    return 0;
+}
+
 /* Preconditions: 'p' must be of class JS_CLASS_ARRAY, p->fast_array =
    TRUE and p->extensible = TRUE */
 static int add_fast_array_element(JSContext *ctx, JSObject *p,
                                   JSValue val, int flags)
 {
     uint32_t new_len, array_len;
+    JSArrayKindEnum kind, val_kind, new_kind;
     /* extend the array by one */
     /* XXX: convert to slow array if new_len > 2^31-1 elements */
     new_len = p->u.array.count + 1;
@@ -8270,22 +10442,45 @@ static int add_fast_array_element(JSContext *ctx, JSObject *p,
             p->prop[0].u.value = JS_NewInt32(ctx, new_len);
         }
     }
+    kind = p->u.array.u1.kind;
+    val_kind = js_array_value_kind(val);
+    if (unlikely(kind != val_kind)) {
+        /* an empty array takes the kind of its first element */
+        if (p->u.array.count == 0 ||
+            (kind == JS_ARRAY_KIND_INT32 && val_kind == JS_ARRAY_KIND_FLOAT64))
+            new_kind = val_kind;
+        else if (kind == JS_ARRAY_KIND_FLOAT64 && val_kind == JS_ARRAY_KIND_INT32)
+            new_kind = kind;
+        else
+            new_kind = JS_ARRAY_KIND_VALUE;
+        if (new_kind != kind) {
+            if (js_array_set_kind(ctx, p, new_kind)) {
+                JS_FreeValue(ctx, val);
+                return -1;
+            }
+            kind = new_kind;
+        }
+    }
     if (unlikely(new_len > p->u.array.u1.size)) {
-        uint32_t new_size;
-        size_t slack;
-        JSValue *new_array_prop;
-        /* XXX: potential arithmetic overflow */
-        new_size = max_int(new_len, p->u.array.u1.size * 3 / 2);
-        new_array_prop = js_realloc2(ctx, p->u.array.u.values, sizeof(JSValue) * new_size, &slack);
-        if (!new_array_prop) {
+        if (expand_fast_array(ctx, p, new_len)) {
             JS_FreeValue(ctx, val);
             return -1;
         }
-        new_size += slack / sizeof(*new_array_prop);
-        p->u.array.u.values = new_array_prop;
-        p->u.array.u1.size = new_size;
     }
-    p->u.array.u.values[new_len - 1] = val;
+    switch(kind) {
+    case JS_ARRAY_KIND_INT32:
+        p->u.array.u.int32_ptr[new_len - 1] = JS_VALUE_GET_INT(val);
+        break;
+    case JS_ARRAY_KIND_FLOAT64:
+        if (val_kind == JS_ARRAY_KIND_INT32)
+            p->u.array.u.double_ptr[new_len - 1] = JS_VALUE_GET_INT(val);
+        else
+            p->u.array.u.double_ptr[new_len - 1] = JS_VALUE_GET_FLOAT64(val);
+        break;
+    default:
+        p->u.array.u.values[new_len - 1] = val;
+        break;
+    }
     p->u.array.count = new_len;
     return TRUE;
 }
@@ -8655,7 +10850,8 @@ static int JS_SetPropertyValue(JSContext *ctx, JSValueConst this_obj,
                 /* add element */
                 return add_fast_array_element(ctx, p, val, flags);
             }
-            set_value(ctx, &p->u.array.u.values[idx], val);
+            if (unlikely(js_fast_array_set(ctx, p, idx, val)))
+                return -1;
             break;
         case JS_CLASS_ARGUMENTS:
             if (unlikely(idx >= (uint32_t)p->u.array.count))
@@ -8964,6 +11160,8 @@ static int js_shape_prepare_update(JSContext *ctx, JSObject *p,
             sh->is_hashed = FALSE;
         }
     }
+    /* the caller modifies the properties of 'sh' */
+    js_shape_clear_enum_keys(ctx->rt, p->shape);
     return 0;
 }
 
@@ -9200,7 +11398,8 @@ int JS_DefineProperty(JSContext *ctx, JSValueConst this_obj,
                             goto redo_prop_update;
                     }
                     if (flags & JS_PROP_HAS_VALUE) {
-                        set_value(ctx, &p->u.array.u.values[idx], JS_DupValue(ctx, val));
+                        if (js_fast_array_set(ctx, p, idx, JS_DupValue(ctx, val)))
+                            return -1;
                     }
                     return TRUE;
                 }
@@ -11711,7 +13910,17 @@ static __maybe_unused void JS_DumpObject(JSRuntime *rt, JSObject *p)
             switch (p->class_id) {
             case JS_CLASS_ARRAY:
             case JS_CLASS_ARGUMENTS:
-                JS_DumpValueShort(rt, p->u.array.u.values[i]);
+                switch(p->u.array.u1.kind) {
+                case JS_ARRAY_KIND_INT32:
+                    printf("%d", p->u.array.u.int32_ptr[i]);
+                    break;
+                case JS_ARRAY_KIND_FLOAT64:
+                    printf("%.14g", p->u.array.u.double_ptr[i]);
+                    break;
+                default:
+                    JS_DumpValueShort(rt, p->u.array.u.values[i]);
+                    break;
+                }
                 break;
             case JS_CLASS_UINT8C_ARRAY:
             case JS_CLASS_INT8_ARRAY:
@@ -11964,11 +14173,27 @@ static double js_pow(double a, double b)
 
 #ifdef CONFIG_BIGNUM
 
+/* return a BigInt to be set by the caller, reusing a freed cell if
+   possible. Its value is undefined. */
+static JSValue js_new_bigint_cell(JSContext *ctx)
+{
+    JSRuntime *rt = ctx->rt;
+    JSBigFloat *p;
+
+    if (rt->bigint_cell_count > 0) {
+        /* its limb is already allocated */
+        p = rt->bigint_cells[--rt->bigint_cell_count];
+        p->header.ref_count = 1;
+        return JS_MKPTR(JS_TAG_BIG_INT, p);
+    }
+    return JS_NewBigInt(ctx);
+}
+
 JSValue JS_NewBigInt64_1(JSContext *ctx, int64_t v)
 {
     JSValue val;
     bf_t *a;
-    val = JS_NewBigInt(ctx);
+    val = js_new_bigint_cell(ctx);
     if (JS_IsException(val))
         return val;
     a = JS_GetBigInt(val);
@@ -12659,11 +14884,194 @@ static JSValue throw_bf_exception(JSContext *ctx, int status)
     return JS_ThrowRangeError(ctx, "%s", str);
 }
 
+#if LIMB_BITS == 64
+/* the operands of the fast paths are in ]-2^127, 2^127[ */
+typedef int128_t js_bigint_si_t;
+typedef uint128_t js_bigint_usi_t;
+#else
+/* the operands of the fast paths are in ]-2^63, 2^63[ */
+typedef int64_t js_bigint_si_t;
+typedef uint64_t js_bigint_usi_t;
+#endif
+
+#define JS_BIGINT_SI_BITS ((int)sizeof(js_bigint_si_t) * 8)
+
+/* return TRUE and set '*pres' if the BigInt 'a' is in the range of
+   the fast path operands */
+static inline BOOL js_bigint_get_si(const bf_t *a, js_bigint_si_t *pres)
+{
+#if LIMB_BITS == 64
+    uint128_t m;
+    if (a->expn == BF_EXP_ZERO) {
+        *pres = 0;
+        return TRUE;
+    } else if (a->len == 1 && a->expn <= 64) {
+        m = a->tab[0] >> (64 - a->expn);
+    } else if (a->len <= 2 && a->expn <= 127) {
+        m = (uint128_t)a->tab[a->len - 1] << 64;
+        if (a->len == 2)
+            m |= a->tab[0];
+        m >>= 128 - a->expn;
+    } else {
+        return FALSE;
+    }
+    *pres = a->sign ? -(js_bigint_si_t)m : (js_bigint_si_t)m;
+    return TRUE;
+#else
+    int64_t v;
+    if (bf_get_int64(&v, a, 0) != 0 || v == INT64_MIN)
+        return FALSE;
+    *pres = v;
+    return TRUE;
+#endif
+}
+
+/* return a BigInt of value 'v' */
+static JSValue js_new_bigint_si(JSContext *ctx, js_bigint_si_t v)
+{
+#if LIMB_BITS == 64
+    JSValue val;
+    bf_t *a;
+    uint128_t m;
+    uint64_t hi, lo;
+    int shift, ret;
+
+    if (v >= INT64_MIN && v <= INT64_MAX)
+        return JS_NewBigInt64(ctx, v);
+    val = js_new_bigint_cell(ctx);
+    if (JS_IsException(val))
+        return val;
+    a = JS_GetBigInt(val);
+    m = v < 0 ? -(uint128_t)v : (uint128_t)v;
+    hi = m >> 64;
+    lo = m;
+    if (hi == 0) {
+        ret = bf_set_ui(a, lo);
+    } else {
+        shift = clz64(hi);
+        if (shift != 0) {
+            hi = (hi << shift) | (lo >> (64 - shift));
+            lo <<= shift;
+        }
+        /* no trailing zero limb */
+        if (lo == 0) {
+            ret = bf_resize(a, 1);
+            if (!ret)
+                a->tab[0] = hi;
+        } else {
+            ret = bf_resize(a, 2);
+            if (!ret) {
+                a->tab[0] = lo;
+                a->tab[1] = hi;
+            }
+        }
+        a->expn = 128 - shift;
+    }
+    if (ret) {
+        JS_FreeValue(ctx, val);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    a->sign = (v < 0);
+    return val;
+#else
+    return JS_NewBigInt64(ctx, v);
+#endif
+}
+
+/* compute 'a op b' when the result fits in a js_bigint_si_t. Return
+   FALSE if the generic code must be used. */
+static BOOL js_binary_arith_bigint_si(JSContext *ctx, OPCodeEnum op,
+                                      js_bigint_si_t *pres,
+                                      js_bigint_si_t a, js_bigint_si_t b)
+{
+    js_bigint_si_t r;
+
+    switch(op) {
+    case OP_add:
+        if (__builtin_add_overflow(a, b, &r))
+            return FALSE;
+        break;
+    case OP_sub:
+        if (__builtin_sub_overflow(a, b, &r))
+            return FALSE;
+        break;
+    case OP_mul:
+        if (__builtin_mul_overflow(a, b, &r))
+            return FALSE;
+        break;
+    case OP_div:
+        if (b == 0 || is_math_mode(ctx))
+            return FALSE;
+        r = a / b;
+        break;
+    case OP_mod:
+        if (b == 0)
+            return FALSE;
+        r = a % b;
+        break;
+    case OP_math_mod:
+        if (b == 0)
+            return FALSE;
+        r = a % b;
+        if (r < 0)
+            r += (b < 0) ? -b : b;
+        break;
+    case OP_pow:
+        if (b < 0)
+            return FALSE;
+        r = 1;
+        for(;;) {
+            if ((b & 1) && __builtin_mul_overflow(r, a, &r))
+                return FALSE;
+            b >>= 1;
+            if (b == 0)
+                break;
+            if (__builtin_mul_overflow(a, a, &a))
+                return FALSE;
+        }
+        break;
+    case OP_shl:
+    case OP_sar:
+        if (op == OP_sar)
+            b = -b;
+        if (b >= 0) {
+            if (a == 0) {
+                r = 0;
+            } else {
+                if (b >= JS_BIGINT_SI_BITS - 1)
+                    return FALSE;
+                r = (js_bigint_si_t)((js_bigint_usi_t)a << b);
+                if ((r >> b) != a)
+                    return FALSE;
+            }
+        } else {
+            if (b < -(JS_BIGINT_SI_BITS - 1))
+                b = -(JS_BIGINT_SI_BITS - 1);
+            r = a >> -b;
+        }
+        break;
+    case OP_and:
+        r = a & b;
+        break;
+    case OP_or:
+        r = a | b;
+        break;
+    case OP_xor:
+        r = a ^ b;
+        break;
+    default:
+        return FALSE;
+    }
+    *pres = r;
+    return TRUE;
+}
+
 static int js_unary_arith_bigint(JSContext *ctx,
                                  JSValue *pres, OPCodeEnum op, JSValue op1)
 {
     bf_t a_s, *r, *a;
     int ret, v;
+    js_bigint_si_t v1;
     JSValue res;
     
     if (op == OP_plus && !is_math_mode(ctx)) {
@@ -12671,6 +15079,32 @@ static int js_unary_arith_bigint(JSContext *ctx,
         JS_FreeValue(ctx, op1);
         return -1;
     }
+    if (JS_VALUE_GET_TAG(op1) == JS_TAG_BIG_INT &&
+        js_bigint_get_si(JS_GetBigInt(op1), &v1)) {
+        switch(op) {
+        case OP_inc:
+        case OP_dec:
+            if (!js_binary_arith_bigint_si(ctx, op == OP_inc ? OP_add : OP_sub,
+                                           &v1, v1, 1))
+                goto slow_path;
+            break;
+        case OP_neg:
+            v1 = -v1;
+            break;
+        case OP_not:
+            v1 = ~v1;
+            break;
+        default:
+            break;
+        }
+        JS_FreeValue(ctx, op1);
+        res = js_new_bigint_si(ctx, v1);
+        if (JS_IsException(res))
+            return -1;
+        *pres = res;
+        return 0;
+    }
+ slow_path:
     res = JS_NewBigInt(ctx);
     if (JS_IsException(res)) {
         JS_FreeValue(ctx, op1);
@@ -13023,8 +15457,23 @@ static int js_binary_arith_bigint(JSContext *ctx, OPCodeEnum op,
 {
     bf_t a_s, b_s, *r, *a, *b;
     int ret;
+    js_bigint_si_t v1, v2, v;
     JSValue res;
     
+    if (JS_VALUE_GET_TAG(op1) == JS_TAG_BIG_INT &&
+        JS_VALUE_GET_TAG(op2) == JS_TAG_BIG_INT &&
+        js_bigint_get_si(JS_GetBigInt(op1), &v1) &&
+        js_bigint_get_si(JS_GetBigInt(op2), &v2) &&
+        js_binary_arith_bigint_si(ctx, op, &v, v1, v2)) {
+        /* the freed cells are reused for the result */
+        JS_FreeValue(ctx, op1);
+        JS_FreeValue(ctx, op2);
+        res = js_new_bigint_si(ctx, v);
+        if (JS_IsException(res))
+            return -1;
+        *pres = res;
+        return 0;
+    }
     res = JS_NewBigInt(ctx);
     if (JS_IsException(res))
         goto fail;
@@ -13679,6 +16128,51 @@ static int js_compare_bigfloat(JSContext *ctx, OPCodeEnum op,
     return res;
 }
 
+static inline BOOL js_compare_get_si(JSValueConst val, js_bigint_si_t *pres)
+{
+    switch(JS_VALUE_GET_TAG(val)) {
+    case JS_TAG_INT:
+        *pres = JS_VALUE_GET_INT(val);
+        return TRUE;
+    case JS_TAG_BIG_INT:
+        return js_bigint_get_si(JS_GetBigInt(val), pres);
+    default:
+        return FALSE;
+    }
+}
+
+static int js_compare_bigint(JSContext *ctx, OPCodeEnum op,
+                             JSValue op1, JSValue op2)
+{
+    js_bigint_si_t v1, v2;
+    int res;
+
+    if (!js_compare_get_si(op1, &v1) || !js_compare_get_si(op2, &v2))
+        return js_compare_bigfloat(ctx, op, op1, op2);
+    switch(op) {
+    case OP_lt:
+        res = (v1 < v2);
+        break;
+    case OP_lte:
+        res = (v1 <= v2);
+        break;
+    case OP_gt:
+        res = (v1 > v2);
+        break;
+    case OP_gte:
+        res = (v1 >= v2);
+        break;
+    case OP_eq:
+        res = (v1 == v2);
+        break;
+    default:
+        abort();
+    }
+    JS_FreeValue(ctx, op1);
+    JS_FreeValue(ctx, op2);
+    return res;
+}
+
 static int js_compare_bigdecimal(JSContext *ctx, OPCodeEnum op,
                                  JSValue op1, JSValue op2)
 {
@@ -14912,6 +17406,49 @@ static int js_arguments_define_own_property(JSContext *ctx,
                              flags | JS_PROP_NO_EXOTIC);
 }
 
+/* Build an object literal from its template object. 'argv' holds the
+   values of the template properties in shape order, they are freed. */
+static JSValue js_build_object_template(JSContext *ctx, JSValueConst tmpl,
+                                        JSValue *argv, int argc)
+{
+    JSShape *sh = JS_VALUE_GET_OBJ(tmpl)->shape;
+    JSShapeProperty *prs;
+    JSObject *p;
+    JSValue obj;
+    int i;
+
+    if (likely(sh->proto == JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_OBJECT]) &&
+               sh->prop_count == argc)) {
+        /* the shape and the property array are final from the start */
+        obj = JS_NewObjectFromShape(ctx, js_dup_shape(sh), JS_CLASS_OBJECT);
+        if (JS_IsException(obj))
+            goto fail;
+        p = JS_VALUE_GET_OBJ(obj);
+        for(i = 0; i < argc; i++)
+            p->prop[i].u.value = argv[i];
+    } else {
+        /* template created in another realm */
+        obj = JS_NewObject(ctx);
+        if (JS_IsException(obj))
+            goto fail;
+        prs = get_shape_prop(sh);
+        for(i = 0; i < argc; i++, prs++) {
+            if (JS_DefinePropertyValue(ctx, obj, prs->atom, argv[i],
+                                       JS_PROP_C_W_E | JS_PROP_THROW) < 0) {
+                JS_FreeValue(ctx, obj);
+                argv += i + 1;
+                argc -= i + 1;
+                goto fail;
+            }
+        }
+    }
+    return obj;
+ fail:
+    for(i = 0; i < argc; i++)
+        JS_FreeValue(ctx, argv[i]);
+    return JS_EXCEPTION;
+}
+
 static const JSClassExoticMethods js_arguments_exotic_methods = {
     .define_own_property = js_arguments_define_own_property,
 };
@@ -15042,6 +17579,7 @@ static JSValue build_for_in_iterator(JSContext *ctx, JSValue obj)
 {
     JSObject *p, *p1;
     JSPropertyEnum *tab_atom;
+    JSEnumKeys *keys;
     int i;
     JSValue enum_obj;
     JSForInIterator *it;
@@ -15066,6 +17604,7 @@ static JSValue build_for_in_iterator(JSContext *ctx, JSValue obj)
     it->is_array = FALSE;
     it->obj = obj;
     it->idx = 0;
+    it->keys = NULL;
     p = JS_VALUE_GET_OBJ(enum_obj);
     p->u.for_in_iterator = it;
 
@@ -15077,10 +17616,15 @@ static JSValue build_for_in_iterator(JSContext *ctx, JSValue obj)
     /* fast path: assume no enumerable properties in the prototype chain */
     p1 = p->shape->proto;
     while (p1 != NULL) {
-        if (JS_GetOwnPropertyNamesInternal(ctx, &tab_atom, &tab_atom_count, p1,
-                                   JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
-            goto fail;
-        js_free_prop_enum(ctx, tab_atom, tab_atom_count);
+        keys = js_get_enum_keys(ctx, p1);
+        if (keys) {
+            tab_atom_count = keys->count;
+        } else {
+            if (JS_GetOwnPropertyNamesInternal(ctx, &tab_atom, &tab_atom_count, p1,
+                                       JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+                goto fail;
+            js_free_prop_enum(ctx, tab_atom, tab_atom_count);
+        }
         if (tab_atom_count != 0) {
             goto slow_path;
         }
@@ -15100,6 +17644,13 @@ static JSValue build_for_in_iterator(JSContext *ctx, JSValue obj)
         it->array_length = p->u.array.count;
     } else {
     normal_case:
+        /* the keys are shared with the other objects of the same shape */
+        keys = js_get_enum_keys(ctx, p);
+        if (keys) {
+            keys->ref_count++;
+            it->keys = keys;
+            return enum_obj;
+        }
         if (JS_GetOwnPropertyNamesInternal(ctx, &tab_atom, &tab_atom_count, p,
                                    JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
             goto fail;
@@ -15165,6 +17716,15 @@ static __exception int js_for_in_next(JSContext *ctx, JSValue *sp)
                 goto done;
             prop = __JS_AtomFromUInt32(it->idx);
             it->idx++;
+        } else if (it->keys) {
+            if (it->idx >= it->keys->count)
+                goto done;
+            prop = it->keys->atoms[it->idx];
+            it->idx++;
+            /* the properties of an object whose shape still holds the
+               keys cannot have been deleted */
+            if (JS_VALUE_GET_OBJ(it->obj)->shape->enum_keys == it->keys)
+                break;
         } else {
             JSShape *sh = p->shape;
             JSShapeProperty *prs;
@@ -15483,14 +18043,16 @@ static BOOL js_is_fast_array(JSContext *ctx, JSValueConst obj)
     return FALSE;
 }
 
-/* Access an Array's internal JSValue array if available */
+/* Access an Array's internal JSValue array if available. Arrays with
+   packed numeric elements are not handled. */
 static BOOL js_get_fast_array(JSContext *ctx, JSValueConst obj,
                               JSValue **arrpp, uint32_t *countp)
 {
     /* Try and handle fast arrays explicitly */
     if (JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT) {
         JSObject *p = JS_VALUE_GET_OBJ(obj);
-        if (p->class_id == JS_CLASS_ARRAY && p->fast_array) {
+        if (p->class_id == JS_CLASS_ARRAY && p->fast_array &&
+            p->u.array.u1.kind == JS_ARRAY_KIND_VALUE) {
             *countp = p->u.array.count;
             *arrpp = p->u.array.u.values;
             return TRUE;
@@ -15503,7 +18065,6 @@ static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
 {
     JSValue iterator, enumobj, method, value;
     int is_array_iterator;
-    JSValue *arrp;
     uint32_t i, count32, pos;
     
     if (JS_VALUE_GET_TAG(sp[-2]) != JS_TAG_INT) {
@@ -15537,10 +18098,12 @@ static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
     }
     if (is_array_iterator
     &&  JS_IsCFunction(ctx, method, (JSCFunction *)js_array_iterator_next, 0)
-    &&  js_get_fast_array(ctx, sp[-1], &arrp, &count32)) {
+    &&  js_is_fast_array(ctx, sp[-1])) {
+        JSObject *p = JS_VALUE_GET_OBJ(sp[-1]);
         uint32_t len;
         if (js_get_length32(ctx, &len, sp[-1]))
             goto exception;
+        count32 = p->u.array.count;
         /* if len > count32, the elements >= count32 might be read in
            the prototypes and might have side effects */
         if (len != count32)
@@ -15548,7 +18111,8 @@ static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
         /* Handle fast arrays explicitly */
         for (i = 0; i < count32; i++) {
             if (JS_DefinePropertyValueUint32(ctx, sp[-3], pos++,
-                                             JS_DupValue(ctx, arrp[i]), JS_PROP_C_W_E) < 0)
+                                             JS_DupValue(ctx, js_fast_array_get(ctx, p, i)),
+                                             JS_PROP_C_W_E) < 0)
                 goto exception;
         }
     } else {
@@ -16066,6 +18630,8 @@ static JSValue js_call_c_function(JSContext *ctx, JSValueConst func_obj,
     }
 
     rt->current_stack_frame = sf->prev_frame;
+    if (unlikely(rt->profiler != NULL) && !sf->prev_frame)
+        js_profiler_leave(rt);
     return ret_val;
 }
 
@@ -16117,6 +18683,66 @@ typedef enum {
 #define FUNC_RET_YIELD      1
 #define FUNC_RET_YIELD_STAR 2
 
+/* Return the variable overwritten with the top of the stack by the
+   instruction at 'pc' (optionally preceded by OP_dup) or NULL if it is
+   not a variable store. */
+static JSValue *js_get_store_target(const uint8_t *pc, JSValue *var_buf,
+                                    JSValue *arg_buf, JSVarRef **var_refs)
+{
+    if (*pc == OP_dup)
+        pc++;
+    switch(*pc) {
+    case OP_put_loc:
+    case OP_set_loc:
+    case OP_put_loc_check:
+        return &var_buf[get_u16(pc + 1)];
+    case OP_put_arg:
+    case OP_set_arg:
+        return &arg_buf[get_u16(pc + 1)];
+    case OP_put_var_ref:
+    case OP_set_var_ref:
+    case OP_put_var_ref_check:
+        return var_refs[get_u16(pc + 1)]->pvalue;
+#if SHORT_OPCODES
+    case OP_put_loc8:
+    case OP_set_loc8:
+        return &var_buf[pc[1]];
+    case OP_put_loc0:
+    case OP_put_loc1:
+    case OP_put_loc2:
+    case OP_put_loc3:
+        return &var_buf[*pc - OP_put_loc0];
+    case OP_set_loc0:
+    case OP_set_loc1:
+    case OP_set_loc2:
+    case OP_set_loc3:
+        return &var_buf[*pc - OP_set_loc0];
+    case OP_put_arg0:
+    case OP_put_arg1:
+    case OP_put_arg2:
+    case OP_put_arg3:
+        return &arg_buf[*pc - OP_put_arg0];
+    case OP_set_arg0:
+    case OP_set_arg1:
+    case OP_set_arg2:
+    case OP_set_arg3:
+        return &arg_buf[*pc - OP_set_arg0];
+    case OP_put_var_ref0:
+    case OP_put_var_ref1:
+    case OP_put_var_ref2:
+    case OP_put_var_ref3:
+        return var_refs[*pc - OP_put_var_ref0]->pvalue;
+    case OP_set_var_ref0:
+    case OP_set_var_ref1:
+    case OP_set_var_ref2:
+    case OP_set_var_ref3:
+        return var_refs[*pc - OP_set_var_ref0]->pvalue;
+#endif
+    default:
+        return NULL;
+    }
+}
+
 /* argv[] is modified if (flags & JS_CALL_FLAG_COPY_ARGV) = 0. */
 static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                                JSValueConst this_obj, JSValueConst new_target,
@@ -17564,6 +20190,21 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             }
             BREAK;
 
+        CASE(OP_object_template):
+            {
+                int n, idx;
+                JSValue obj;
+                n = get_u16(pc);
+                idx = get_u16(pc + 2);
+                pc += 4;
+                obj = js_build_object_template(ctx, b->cpool[idx], sp - n, n);
+                sp -= n;
+                if (unlikely(JS_IsException(obj)))
+                    goto exception;
+                *sp++ = obj;
+            }
+            BREAK;
+
         CASE(OP_set_name):
             {
                 int ret;
@@ -17838,7 +20479,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 
         CASE(OP_add):
             {
-                JSValue op1, op2;
+                JSValue op1, op2, *pv;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -17852,6 +20493,17 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) +
                                              JS_VALUE_GET_FLOAT64(op2));
                     sp--;
+                } else if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING &&
+                           JS_VALUE_GET_TAG(op2) != JS_TAG_OBJECT &&
+                           (pv = js_get_store_target(pc, var_buf, arg_buf,
+                                                     var_refs)) != NULL) {
+                    /* 's = s + x': append to the string of 's'. 'x' must
+                       be a primitive: the user code run by ToPrimitive
+                       could reassign 's' or free its closure variable. */
+                    sp[-2] = js_concat_string(ctx, op1, op2, pv);
+                    sp--;
+                    if (JS_IsException(sp[-1]))
+                        goto exception;
                 } else {
                 add_slow:
                     if (js_add_slow(ctx, sp))
@@ -17883,7 +20535,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     op1 = JS_ToPrimitiveFree(ctx, op1, HINT_NONE);
                     if (JS_IsException(op1))
                         goto exception;
-                    op1 = JS_ConcatString(ctx, JS_DupValue(ctx, *pv), op1);
+                    op1 = js_concat_string(ctx, JS_DupValue(ctx, *pv), op1, pv);
                     if (JS_IsException(op1))
                         goto exception;
                     set_value(ctx, pv, op1);
@@ -18630,6 +21282,8 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         }
     }
     rt->current_stack_frame = sf->prev_frame;
+    if (unlikely(rt->profiler != NULL) && !sf->prev_frame)
+        js_profiler_leave(rt);
     return ret_val;
 }
 
@@ -22564,24 +25218,79 @@ static void set_object_name_computed(JSParseState *s)
     }
 }
 
+/* maximum number of properties of an object literal built from a
+   template object */
+#define JS_OBJECT_TEMPLATE_MAX 64
+
+/* Replace the OP_object and OP_define_field of an object literal with
+   static keys by an OP_object_template creating the object with its
+   final shape once all the values are on the stack. */
+static __exception int emit_object_template(JSParseState *s, int object_pos,
+                                            const int *field_pos, int field_count)
+{
+    JSFunctionDef *fd = s->cur_func;
+    JSValue tmpl;
+    JSAtom atom;
+    int i, idx;
+
+    if (fd->cpool_count > 0xffff)
+        return 0;
+    tmpl = JS_NewObject(s->ctx);
+    if (JS_IsException(tmpl))
+        return -1;
+    for(i = 0; i < field_count; i++) {
+        atom = get_u32(fd->byte_code.buf + field_pos[i] + 1);
+        if (find_own_property1(JS_VALUE_GET_OBJ(tmpl), atom)) {
+            /* duplicate keys: keep the field definitions */
+            JS_FreeValue(s->ctx, tmpl);
+            return 0;
+        }
+        if (JS_DefinePropertyValue(s->ctx, tmpl, atom, JS_UNDEFINED,
+                                   JS_PROP_C_W_E | JS_PROP_THROW) < 0) {
+            JS_FreeValue(s->ctx, tmpl);
+            return -1;
+        }
+    }
+    idx = cpool_add(s, tmpl);
+    if (idx < 0) {
+        JS_FreeValue(s->ctx, tmpl);
+        return -1;
+    }
+    fd->byte_code.buf[object_pos] = OP_nop;
+    for(i = 0; i < field_count; i++) {
+        atom = get_u32(fd->byte_code.buf + field_pos[i] + 1);
+        JS_FreeAtom(s->ctx, atom);
+        memset(fd->byte_code.buf + field_pos[i], OP_nop, 5);
+    }
+    emit_op(s, OP_object_template);
+    emit_u16(s, field_count);
+    emit_u16(s, idx);
+    return 0;
+}
+
 static __exception int js_parse_object_literal(JSParseState *s)
 {
     JSAtom name = JS_ATOM_NULL;
     const uint8_t *start_ptr;
     int start_line, prop_type;
-    BOOL has_proto;
+    BOOL has_proto, is_template;
+    int object_pos, field_count;
+    int field_pos[JS_OBJECT_TEMPLATE_MAX];
 
     if (next_token(s))
         goto fail;
-    /* XXX: add an initial length that will be patched back */
     emit_op(s, OP_object);
+    object_pos = s->cur_func->last_opcode_pos;
+    field_count = 0;
     has_proto = FALSE;
+    is_template = TRUE;
     while (s->token.val != '}') {
         /* specific case for getter/setter */
         start_ptr = s->token.ptr;
         start_line = s->token.line_num;
 
         if (s->token.val == TOK_ELLIPSIS) {
+            is_template = FALSE;
             if (next_token(s))
                 return -1;
             if (js_parse_assign_expr(s))
@@ -22605,6 +25314,7 @@ static __exception int js_parse_object_literal(JSParseState *s)
             emit_u16(s, s->cur_func->scope_level);
             emit_op(s, OP_define_field);
             emit_atom(s, name);
+            goto add_field;
         } else if (s->token.val == '(') {
             BOOL is_getset = (prop_type == PROP_TYPE_GET ||
                               prop_type == PROP_TYPE_SET);
@@ -22612,6 +25322,7 @@ static __exception int js_parse_object_literal(JSParseState *s)
             JSFunctionKindEnum func_kind;
             int op_flags;
 
+            is_template = FALSE;
             func_kind = JS_FUNC_NORMAL;
             if (is_getset) {
                 func_type = JS_PARSE_FUNC_GETTER + prop_type - PROP_TYPE_GET;
@@ -22649,6 +25360,7 @@ static __exception int js_parse_object_literal(JSParseState *s)
                 set_object_name_computed(s);
                 emit_op(s, OP_define_array_el);
                 emit_op(s, OP_drop);
+                is_template = FALSE;
             } else if (name == JS_ATOM___proto__) {
                 if (has_proto) {
                     js_parse_error(s, "duplicate __proto__ property name");
@@ -22656,10 +25368,16 @@ static __exception int js_parse_object_literal(JSParseState *s)
                 }
                 emit_op(s, OP_set_proto);
                 has_proto = TRUE;
+                is_template = FALSE;
             } else {
                 set_object_name(s, name);
                 emit_op(s, OP_define_field);
                 emit_atom(s, name);
+            add_field:
+                if (field_count < JS_OBJECT_TEMPLATE_MAX)
+                    field_pos[field_count++] = s->cur_func->last_opcode_pos;
+                else
+                    is_template = FALSE;
             }
         }
         JS_FreeAtom(s->ctx, name);
@@ -22670,6 +25388,10 @@ static __exception int js_parse_object_literal(JSParseState *s)
         if (next_token(s))
             goto fail;
     }
+    if (is_template && field_count > 0) {
+        if (emit_object_template(s, object_pos, field_pos, field_count))
+            goto fail;
+    }
     if (js_parse_expect(s, '}'))
         goto fail;
     return 0;
@@ -32488,6 +35210,7 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
     byte_code_offset = function_size;
     function_size += fd->byte_code.size;
 
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_BYTECODE;
     b = js_mallocz(ctx, function_size);
     if (!b)
         goto fail;
@@ -33801,9 +36524,9 @@ typedef enum BCTagEnum {
 } BCTagEnum;
 
 #ifdef CONFIG_BIGNUM
-#define BC_BASE_VERSION 2
+#define BC_BASE_VERSION 6
 #else
-#define BC_BASE_VERSION 1
+#define BC_BASE_VERSION 5
 #endif
 #define BC_BE_VERSION 0x40
 #ifdef WORDS_BIGENDIAN
@@ -35208,6 +37931,7 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
         function_size += bc.byte_code_len;
     }
 
+    ctx->rt->alloc_kind = JS_ALLOC_KIND_BYTECODE;
     b = js_mallocz(ctx, function_size);
     if (!b)
         return JS_EXCEPTION;
@@ -36632,22 +39356,35 @@ static JSValue JS_GetOwnPropertyNames2(JSContext *ctx, JSValueConst obj1,
     JSValue obj, r, val, key, value;
     JSObject *p;
     JSPropertyEnum *atoms;
+    JSEnumKeys *keys;
     uint32_t len, i, j;
 
     r = JS_UNDEFINED;
     val = JS_UNDEFINED;
+    atoms = NULL;
+    len = 0;
+    keys = NULL;
     obj = JS_ToObject(ctx, obj1);
     if (JS_IsException(obj))
         return JS_EXCEPTION;
     p = JS_VALUE_GET_OBJ(obj);
-    if (JS_GetOwnPropertyNamesInternal(ctx, &atoms, &len, p, flags & ~JS_GPN_ENUM_ONLY))
-        goto exception;
+    if (flags == (JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+        keys = js_get_enum_keys(ctx, p);
+    if (keys) {
+        keys->ref_count++;
+        len = keys->count;
+    } else {
+        if (JS_GetOwnPropertyNamesInternal(ctx, &atoms, &len, p, flags & ~JS_GPN_ENUM_ONLY))
+            goto exception;
+    }
     r = JS_NewArray(ctx);
     if (JS_IsException(r))
         goto exception;
     for(j = i = 0; i < len; i++) {
-        JSAtom atom = atoms[i].atom;
-        if (flags & JS_GPN_ENUM_ONLY) {
+        JSAtom atom = keys ? keys->atoms[i] : atoms[i].atom;
+        /* the cached keys are valid while the shape is unchanged */
+        if ((flags & JS_GPN_ENUM_ONLY) &&
+            !(keys && p->shape->enum_keys == keys)) {
             JSPropertyDescriptor desc;
             int res;
 
@@ -36700,7 +39437,10 @@ exception:
     JS_FreeValue(ctx, r);
     r = JS_EXCEPTION;
 done:
-    js_free_prop_enum(ctx, atoms, len);
+    if (keys)
+        js_free_enum_keys(ctx->rt, keys);
+    else
+        js_free_prop_enum(ctx, atoms, len);
     JS_FreeValue(ctx, obj);
     return r;
 }
@@ -37520,7 +40260,7 @@ static JSValue *build_arg_list(JSContext *ctx, uint32_t *plen,
         p->fast_array &&
         len == p->u.array.count) {
         for(i = 0; i < len; i++) {
-            tab[i] = JS_DupValue(ctx, p->u.array.u.values[i]);
+            tab[i] = JS_DupValue(ctx, js_fast_array_get(ctx, p, i));
         }
     } else {
         for(i = 0; i < len; i++) {
@@ -38507,12 +41247,69 @@ static JSValue js_array_fill(JSContext *ctx, JSValueConst this_val,
     return JS_EXCEPTION;
 }
 
+/* return the fast array object of 'obj' if its elements are packed
+   numbers, NULL otherwise */
+static JSObject *js_get_packed_array(JSValueConst obj)
+{
+    if (JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT) {
+        JSObject *p = JS_VALUE_GET_OBJ(obj);
+        if (p->class_id == JS_CLASS_ARRAY && p->fast_array &&
+            p->u.array.u1.kind != JS_ARRAY_KIND_VALUE)
+            return p;
+    }
+    return NULL;
+}
+
+/* search the number 'val' in the elements 'n', 'n + dir', ... of the
+   packed array 'p', stopping before 'end'. NaN is only found if
+   'same_value_zero' is TRUE. Return the index or -1 if not found. */
+static int64_t js_array_packed_search(JSObject *p, JSValueConst val,
+                                      int64_t n, int64_t end, int dir,
+                                      BOOL same_value_zero)
+{
+    uint32_t tag = JS_VALUE_GET_TAG(val);
+    double d;
+    int32_t v;
+
+    if (tag == JS_TAG_INT)
+        d = JS_VALUE_GET_INT(val);
+    else if (JS_TAG_IS_FLOAT64(tag))
+        d = JS_VALUE_GET_FLOAT64(val);
+    else
+        return -1;
+    if (p->u.array.u1.kind == JS_ARRAY_KIND_INT32) {
+        if (!(d >= INT32_MIN && d <= INT32_MAX))
+            return -1;
+        v = (int32_t)d;
+        if (v != d)
+            return -1;
+        for (; n != end; n += dir) {
+            if (p->u.array.u.int32_ptr[n] == v)
+                return n;
+        }
+    } else if (isnan(d)) {
+        if (!same_value_zero)
+            return -1;
+        for (; n != end; n += dir) {
+            if (isnan(p->u.array.u.double_ptr[n]))
+                return n;
+        }
+    } else {
+        for (; n != end; n += dir) {
+            if (p->u.array.u.double_ptr[n] == d)
+                return n;
+        }
+    }
+    return -1;
+}
+
 static JSValue js_array_includes(JSContext *ctx, JSValueConst this_val,
                                  int argc, JSValueConst *argv)
 {
     JSValue obj, val;
     int64_t len, n, res;
     JSValue *arrp;
+    JSObject *p;
     uint32_t count;
 
     obj = JS_ToObject(ctx, this_val);
@@ -38526,7 +41323,16 @@ static JSValue js_array_includes(JSContext *ctx, JSValueConst this_val,
             if (JS_ToInt64Clamp(ctx, &n, argv[1], 0, len, len))
                 goto exception;
         }
-        if (js_get_fast_array(ctx, obj, &arrp, &count)) {
+        if ((p = js_get_packed_array(obj)) != NULL) {
+            count = p->u.array.count;
+            if (n < count) {
+                if (js_array_packed_search(p, argv[0], n, count, 1, TRUE) >= 0) {
+                    res = TRUE;
+                    goto done;
+                }
+                n = count;
+            }
+        } else if (js_get_fast_array(ctx, obj, &arrp, &count)) {
             for (; n < count; n++) {
                 if (js_strict_eq2(ctx, JS_DupValue(ctx, argv[0]),
                                   JS_DupValue(ctx, arrp[n]),
@@ -38562,6 +41368,7 @@ static JSValue js_array_indexOf(JSContext *ctx, JSValueConst this_val,
     JSValue obj, val;
     int64_t len, n, res;
     JSValue *arrp;
+    JSObject *p;
     uint32_t count;
 
     obj = JS_ToObject(ctx, this_val);
@@ -38575,7 +41382,15 @@ static JSValue js_array_indexOf(JSContext *ctx, JSValueConst this_val,
             if (JS_ToInt64Clamp(ctx, &n, argv[1], 0, len, len))
                 goto exception;
         }
-        if (js_get_fast_array(ctx, obj, &arrp, &count)) {
+        if ((p = js_get_packed_array(obj)) != NULL) {
+            count = p->u.array.count;
+            if (n < count) {
+                res = js_array_packed_search(p, argv[0], n, count, 1, FALSE);
+                if (res >= 0)
+                    goto done;
+                n = count;
+            }
+        } else if (js_get_fast_array(ctx, obj, &arrp, &count)) {
             for (; n < count; n++) {
                 if (js_strict_eq2(ctx, JS_DupValue(ctx, argv[0]),
                                   JS_DupValue(ctx, arrp[n]), JS_EQ_STRICT)) {
@@ -38611,6 +41426,7 @@ static JSValue js_array_lastIndexOf(JSContext *ctx, JSValueConst this_val,
     JSValue obj, val;
     int64_t len, n, res;
     int present;
+    JSObject *p;
 
     obj = JS_ToObject(ctx, this_val);
     if (js_get_length64(ctx, &len, obj))
@@ -38623,7 +41439,12 @@ static JSValue js_array_lastIndexOf(JSContext *ctx, JSValueConst this_val,
             if (JS_ToInt64Clamp(ctx, &n, argv[1], -1, len - 1, len))
                 goto exception;
         }
-        /* XXX: should special case fast arrays */
+        /* XXX: should special case fast arrays of JSValues */
+        p = js_get_packed_array(obj);
+        if (p && n < p->u.array.count) {
+            res = js_array_packed_search(p, argv[0], n, -1, -1, FALSE);
+            n = -1;
+        }
         for (; n >= 0; n--) {
             present = JS_TryGetPropertyInt64(ctx, obj, n, &val);
             if (present < 0)
@@ -38735,6 +41556,7 @@ static JSValue js_array_join(JSContext *ctx, JSValueConst this_val,
     JSValue obj, sep = JS_UNDEFINED, el;
     StringBuffer b_s, *b = &b_s;
     JSString *p = NULL;
+    JSObject *pa;
     int64_t i, n;
     int c;
 
@@ -38755,6 +41577,30 @@ static JSValue js_array_join(JSContext *ctx, JSValueConst this_val,
     }
     string_buffer_init(ctx, b, 0);
 
+    /* the packed number elements are converted without side effects */
+    pa = js_get_packed_array(obj);
+    if (pa && !toLocaleString && pa->u.array.count == n) {
+        char buf[JS_DTOA_BUF_SIZE];
+        for(i = 0; i < n; i++) {
+            if (i > 0) {
+                if (c >= 0) {
+                    string_buffer_putc8(b, c);
+                } else {
+                    string_buffer_concat(b, p, 0, p->len);
+                }
+            }
+            if (pa->u.array.u1.kind == JS_ARRAY_KIND_INT32) {
+                string_buffer_puts8(b, i64toa(buf + sizeof(buf),
+                                              pa->u.array.u.int32_ptr[i], 10));
+            } else {
+                js_dtoa1(buf, pa->u.array.u.double_ptr[i], 10, 0,
+                         JS_DTOA_VAR_FORMAT);
+                string_buffer_puts8(b, buf);
+            }
+        }
+        n = 0;
+    }
+
     for(i = 0; i < n; i++) {
         if (i > 0) {
             if (c >= 0) {
@@ -38791,7 +41637,6 @@ static JSValue js_array_pop(JSContext *ctx, JSValueConst this_val,
 {
     JSValue obj, res = JS_UNDEFINED;
     int64_t len, newLen;
-    JSValue *arrp;
     uint32_t count32;
 
     obj = JS_ToObject(ctx, this_val);
@@ -38801,14 +41646,20 @@ static JSValue js_array_pop(JSContext *ctx, JSValueConst this_val,
     if (len > 0) {
         newLen = len - 1;
         /* Special case fast arrays */
-        if (js_get_fast_array(ctx, obj, &arrp, &count32) && count32 == len) {
+        if (js_is_fast_array(ctx, obj) &&
+            JS_VALUE_GET_OBJ(obj)->u.array.count == len) {
             JSObject *p = JS_VALUE_GET_OBJ(obj);
+            count32 = p->u.array.count;
+            /* the element is moved out of the array */
             if (shift) {
-                res = arrp[0];
-                memmove(arrp, arrp + 1, (count32 - 1) * sizeof(*arrp));
+                size_t elem_size = js_array_kind_size(p->u.array.u1.kind);
+                res = js_fast_array_get(ctx, p, 0);
+                memmove(p->u.array.u.uint8_ptr,
+                        p->u.array.u.uint8_ptr + elem_size,
+                        (count32 - 1) * elem_size);
                 p->u.array.count--;
             } else {
-                res = arrp[count32 - 1];
+                res = js_fast_array_get(ctx, p, count32 - 1);
                 p->u.array.count--;
             }
         } else {
@@ -38884,6 +41735,7 @@ static JSValue js_array_reverse(JSContext *ctx, JSValueConst this_val,
     int64_t len, l, h;
     int l_present, h_present;
     uint32_t count32;
+    JSObject *p;
 
     lval = JS_UNDEFINED;
     obj = JS_ToObject(ctx, this_val);
@@ -38903,6 +41755,29 @@ static JSValue js_array_reverse(JSContext *ctx, JSValueConst this_val,
         }
         return obj;
     }
+    p = js_get_packed_array(obj);
+    if (p && p->u.array.count == len) {
+        uint32_t ll, hh;
+
+        if (len > 1) {
+            if (p->u.array.u1.kind == JS_ARRAY_KIND_INT32) {
+                int32_t *tab = p->u.array.u.int32_ptr, v;
+                for (ll = 0, hh = len - 1; ll < hh; ll++, hh--) {
+                    v = tab[ll];
+                    tab[ll] = tab[hh];
+                    tab[hh] = v;
+                }
+            } else {
+                double *tab = p->u.array.u.double_ptr, d;
+                for (ll = 0, hh = len - 1; ll < hh; ll++, hh--) {
+                    d = tab[ll];
+                    tab[ll] = tab[hh];
+                    tab[hh] = d;
+                }
+            }
+        }
+        return obj;
+    }
 
     for (l = 0, h = len - 1; l < h; l++, h--) {
         l_present = JS_TryGetPropertyInt64(ctx, obj, l, &lval);
@@ -38951,8 +41826,7 @@ static JSValue js_array_slice(JSContext *ctx, JSValueConst this_val,
     JSValue obj, arr, val, len_val;
     int64_t len, start, k, final, n, count, del_count, new_len;
     int kPresent;
-    JSValue *arrp;
-    uint32_t count32, i, item_count;
+    uint32_t i, item_count;
 
     arr = JS_UNDEFINED;
     obj = JS_ToObject(ctx, this_val);
@@ -39002,11 +41876,11 @@ static JSValue js_array_slice(JSContext *ctx, JSValueConst this_val,
        JS_CreateDataPropertyUint32() won't modify obj in case arr is
        an exotic object */
     /* Special case fast arrays */
-    if (js_get_fast_array(ctx, obj, &arrp, &count32) &&
-        js_is_fast_array(ctx, arr)) {
+    if (js_is_fast_array(ctx, obj) && js_is_fast_array(ctx, arr)) {
+        JSObject *p = JS_VALUE_GET_OBJ(obj);
         /* XXX: should share code with fast array constructor */
-        for (; k < final && k < count32; k++, n++) {
-            if (JS_CreateDataPropertyUint32(ctx, arr, n, JS_DupValue(ctx, arrp[k]), JS_PROP_THROW) < 0)
+        for (; k < final && k < p->u.array.count; k++, n++) {
+            if (JS_CreateDataPropertyUint32(ctx, arr, n, JS_DupValue(ctx, js_fast_array_get(ctx, p, k)), JS_PROP_THROW) < 0)
                 goto exception;
         }
     }
@@ -40271,12 +43145,17 @@ static JSValue js_string_concat(JSContext *ctx, JSValueConst this_val,
 
 static int string_cmp(JSString *p1, JSString *p2, int x1, int x2, int len)
 {
-    int i, c1, c2;
-    for (i = 0; i < len; i++) {
-        if ((c1 = string_get(p1, x1 + i)) != (c2 = string_get(p2, x2 + i)))
-            return c1 - c2;
+    if (!p1->is_wide_char) {
+        if (!p2->is_wide_char)
+            return memcmp(p1->u.str8 + x1, p2->u.str8 + x2, len);
+        else
+            return -memcmp16_8(p2->u.str16 + x2, p1->u.str8 + x1, len);
+    } else {
+        if (!p2->is_wide_char)
+            return memcmp16_8(p1->u.str16 + x1, p2->u.str8 + x2, len);
+        else
+            return memcmp16(p1->u.str16 + x1, p2->u.str16 + x2, len);
     }
-    return 0;
 }
 
 static int string_indexof_char(JSString *p, int c, int from)
@@ -40284,16 +43163,16 @@ static int string_indexof_char(JSString *p, int c, int from)
     /* assuming 0 <= from <= p->len */
     int i, len = p->len;
     if (p->is_wide_char) {
-        for (i = from; i < len; i++) {
-            if (p->u.str16[i] == c)
+        if ((c & ~0xffff) == 0) {
+            i = from + memchr16(p->u.str16 + from, c, len - from);
+            if (i < len)
                 return i;
         }
     } else {
         if ((c & ~0xff) == 0) {
-            for (i = from; i < len; i++) {
-                if (p->u.str8[i] == (uint8_t)c)
-                    return i;
-            }
+            const uint8_t *q = memchr(p->u.str8 + from, c, len - from);
+            if (q)
+                return q - p->u.str8;
         }
     }
     return -1;
@@ -40372,7 +43251,9 @@ static JSValue js_string_indexOf(JSContext *ctx, JSValueConst this_val,
         inc = 1;
     }
     ret = -1;
-    if (len >= v_len && inc * (stop - start) >= 0) {
+    if (inc > 0) {
+        ret = string_indexof(p, p1, start);
+    } else if (len >= v_len && inc * (stop - start) >= 0) {
         for (i = start;; i += inc) {
             if (!string_cmp(p, p1, i, 0, v_len)) {
                 ret = i;
@@ -40399,7 +43280,7 @@ static JSValue js_string_includes(JSContext *ctx, JSValueConst this_val,
                                   int argc, JSValueConst *argv, int magic)
 {
     JSValue str, v = JS_UNDEFINED;
-    int i, len, v_len, pos, start, stop, ret;
+    int len, v_len, pos, start, stop, ret;
     JSString *p;
     JSString *p1;
 
@@ -40439,13 +43320,10 @@ static JSValue js_string_includes(JSContext *ctx, JSValueConst this_val,
         start = stop = pos;
     }
     if (start >= 0 && start <= stop) {
-        for (i = start;; i++) {
-            if (!string_cmp(p, p1, i, 0, v_len)) {
-                ret = 1;
-                break;
-            }
-            if (i == stop)
-                break;
+        if (magic == 0) {
+            ret = string_indexof(p, p1, start) >= 0;
+        } else {
+            ret = !string_cmp(p, p1, start, 0, v_len);
         }
     }
  done:
@@ -41159,6 +44037,36 @@ static JSValue js_string_localeCompare(JSContext *ctx, JSValueConst this_val,
     return JS_NewInt32(ctx, cmp);
 }
 
+/* case conversion of the 8 bit string 'p'. Return JS_UNDEFINED if the
+   result is not a 8 bit string of the same length. */
+static no_inline JSValue js_string_toLowerCase8(JSContext *ctx, JSString *p,
+                                      int to_lower)
+{
+    JSString *p1;
+    uint32_t res[LRE_CC_RES_LEN_MAX];
+    int i;
+
+    p1 = js_alloc_string(ctx, p->len, 0);
+    if (!p1)
+        return JS_EXCEPTION;
+    if (ascii_span(p->u.str8, p->len) == p->len) {
+        ascii_case_conv(p1->u.str8, p->u.str8, p->len, to_lower);
+    } else {
+        /* Latin-1 stays Latin-1 except for the upper case of U+00B5,
+           U+00DF and U+00FF */
+        for(i = 0; i < p->len; i++) {
+            if (lre_case_conv(res, p->u.str8[i], to_lower) != 1 ||
+                res[0] >= 0x100) {
+                js_free_string(ctx->rt, p1);
+                return JS_UNDEFINED;
+            }
+            p1->u.str8[i] = res[0];
+        }
+    }
+    p1->u.str8[p->len] = '\0';
+    return JS_MKPTR(JS_TAG_STRING, p1);
+}
+
 static JSValue js_string_toLowerCase(JSContext *ctx, JSValueConst this_val,
                                      int argc, JSValueConst *argv, int to_lower)
 {
@@ -41174,6 +44082,14 @@ static JSValue js_string_toLowerCase(JSContext *ctx, JSValueConst this_val,
     p = JS_VALUE_GET_STRING(val);
     if (p->len == 0)
         return val;
+    if (!p->is_wide_char) {
+        JSValue ret;
+        ret = js_string_toLowerCase8(ctx, p, to_lower);
+        if (!JS_IsUndefined(ret)) {
+            JS_FreeValue(ctx, val);
+            return ret;
+        }
+    }
     if (string_buffer_init(ctx, b, p->len))
         goto fail;
     for(i = 0; i < p->len;) {
@@ -41192,8 +44108,8 @@ static JSValue js_string_toLowerCase(JSContext *ctx, JSValueConst this_val,
     JS_FreeValue(ctx, val);
     return string_buffer_end(b);
  fail:
-    JS_FreeValue(ctx, val);
     string_buffer_free(b);
+    JS_FreeValue(ctx, val);
     return JS_EXCEPTION;
 }
 
@@ -41244,6 +44160,38 @@ static JSValue JS_NewUTF32String(JSContext *ctx, const uint32_t *buf, int len)
     return JS_EXCEPTION;
 }
 
+/* return TRUE if 'p' is known to be in the normalization form
+   'n_type'. FALSE means that it must be normalized. */
+static BOOL js_string_is_normalized(JSString *p,
+                                    UnicodeNormalizationEnum n_type)
+{
+    int i, c, cc, last_cc;
+
+    if (!p->is_wide_char) {
+        /* Latin-1 is in NFC. The decompositions start at U+00A0 for
+           the compatibility forms and at U+00C0 for NFD. */
+        if (n_type == UNICODE_NFC)
+            return TRUE;
+        c = (n_type == UNICODE_NFD) ? 0xc0 : 0xa0;
+        for(i = 0; i < p->len; i++) {
+            if (p->u.str8[i] >= c)
+                return FALSE;
+        }
+        return TRUE;
+    }
+    if (n_type != UNICODE_NFC)
+        return FALSE;
+    last_cc = 0;
+    for(i = 0; i < p->len;) {
+        c = string_getc(p, &i);
+        cc = unicode_nfc_quick_check(c);
+        if (cc < 0 || (cc != 0 && last_cc > cc))
+            return FALSE;
+        last_cc = cc;
+    }
+    return TRUE;
+}
+
 static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
                                    int argc, JSValueConst *argv)
 {
@@ -41257,10 +44205,6 @@ static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
     val = JS_ToStringCheckObject(ctx, this_val);
     if (JS_IsException(val))
         return val;
-    buf_len = JS_ToUTF32String(ctx, &buf, val);
-    JS_FreeValue(ctx, val);
-    if (buf_len < 0)
-        return JS_EXCEPTION;
 
     if (argc == 0 || JS_IsUndefined(argv[0])) {
         n_type = UNICODE_NFC;
@@ -41286,12 +44230,19 @@ static JSValue js_string_normalize(JSContext *ctx, JSValueConst this_val,
             JS_FreeCString(ctx, form);
             JS_ThrowRangeError(ctx, "bad normalization form");
         fail1:
-            js_free(ctx, buf);
+            JS_FreeValue(ctx, val);
             return JS_EXCEPTION;
         }
         JS_FreeCString(ctx, form);
     }
 
+    if (js_string_is_normalized(JS_VALUE_GET_STRING(val), n_type))
+        return val;
+
+    buf_len = JS_ToUTF32String(ctx, &buf, val);
+    JS_FreeValue(ctx, val);
+    if (buf_len < 0)
+        return JS_EXCEPTION;
     out_len = unicode_normalize(&out_buf, buf, buf_len, n_type,
                                 ctx->rt, (DynBufReallocFunc *)js_realloc_rt);
     js_free(ctx, buf);
@@ -41924,6 +44875,119 @@ static void js_regexp_finalizer(JSRuntime *rt, JSValue val)
     JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, re->pattern));
 }
 
+static inline uint32_t js_regexp_cache_hash(JSAtom source, int flags,
+                                            int hash_size)
+{
+    return (source * 31 + flags) & (hash_size - 1);
+}
+
+static void js_regexp_cache_remove(JSRuntime *rt, JSRegExpCacheEntry *e)
+{
+    JSRegExpCache *rc = &rt->regexp_cache;
+    JSRegExpCacheEntry **pe;
+
+    pe = &rc->hash[js_regexp_cache_hash(e->source, e->flags, rc->hash_size)];
+    while (*pe != e)
+        pe = &(*pe)->hash_next;
+    *pe = e->hash_next;
+    list_del(&e->link);
+    rc->count--;
+    JS_FreeAtomRT(rt, e->source);
+    JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, e->bytecode));
+    js_free_rt(rt, e);
+}
+
+/* Set the maximum number of compiled regexps kept by the runtime, 0 to
+   disable the cache. */
+void JS_SetRegExpCacheSize(JSRuntime *rt, int size)
+{
+    JSRegExpCache *rc = &rt->regexp_cache;
+    JSRegExpCacheEntry **new_hash, *e;
+    struct list_head *el;
+    int new_hash_size;
+    uint32_t h;
+
+    /* also bounds the hash table size below */
+    rc->size = min_int(max_int(size, 0), JS_REGEXP_CACHE_MAX_SIZE);
+    while (rc->count > rc->size) {
+        e = list_entry(rc->lru.prev, JSRegExpCacheEntry, link);
+        js_regexp_cache_remove(rt, e);
+    }
+    if (rc->size == 0) {
+        js_free_rt(rt, rc->hash);
+        rc->hash = NULL;
+        rc->hash_size = 0;
+        return;
+    }
+    new_hash_size = 16;
+    while (new_hash_size < rc->size)
+        new_hash_size *= 2;
+    if (new_hash_size == rc->hash_size)
+        return;
+    new_hash = js_mallocz_rt(rt, sizeof(new_hash[0]) * new_hash_size);
+    if (!new_hash)
+        return;
+    list_for_each(el, &rc->lru) {
+        e = list_entry(el, JSRegExpCacheEntry, link);
+        h = js_regexp_cache_hash(e->source, e->flags, new_hash_size);
+        e->hash_next = new_hash[h];
+        new_hash[h] = e;
+    }
+    js_free_rt(rt, rc->hash);
+    rc->hash = new_hash;
+    rc->hash_size = new_hash_size;
+}
+
+void JS_GetRegExpCacheStats(JSRuntime *rt, JSRegExpCacheStats *s)
+{
+    JSRegExpCache *rc = &rt->regexp_cache;
+    s->hits = rc->hits;
+    s->misses = rc->misses;
+    s->count = rc->count;
+    s->size = rc->size;
+}
+
+static JSRegExpCacheEntry *js_regexp_cache_find(JSRuntime *rt, JSAtom source,
+                                                int flags)
+{
+    JSRegExpCache *rc = &rt->regexp_cache;
+    JSRegExpCacheEntry *e;
+
+    for(e = rc->hash[js_regexp_cache_hash(source, flags, rc->hash_size)];
+        e != NULL; e = e->hash_next) {
+        if (e->source == source && e->flags == flags) {
+            list_del(&e->link);
+            list_add(&e->link, &rc->lru);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void js_regexp_cache_add(JSRuntime *rt, JSAtom source, int flags,
+                                JSValueConst bc)
+{
+    JSRegExpCache *rc = &rt->regexp_cache;
+    JSRegExpCacheEntry *e;
+    uint32_t h;
+
+    if (rc->count >= rc->size) {
+        e = list_entry(rc->lru.prev, JSRegExpCacheEntry, link);
+        js_regexp_cache_remove(rt, e);
+    }
+    e = js_malloc_rt(rt, sizeof(*e));
+    if (!e)
+        return;
+    e->source = JS_DupAtomRT(rt, source);
+    e->flags = flags;
+    e->bytecode = JS_VALUE_GET_STRING(JS_DupValueRT(rt, bc));
+    h = js_regexp_cache_hash(source, flags, rc->hash_size);
+    e->hash_next = rc->hash[h];
+    rc->hash[h] = e;
+    list_add(&e->link, &rc->lru);
+    rc->count++;
+}
+
 /* create a string containing the RegExp bytecode */
 static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
                                  JSValueConst flags)
@@ -41935,6 +44999,9 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
     int re_bytecode_len;
     JSValue ret;
     char error_msg[64];
+    JSRegExpCache *rc = &ctx->rt->regexp_cache;
+    JSRegExpCacheEntry *e;
+    JSAtom source;
 
     re_flags = 0;
     if (!JS_IsUndefined(flags)) {
@@ -41962,6 +45029,9 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
             case 'y':
                 mask = LRE_FLAG_STICKY;
                 break;
+            case 'l':
+                mask = LRE_FLAG_LINEAR;
+                break;
             default:
                 goto bad_flags;
             }
@@ -41975,20 +45045,47 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
         JS_FreeCString(ctx, str);
     }
 
+    source = JS_ATOM_NULL;
+    if (rc->size > 0 && JS_VALUE_GET_TAG(pattern) == JS_TAG_STRING) {
+        if (!rc->hash) {
+            JS_SetRegExpCacheSize(ctx->rt, rc->size);
+        }
+        if (rc->hash) {
+            source = JS_NewAtomStr(ctx, JS_VALUE_GET_STRING(JS_DupValue(ctx, pattern)));
+            if (source == JS_ATOM_NULL)
+                return JS_EXCEPTION;
+            e = js_regexp_cache_find(ctx->rt, source, re_flags);
+            if (e) {
+                rc->hits++;
+                JS_FreeAtom(ctx, source);
+                return JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, e->bytecode));
+            }
+            rc->misses++;
+        }
+    }
+
     str = JS_ToCStringLen2(ctx, &len, pattern, !(re_flags & LRE_FLAG_UTF16));
     if (!str)
-        return JS_EXCEPTION;
+        goto fail;
     re_bytecode_buf = lre_compile(&re_bytecode_len, error_msg,
                                   sizeof(error_msg), str, len, re_flags, ctx);
     JS_FreeCString(ctx, str);
     if (!re_bytecode_buf) {
         JS_ThrowSyntaxError(ctx, "%s", error_msg);
-        return JS_EXCEPTION;
+        goto fail;
     }
 
     ret = js_new_string8(ctx, re_bytecode_buf, re_bytecode_len);
     js_free(ctx, re_bytecode_buf);
+    if (source != JS_ATOM_NULL) {
+        if (!JS_IsException(ret))
+            js_regexp_cache_add(ctx->rt, source, re_flags, ret);
+        JS_FreeAtom(ctx, source);
+    }
     return ret;
+ fail:
+    JS_FreeAtom(ctx, source);
+    return JS_EXCEPTION;
 }
 
 /* create a RegExp object from a string containing the RegExp bytecode
@@ -42317,6 +45414,11 @@ static JSValue js_regexp_get_flags(JSContext *ctx, JSValueConst this_val)
         goto exception;
     if (res)
         *p++ = 'y';
+    res = JS_ToBoolFree(ctx, JS_GetPropertyStr(ctx, this_val, "linear"));
+    if (res < 0)
+        goto exception;
+    if (res)
+        *p++ = 'l';
     return JS_NewStringLen(ctx, str, p - str);
 
 exception:
@@ -42354,6 +45456,24 @@ BOOL lre_check_stack_overflow(void *opaque, size_t alloca_size)
     return js_check_stack_overflow(ctx->rt, alloca_size);
 }
 
+BOOL lre_check_timeout(void *opaque)
+{
+    JSContext *ctx = opaque;
+    JSRuntime *rt = ctx->rt;
+    if (unlikely(rt->profiler != NULL))
+        js_profiler_poll(ctx);
+    return (rt->interrupt_handler &&
+            rt->interrupt_handler(rt, rt->interrupt_opaque));
+}
+
+static void js_throw_regexp_error(JSContext *ctx, int ret)
+{
+    if (ret == LRE_RET_TIMEOUT)
+        JS_ThrowInternalError(ctx, "interrupted in regexp execution");
+    else
+        JS_ThrowInternalError(ctx, "out of memory in regexp execution");
+}
+
 void *lre_realloc(void *opaque, void *ptr, size_t size)
 {
     JSContext *ctx = opaque;
@@ -42418,7 +45538,7 @@ static JSValue js_regexp_exec(JSContext *ctx, JSValueConst this_val,
                     goto fail;
             }
         } else {
-            JS_ThrowInternalError(ctx, "out of memory in regexp execution");
+            js_throw_regexp_error(ctx, ret);
             goto fail;
         }
         JS_FreeValue(ctx, str_val);
@@ -42543,7 +45663,7 @@ static JSValue JS_RegExpDelete(JSContext *ctx, JSValueConst this_val, JSValueCon
                         goto fail;
                 }
             } else {
-                JS_ThrowInternalError(ctx, "out of memory in regexp execution");
+                js_throw_regexp_error(ctx, ret);
                 goto fail;
             }
             break;
@@ -43321,6 +46441,7 @@ static const JSCFunctionListEntry js_regexp_proto_funcs[] = {
     JS_CGETSET_MAGIC_DEF("dotAll", js_regexp_get_flag, NULL, 8 ),
     JS_CGETSET_MAGIC_DEF("unicode", js_regexp_get_flag, NULL, 16 ),
     JS_CGETSET_MAGIC_DEF("sticky", js_regexp_get_flag, NULL, 32 ),
+    JS_CGETSET_MAGIC_DEF("linear", js_regexp_get_flag, NULL, 256 ),
     JS_CFUNC_DEF("exec", 1, js_regexp_exec ),
     JS_CFUNC_DEF("compile", 2, js_regexp_compile ),
     JS_CFUNC_DEF("test", 1, js_regexp_test ),
@@ -43503,12 +46624,521 @@ static JSValue json_parse_value(JSParseState *s)
     return JS_EXCEPTION;
 }
 
+/* Fast path of JSON.parse for the strict JSON grammar. Any input it
+   does not handle, syntax errors included, makes it bail out so that
+   the generic parser reports the error. Sibling objects with the same
+   keys reuse the shape of the previous one. */
+
+#define JSON_SHAPE_CACHE_SIZE 32 /* must be a power of two */
+
+typedef struct JSONShapeCacheEntry {
+    JSShape *sh;
+    JSAtom key; /* property holding the object, JS_ATOM_NULL at the top */
+    int depth;
+} JSONShapeCacheEntry;
+
+typedef struct JSONField {
+    JSAtom atom;
+    JSValue val;
+} JSONField;
+
+typedef struct JSONParseState {
+    JSContext *ctx;
+    const uint8_t *p;
+    const uint8_t *buf_end;
+    BOOL bail;
+    /* fields of the objects being parsed */
+    JSONField *fields;
+    int field_count;
+    int field_size;
+    JSONShapeCacheEntry shape_cache[JSON_SHAPE_CACHE_SIZE];
+} JSONParseState;
+
+#define JSON_REPEAT_BYTE(c) ((uint64_t)(c) * 0x0101010101010101)
+
+/* the high bit of a byte is set if the corresponding byte of 'v' is
+   zero. Bytes above the first zero byte may be set too. */
+static inline uint64_t json_zero_bytes(uint64_t v)
+{
+    return (v - JSON_REPEAT_BYTE(0x01)) & ~v;
+}
+
+static inline const uint8_t *json_skip_ws(const uint8_t *p,
+                                          const uint8_t *buf_end)
+{
+    uint64_t v;
+
+    for(;;) {
+        switch(*p) {
+        case ' ':
+            /* indentation: skip the spaces 8 at a time */
+            while (buf_end - p >= 8) {
+                memcpy(&v, p, 8);
+                if (v != JSON_REPEAT_BYTE(' '))
+                    break;
+                p += 8;
+            }
+            if (*p != ' ')
+                break;
+            /* fall thru */
+        case '\t':
+        case '\n':
+        case '\r':
+            p++;
+            break;
+        default:
+            return p;
+        }
+    }
+}
+
+/* return the first byte which is '"', '\\', a control character or
+   not ASCII. The bytes are tested 8 at a time. */
+static const uint8_t *json_scan_string(const uint8_t *p,
+                                       const uint8_t *buf_end)
+{
+    uint64_t v, m;
+
+    while (buf_end - p >= 8) {
+        memcpy(&v, p, 8);
+        m = json_zero_bytes(v ^ JSON_REPEAT_BYTE('"')) |
+            json_zero_bytes(v ^ JSON_REPEAT_BYTE('\\')) |
+            ((v - JSON_REPEAT_BYTE(0x20)) & ~v) | v;
+        if (m & JSON_REPEAT_BYTE(0x80))
+            break;
+        p += 8;
+    }
+    while (*p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\')
+        p++;
+    return p;
+}
+
+static JSValue json_fast_bail(JSONParseState *s)
+{
+    s->bail = TRUE;
+    return JS_EXCEPTION;
+}
+
+/* 's->p' is after the opening quote */
+static JSValue json_fast_parse_string(JSONParseState *s)
+{
+    StringBuffer b_s, *b = &b_s;
+    const uint8_t *p, *q;
+    int c, i, h;
+
+    p = s->p;
+    q = json_scan_string(p, s->buf_end);
+    if (*q == '"') {
+        s->p = q + 1;
+        return js_new_string8(s->ctx, p, q - p);
+    }
+    if (string_buffer_init(s->ctx, b, q - p + 16))
+        return JS_EXCEPTION;
+    if (string_buffer_write8(b, p, q - p))
+        goto fail;
+    p = q;
+    for(;;) {
+        c = *p;
+        if (c == '"') {
+            p++;
+            break;
+        } else if (c == '\\') {
+            switch(p[1]) {
+            case '"':
+            case '\\':
+            case '/':
+                c = p[1];
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                c = 0;
+                for(i = 0; i < 4; i++) {
+                    h = from_hex(p[2 + i]);
+                    if (h < 0)
+                        goto bail;
+                    c = (c << 4) | h;
+                }
+                p += 4;
+                break;
+            default:
+                goto bail;
+            }
+            p += 2;
+            if (string_buffer_putc16(b, c))
+                goto fail;
+        } else if (c >= 0x80) {
+            c = unicode_from_utf8(p, UTF8_CHAR_LEN_MAX, &p);
+            if (c < 0)
+                goto bail;
+            if (string_buffer_putc(b, c))
+                goto fail;
+        } else if (c < 0x20) {
+            goto bail;
+        } else {
+            q = json_scan_string(p + 1, s->buf_end);
+            if (string_buffer_write8(b, p, q - p))
+                goto fail;
+            p = q;
+        }
+    }
+    s->p = p;
+    return string_buffer_end(b);
+ bail:
+    s->bail = TRUE;
+ fail:
+    string_buffer_free(b);
+    return JS_EXCEPTION;
+}
+
+static BOOL json_atom_equals(JSRuntime *rt, JSAtom atom,
+                             const uint8_t *p, int len)
+{
+    JSString *str;
+
+    if (atom == JS_ATOM_NULL || __JS_AtomIsTaggedInt(atom))
+        return FALSE;
+    str = rt->atom_array[atom];
+    return !str->is_wide_char && str->len == len &&
+        !memcmp(str->u.str8, p, len);
+}
+
+/* 's->p' is after the opening quote. Return 'expected' if the key
+   matches it. */
+static JSAtom json_fast_parse_key(JSONParseState *s, JSAtom expected)
+{
+    JSContext *ctx = s->ctx;
+    const uint8_t *p, *q;
+    JSValue str;
+    JSAtom atom;
+
+    p = s->p;
+    q = json_scan_string(p, s->buf_end);
+    if (*q == '"') {
+        s->p = q + 1;
+        if (json_atom_equals(ctx->rt, expected, p, q - p))
+            return JS_DupAtom(ctx, expected);
+        return JS_NewAtomLen(ctx, (const char *)p, q - p);
+    }
+    str = json_fast_parse_string(s);
+    if (JS_IsException(str))
+        return JS_ATOM_NULL;
+    atom = JS_ValueToAtom(ctx, str);
+    JS_FreeValue(ctx, str);
+    return atom;
+}
+
+static JSValue json_fast_parse_number(JSONParseState *s)
+{
+    const uint8_t *p, *p_start, *p_digits;
+    const char *p_next;
+    uint32_t v;
+    JSValue val;
+    BOOL is_neg;
+
+    p = p_start = s->p;
+    is_neg = (*p == '-');
+    if (is_neg)
+        p++;
+    if (!is_digit(*p) || (p[0] == '0' && is_digit(p[1])))
+        return json_fast_bail(s);
+    /* integers of at most 9 digits */
+    v = 0;
+    p_digits = p;
+    while (is_digit(*p) && p - p_digits < 9) {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (!is_digit(*p) && *p != '.' && *p != 'e' && *p != 'E' &&
+        !(is_neg && v == 0)) {
+        s->p = p;
+        return JS_NewInt32(s->ctx, is_neg ? -(int32_t)v : v);
+    }
+    val = js_atof(s->ctx, (const char *)p_start, &p_next, 10, 0);
+    if (JS_IsException(val))
+        return val;
+    s->p = (const uint8_t *)p_next;
+    return val;
+}
+
+static int json_push_field(JSONParseState *s, JSAtom atom, JSValue val)
+{
+    if (unlikely(s->field_count >= s->field_size)) {
+        if (js_resize_array(s->ctx, (void **)&s->fields, sizeof(s->fields[0]),
+                            &s->field_size, s->field_count + 1)) {
+            JS_FreeAtom(s->ctx, atom);
+            JS_FreeValue(s->ctx, val);
+            return -1;
+        }
+    }
+    s->fields[s->field_count].atom = atom;
+    s->fields[s->field_count].val = val;
+    s->field_count++;
+    return 0;
+}
+
+static void json_pop_fields(JSONParseState *s, int base)
+{
+    int i;
+
+    for(i = base; i < s->field_count; i++) {
+        JS_FreeAtom(s->ctx, s->fields[i].atom);
+        JS_FreeValue(s->ctx, s->fields[i].val);
+    }
+    s->field_count = base;
+}
+
+static JSValue json_fast_parse_value(JSONParseState *s, JSAtom key, int depth);
+
+/* 's->p' is after the opening brace */
+static JSValue json_fast_parse_object(JSONParseState *s, JSAtom key, int depth)
+{
+    JSContext *ctx = s->ctx;
+    JSONShapeCacheEntry *ce;
+    JSONField *fields;
+    JSShape *sh;
+    JSObject *p1;
+    const uint8_t *p;
+    JSAtom atom, expected;
+    JSValue val, obj;
+    int base, n, i, ret;
+
+    ce = &s->shape_cache[(key * 31 + depth) & (JSON_SHAPE_CACHE_SIZE - 1)];
+    sh = NULL;
+    if (ce->sh && ce->key == key && ce->depth == depth)
+        sh = ce->sh;
+    base = s->field_count;
+    n = 0;
+    p = json_skip_ws(s->p, s->buf_end);
+    if (*p != '}') {
+        for(;;) {
+            if (*p != '"')
+                goto bail;
+            expected = JS_ATOM_NULL;
+            if (sh && n < sh->prop_count)
+                expected = get_shape_prop(sh)[n].atom;
+            s->p = p + 1;
+            atom = json_fast_parse_key(s, expected);
+            if (atom == JS_ATOM_NULL)
+                goto fail;
+            if (atom != expected)
+                sh = NULL;
+            p = json_skip_ws(s->p, s->buf_end);
+            if (*p != ':') {
+                JS_FreeAtom(ctx, atom);
+                goto bail;
+            }
+            s->p = p + 1;
+            val = json_fast_parse_value(s, atom, depth);
+            if (JS_IsException(val)) {
+                JS_FreeAtom(ctx, atom);
+                goto fail;
+            }
+            if (json_push_field(s, atom, val))
+                goto fail;
+            n++;
+            p = json_skip_ws(s->p, s->buf_end);
+            if (*p == '}')
+                break;
+            if (*p != ',')
+                goto bail;
+            p = json_skip_ws(p + 1, s->buf_end);
+        }
+    }
+    s->p = p + 1;
+
+    fields = s->fields + base;
+    if (sh && n == sh->prop_count) {
+        /* same keys as the previous sibling */
+        obj = JS_NewObjectFromShape(ctx, js_dup_shape(sh), JS_CLASS_OBJECT);
+        if (JS_IsException(obj))
+            goto fail;
+        p1 = JS_VALUE_GET_OBJ(obj);
+        for(i = 0; i < n; i++) {
+            p1->prop[i].u.value = fields[i].val;
+            JS_FreeAtom(ctx, fields[i].atom);
+        }
+        s->field_count = base;
+        return obj;
+    }
+    obj = JS_NewObject(ctx);
+    if (JS_IsException(obj))
+        goto fail;
+    for(i = 0; i < n; i++) {
+        ret = JS_DefinePropertyValue(ctx, obj, fields[i].atom,
+                                     fields[i].val, JS_PROP_C_W_E);
+        JS_FreeAtom(ctx, fields[i].atom);
+        if (ret < 0) {
+            s->field_count = base;
+            for(i++; i < n; i++) {
+                JS_FreeAtom(ctx, fields[i].atom);
+                JS_FreeValue(ctx, fields[i].val);
+            }
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+    }
+    s->field_count = base;
+    p1 = JS_VALUE_GET_OBJ(obj);
+    if (n > 0 && p1->shape->is_hashed && p1->shape != ce->sh) {
+        if (ce->sh)
+            js_free_shape(ctx->rt, ce->sh);
+        ce->sh = js_dup_shape(p1->shape);
+        ce->key = key;
+        ce->depth = depth;
+    }
+    return obj;
+ bail:
+    s->bail = TRUE;
+ fail:
+    json_pop_fields(s, base);
+    return JS_EXCEPTION;
+}
+
+/* 's->p' is after the opening bracket */
+static JSValue json_fast_parse_array(JSONParseState *s, JSAtom key, int depth)
+{
+    JSContext *ctx = s->ctx;
+    const uint8_t *p;
+    JSValue obj, el;
+
+    obj = JS_NewArray(ctx);
+    if (JS_IsException(obj))
+        return obj;
+    p = json_skip_ws(s->p, s->buf_end);
+    if (*p != ']') {
+        for(;;) {
+            s->p = p;
+            /* the elements are siblings of the same key */
+            el = json_fast_parse_value(s, key, depth);
+            if (JS_IsException(el))
+                goto fail;
+            if (add_fast_array_element(ctx, JS_VALUE_GET_OBJ(obj), el, 0) < 0)
+                goto fail;
+            p = json_skip_ws(s->p, s->buf_end);
+            if (*p == ']')
+                break;
+            if (*p != ',') {
+                s->bail = TRUE;
+                goto fail;
+            }
+            p++;
+        }
+    }
+    s->p = p + 1;
+    return obj;
+ fail:
+    JS_FreeValue(ctx, obj);
+    return JS_EXCEPTION;
+}
+
+static BOOL json_match_ident(JSONParseState *s, const uint8_t *p,
+                             const char *ident, int len)
+{
+    if (s->buf_end - p < len || memcmp(p, ident, len) != 0)
+        return FALSE;
+    p += len;
+    return !(is_digit(*p) || (*p >= 'a' && *p <= 'z') ||
+             (*p >= 'A' && *p <= 'Z') || *p == '_' || *p == '$' ||
+             *p >= 0x80);
+}
+
+static JSValue json_fast_parse_value(JSONParseState *s, JSAtom key, int depth)
+{
+    const uint8_t *p;
+
+    if (js_check_stack_overflow(s->ctx->rt, 0))
+        return json_fast_bail(s);
+    p = json_skip_ws(s->p, s->buf_end);
+    switch(*p) {
+    case '{':
+        s->p = p + 1;
+        return json_fast_parse_object(s, key, depth + 1);
+    case '[':
+        s->p = p + 1;
+        return json_fast_parse_array(s, key, depth + 1);
+    case '"':
+        s->p = p + 1;
+        return json_fast_parse_string(s);
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        s->p = p;
+        return json_fast_parse_number(s);
+    case 't':
+        if (!json_match_ident(s, p, "true", 4))
+            break;
+        s->p = p + 4;
+        return JS_TRUE;
+    case 'f':
+        if (!json_match_ident(s, p, "false", 5))
+            break;
+        s->p = p + 5;
+        return JS_FALSE;
+    case 'n':
+        if (!json_match_ident(s, p, "null", 4))
+            break;
+        s->p = p + 4;
+        return JS_NULL;
+    default:
+        break;
+    }
+    return json_fast_bail(s);
+}
+
+/* Return JS_EXCEPTION with '*pbail' set if the generic parser must be
+   used instead */
+static JSValue json_fast_parse(JSContext *ctx, const char *buf, size_t buf_len,
+                               BOOL *pbail)
+{
+    JSONParseState s1, *s = &s1;
+    JSValue val;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->ctx = ctx;
+    s->p = (const uint8_t *)buf;
+    s->buf_end = s->p + buf_len;
+    val = json_fast_parse_value(s, JS_ATOM_NULL, 0);
+    if (!JS_IsException(val) &&
+        json_skip_ws(s->p, s->buf_end) != s->buf_end) {
+        JS_FreeValue(ctx, val);
+        val = json_fast_bail(s);
+    }
+    for(i = 0; i < JSON_SHAPE_CACHE_SIZE; i++) {
+        if (s->shape_cache[i].sh)
+            js_free_shape(ctx->rt, s->shape_cache[i].sh);
+    }
+    js_free(ctx, s->fields);
+    *pbail = s->bail;
+    return val;
+}
+
 JSValue JS_ParseJSON2(JSContext *ctx, const char *buf, size_t buf_len,
                       const char *filename, int flags)
 {
     JSParseState s1, *s = &s1;
     JSValue val = JS_UNDEFINED;
+    BOOL bail;
 
+    if (!(flags & JS_PARSE_JSON_EXT)) {
+        val = json_fast_parse(ctx, buf, buf_len, &bail);
+        if (!bail)
+            return val;
+    }
     js_parse_init(ctx, s, buf, buf_len, filename);
     s->ext_json = ((flags & JS_PARSE_JSON_EXT) != 0);
     if (json_next_token(s))
@@ -45301,24 +48931,40 @@ static const JSCFunctionListEntry js_symbol_funcs[] = {
 /* Set/Map/WeakSet/WeakMap */
 
 typedef struct JSMapRecord {
-    int ref_count; /* used during enumeration to avoid freeing the record */
-    BOOL empty; /* TRUE if the record is deleted */
-    struct JSMapState *map;
-    struct JSMapRecord *next_weak_ref;
-    struct list_head link;
-    struct list_head hash_link;
-    JSValue key;
+    JSValue key; /* JS_UNINITIALIZED if the record is deleted */
     JSValue value;
+    uint32_t hash;
 } JSMapRecord;
 
+/* position of an iterator or of forEach() in the record array. It is
+   updated when the records are compacted. */
+typedef struct JSMapCursor {
+    struct list_head link; /* in JSMapState.cursors */
+    uint32_t pos; /* index of the next record to visit */
+} JSMapCursor;
+
+/* reference from the key object of a WeakMap/WeakSet record */
+typedef struct JSMapWeakRef {
+    struct JSMapState *map;
+    uint32_t pos; /* index of the record */
+    struct JSMapWeakRef *next_weak_ref;
+    JSValue value; /* used when the key object is freed */
+} JSMapWeakRef;
+
+/* The records are stored in insertion order in a dense array. The
+   hash table uses open addressing with linear probing and contains
+   the record index plus one (0 for an empty slot). Deleted records
+   stay in place until the next compaction. */
 typedef struct JSMapState {
     BOOL is_weak; /* TRUE if WeakSet/WeakMap */
-    struct list_head records; /* list of JSMapRecord.link */
-    uint32_t record_count;
-    struct list_head *hash_table;
-    uint32_t hash_size; /* must be a power of two */
-    uint32_t record_count_threshold; /* count at which a hash table
-                                        resize is needed */
+    uint32_t record_count; /* number of live records */
+    uint32_t record_end; /* number of used records, including the
+                            deleted ones */
+    uint32_t record_size; /* allocated number of records */
+    JSMapRecord *records;
+    uint32_t *hash_table;
+    uint32_t hash_size; /* 0 or a power of two >= 2 * record_size */
+    struct list_head cursors; /* list of JSMapCursor.link */
 } JSMapState;
 
 #define MAGIC_SET (1 << 0)
@@ -45340,15 +48986,9 @@ static JSValue js_map_constructor(JSContext *ctx, JSValueConst new_target,
     s = js_mallocz(ctx, sizeof(*s));
     if (!s)
         goto fail;
-    init_list_head(&s->records);
+    init_list_head(&s->cursors);
     s->is_weak = is_weak;
     JS_SetOpaque(obj, s);
-    s->hash_size = 1;
-    s->hash_table = js_malloc(ctx, sizeof(s->hash_table[0]) * s->hash_size);
-    if (!s->hash_table)
-        goto fail;
-    init_list_head(&s->hash_table[0]);
-    s->record_count_threshold = 4;
 
     arr = JS_UNDEFINED;
     if (argc > 0)
@@ -45434,210 +49074,279 @@ static JSValue js_map_constructor(JSContext *ctx, JSValueConst new_target,
     return JS_EXCEPTION;
 }
 
-/* XXX: could normalize strings to speed up comparison */
+/* Numbers are normalized so that equal keys have the same
+   representation: -0.0 and integer float64 values are converted to
+   int32. */
 static JSValueConst map_normalize_key(JSContext *ctx, JSValueConst key)
 {
     uint32_t tag = JS_VALUE_GET_TAG(key);
-    /* convert -0.0 to +0.0 */
-    if (JS_TAG_IS_FLOAT64(tag) && JS_VALUE_GET_FLOAT64(key) == 0.0) {
-        key = JS_NewInt32(ctx, 0);
+    double d;
+    if (JS_TAG_IS_FLOAT64(tag)) {
+        d = JS_VALUE_GET_FLOAT64(key);
+        if (d >= INT32_MIN && d <= INT32_MAX && (int32_t)d == d)
+            key = JS_NewInt32(ctx, (int32_t)d);
     }
     return key;
 }
 
-/* XXX: better hash ? */
+/* 64 bit finalizer of MurmurHash3 */
+static inline uint32_t map_hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
 static uint32_t map_hash_key(JSContext *ctx, JSValueConst key)
 {
     uint32_t tag = JS_VALUE_GET_NORM_TAG(key);
-    uint32_t h;
+    uint64_t h;
     double d;
     JSFloat64Union u;
 
     switch(tag) {
     case JS_TAG_BOOL:
-        h = JS_VALUE_GET_INT(key);
+    case JS_TAG_INT:
+        h = (uint32_t)JS_VALUE_GET_INT(key);
         break;
     case JS_TAG_STRING:
         h = hash_string(JS_VALUE_GET_STRING(key), 0);
         break;
     case JS_TAG_OBJECT:
     case JS_TAG_SYMBOL:
-        h = (uintptr_t)JS_VALUE_GET_PTR(key) * 3163;
+        h = (uintptr_t)JS_VALUE_GET_PTR(key);
         break;
-    case JS_TAG_INT:
-        d = JS_VALUE_GET_INT(key) * 3163;
-        goto hash_float64;
     case JS_TAG_FLOAT64:
         d = JS_VALUE_GET_FLOAT64(key);
         /* normalize the NaN */
         if (isnan(d))
             d = JS_FLOAT64_NAN;
-    hash_float64:
         u.d = d;
-        h = (u.u32[0] ^ u.u32[1]) * 3163;
+        h = u.u64;
         break;
     default:
         h = 0; /* XXX: bignum support */
         break;
     }
-    h ^= tag;
-    return h;
+    h ^= (uint64_t)tag << 32;
+    return map_hash_mix(h);
+}
+
+static inline BOOL map_record_is_deleted(const JSMapRecord *mr)
+{
+    return JS_VALUE_GET_TAG(mr->key) == JS_TAG_UNINITIALIZED;
 }
 
 static JSMapRecord *map_find_record(JSContext *ctx, JSMapState *s,
-                                    JSValueConst key)
+                                    JSValueConst key, uint32_t h)
 {
-    struct list_head *el;
     JSMapRecord *mr;
-    uint32_t h;
-    h = map_hash_key(ctx, key) & (s->hash_size - 1);
-    list_for_each(el, &s->hash_table[h]) {
-        mr = list_entry(el, JSMapRecord, hash_link);
-        if (js_same_value_zero(ctx, mr->key, key))
+    uint32_t i, idx, mask;
+
+    if (s->hash_size == 0)
+        return NULL;
+    mask = s->hash_size - 1;
+    for(i = h & mask; (idx = s->hash_table[i]) != 0; i = (i + 1) & mask) {
+        mr = &s->records[idx - 1];
+        if (mr->hash == h && !map_record_is_deleted(mr) &&
+            js_same_value_zero(ctx, mr->key, key))
             return mr;
     }
     return NULL;
 }
 
-static void map_hash_resize(JSContext *ctx, JSMapState *s)
+static void map_hash_rebuild(JSMapState *s)
 {
-    uint32_t new_hash_size, i, h;
-    size_t slack;
-    struct list_head *new_hash_table, *el;
-    JSMapRecord *mr;
+    uint32_t i, j, mask;
 
-    /* XXX: no reporting of memory allocation failure */
-    if (s->hash_size == 1)
-        new_hash_size = 4;
-    else
-        new_hash_size = s->hash_size * 2;
-    new_hash_table = js_realloc2(ctx, s->hash_table,
-                                 sizeof(new_hash_table[0]) * new_hash_size, &slack);
-    if (!new_hash_table)
-        return;
-    new_hash_size += slack / sizeof(*new_hash_table);
+    memset(s->hash_table, 0, sizeof(s->hash_table[0]) * s->hash_size);
+    mask = s->hash_size - 1;
+    for(i = 0; i < s->record_end; i++) {
+        for(j = s->records[i].hash & mask; s->hash_table[j] != 0;
+            j = (j + 1) & mask)
+            continue;
+        s->hash_table[j] = i + 1;
+    }
+}
 
-    for(i = 0; i < new_hash_size; i++)
-        init_list_head(&new_hash_table[i]);
+static JSMapWeakRef **find_weak_ref(JSMapState *s, uint32_t pos)
+{
+    JSMapWeakRef **pwr, *wr;
+    JSObject *p;
+
+    p = JS_VALUE_GET_OBJ(s->records[pos].key);
+    pwr = &p->first_weak_ref;
+    for(;;) {
+        wr = *pwr;
+        assert(wr != NULL);
+        if (wr->map == s && wr->pos == pos)
+            return pwr;
+        pwr = &wr->next_weak_ref;
+    }
+}
 
-    list_for_each(el, &s->records) {
-        mr = list_entry(el, JSMapRecord, link);
-        if (!mr->empty) {
-            h = map_hash_key(ctx, mr->key) & (new_hash_size - 1);
-            list_add_tail(&mr->hash_link, &new_hash_table[h]);
+/* Remove the deleted records. The iterator positions and the weak
+   references are updated accordingly. */
+static void map_compact(JSMapState *s)
+{
+    struct list_head *el;
+    JSMapCursor *c;
+    uint32_t i, j;
+
+    list_for_each(el, &s->cursors) {
+        c = list_entry(el, JSMapCursor, link);
+        j = 0;
+        for(i = 0; i < c->pos; i++) {
+            if (!map_record_is_deleted(&s->records[i]))
+                j++;
+        }
+        c->pos = j;
+    }
+    j = 0;
+    for(i = 0; i < s->record_end; i++) {
+        if (map_record_is_deleted(&s->records[i]))
+            continue;
+        if (i != j) {
+            if (s->is_weak)
+                (*find_weak_ref(s, i))->pos = j;
+            s->records[j] = s->records[i];
         }
+        j++;
+    }
+    s->record_end = j;
+}
+
+/* make room for one more record */
+static int map_grow(JSContext *ctx, JSMapState *s)
+{
+    uint32_t new_record_size, new_hash_size;
+    JSMapRecord *new_records;
+    uint32_t *new_hash_table;
+
+    if (s->record_count < s->record_end / 2) {
+        /* enough deleted records: compact in place */
+        map_compact(s);
+        map_hash_rebuild(s);
+        return 0;
     }
+    if (s->record_end != s->record_count)
+        map_compact(s);
+    new_record_size = max_uint32(4, s->record_size * 2);
+    new_records = js_realloc(ctx, s->records,
+                             sizeof(new_records[0]) * new_record_size);
+    if (!new_records)
+        goto fail;
+    s->records = new_records;
+    s->record_size = new_record_size;
+    new_hash_size = new_record_size * 2;
+    new_hash_table = js_realloc(ctx, s->hash_table,
+                                sizeof(new_hash_table[0]) * new_hash_size);
+    if (!new_hash_table)
+        goto fail;
     s->hash_table = new_hash_table;
     s->hash_size = new_hash_size;
-    s->record_count_threshold = new_hash_size * 2;
+    map_hash_rebuild(s);
+    return 0;
+ fail:
+    /* the records may have been moved by map_compact() */
+    map_hash_rebuild(s);
+    return -1;
 }
 
 static JSMapRecord *map_add_record(JSContext *ctx, JSMapState *s,
-                                   JSValueConst key)
+                                   JSValueConst key, uint32_t h)
 {
-    uint32_t h;
+    uint32_t i, mask, pos;
     JSMapRecord *mr;
 
-    mr = js_malloc(ctx, sizeof(*mr));
-    if (!mr)
-        return NULL;
-    mr->ref_count = 1;
-    mr->map = s;
-    mr->empty = FALSE;
+    if (s->record_end >= s->record_size ||
+        s->hash_size < 2 * s->record_size) {
+        if (map_grow(ctx, s))
+            return NULL;
+    }
+    pos = s->record_end;
     if (s->is_weak) {
         JSObject *p = JS_VALUE_GET_OBJ(key);
+        JSMapWeakRef *wr;
         /* Add the weak reference */
-        mr->next_weak_ref = p->first_weak_ref;
-        p->first_weak_ref = mr;
+        wr = js_malloc(ctx, sizeof(*wr));
+        if (!wr)
+            return NULL;
+        wr->map = s;
+        wr->pos = pos;
+        wr->next_weak_ref = p->first_weak_ref;
+        p->first_weak_ref = wr;
     } else {
         JS_DupValue(ctx, key);
     }
+    mr = &s->records[pos];
     mr->key = (JSValue)key;
-    h = map_hash_key(ctx, key) & (s->hash_size - 1);
-    list_add_tail(&mr->hash_link, &s->hash_table[h]);
-    list_add_tail(&mr->link, &s->records);
+    mr->value = JS_UNDEFINED;
+    mr->hash = h;
+    mask = s->hash_size - 1;
+    for(i = h & mask; s->hash_table[i] != 0; i = (i + 1) & mask)
+        continue;
+    s->hash_table[i] = pos + 1;
+    s->record_end++;
     s->record_count++;
-    if (s->record_count >= s->record_count_threshold) {
-        map_hash_resize(ctx, s);
-    }
     return mr;
 }
 
 /* Remove the weak reference from the object weak
    reference list. we don't use a doubly linked list to
    save space, assuming a given object has few weak
-       references to it */
-static void delete_weak_ref(JSRuntime *rt, JSMapRecord *mr)
+   references to it */
+static void delete_weak_ref(JSRuntime *rt, JSMapState *s, uint32_t pos)
 {
-    JSMapRecord **pmr, *mr1;
-    JSObject *p;
+    JSMapWeakRef **pwr, *wr;
 
-    p = JS_VALUE_GET_OBJ(mr->key);
-    pmr = &p->first_weak_ref;
-    for(;;) {
-        mr1 = *pmr;
-        assert(mr1 != NULL);
-        if (mr1 == mr)
-            break;
-        pmr = &mr1->next_weak_ref;
-    }
-    *pmr = mr1->next_weak_ref;
+    pwr = find_weak_ref(s, pos);
+    wr = *pwr;
+    *pwr = wr->next_weak_ref;
+    js_free_rt(rt, wr);
 }
 
 static void map_delete_record(JSRuntime *rt, JSMapState *s, JSMapRecord *mr)
 {
-    if (mr->empty)
-        return;
-    list_del(&mr->hash_link);
     if (s->is_weak) {
-        delete_weak_ref(rt, mr);
+        delete_weak_ref(rt, s, mr - s->records);
     } else {
         JS_FreeValueRT(rt, mr->key);
     }
     JS_FreeValueRT(rt, mr->value);
-    if (--mr->ref_count == 0) {
-        list_del(&mr->link);
-        js_free_rt(rt, mr);
-    } else {
-        /* keep a zombie record for iterators */
-        mr->empty = TRUE;
-        mr->key = JS_UNDEFINED;
-        mr->value = JS_UNDEFINED;
-    }
+    /* the record stays in the hash table until the next compaction */
+    mr->key = JS_UNINITIALIZED;
+    mr->value = JS_UNDEFINED;
     s->record_count--;
 }
 
-static void map_decref_record(JSRuntime *rt, JSMapRecord *mr)
-{
-    if (--mr->ref_count == 0) {
-        /* the record can be safely removed */
-        assert(mr->empty);
-        list_del(&mr->link);
-        js_free_rt(rt, mr);
-    }
-}
-
 static void reset_weak_ref(JSRuntime *rt, JSObject *p)
 {
-    JSMapRecord *mr, *mr_next;
+    JSMapWeakRef *wr, *wr_next;
+    JSMapRecord *mr;
     JSMapState *s;
     
     /* first pass to remove the records from the WeakMap/WeakSet
-       lists */
-    for(mr = p->first_weak_ref; mr != NULL; mr = mr->next_weak_ref) {
-        s = mr->map;
+       tables */
+    for(wr = p->first_weak_ref; wr != NULL; wr = wr->next_weak_ref) {
+        s = wr->map;
         assert(s->is_weak);
-        assert(!mr->empty); /* no iterator on WeakMap/WeakSet */
-        list_del(&mr->hash_link);
-        list_del(&mr->link);
+        mr = &s->records[wr->pos];
+        wr->value = mr->value;
+        mr->key = JS_UNINITIALIZED;
+        mr->value = JS_UNDEFINED;
+        s->record_count--;
     }
     
     /* second pass to free the values to avoid modifying the weak
        reference list while traversing it. */
-    for(mr = p->first_weak_ref; mr != NULL; mr = mr_next) {
-        mr_next = mr->next_weak_ref;
-        JS_FreeValueRT(rt, mr->value);
-        js_free_rt(rt, mr);
+    for(wr = p->first_weak_ref; wr != NULL; wr = wr_next) {
+        wr_next = wr->next_weak_ref;
+        JS_FreeValueRT(rt, wr->value);
+        js_free_rt(rt, wr);
     }
 
     p->first_weak_ref = NULL; /* fail safe */
@@ -45649,6 +49358,7 @@ static JSValue js_map_set(JSContext *ctx, JSValueConst this_val,
     JSMapState *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_MAP + magic);
     JSMapRecord *mr;
     JSValueConst key, value;
+    uint32_t h;
 
     if (!s)
         return JS_EXCEPTION;
@@ -45659,11 +49369,12 @@ static JSValue js_map_set(JSContext *ctx, JSValueConst this_val,
         value = JS_UNDEFINED;
     else
         value = argv[1];
-    mr = map_find_record(ctx, s, key);
+    h = map_hash_key(ctx, key);
+    mr = map_find_record(ctx, s, key, h);
     if (mr) {
         JS_FreeValue(ctx, mr->value);
     } else {
-        mr = map_add_record(ctx, s, key);
+        mr = map_add_record(ctx, s, key, h);
         if (!mr)
             return JS_EXCEPTION;
     }
@@ -45681,7 +49392,7 @@ static JSValue js_map_get(JSContext *ctx, JSValueConst this_val,
     if (!s)
         return JS_EXCEPTION;
     key = map_normalize_key(ctx, argv[0]);
-    mr = map_find_record(ctx, s, key);
+    mr = map_find_record(ctx, s, key, map_hash_key(ctx, key));
     if (!mr)
         return JS_UNDEFINED;
     else
@@ -45698,7 +49409,7 @@ static JSValue js_map_has(JSContext *ctx, JSValueConst this_val,
     if (!s)
         return JS_EXCEPTION;
     key = map_normalize_key(ctx, argv[0]);
-    mr = map_find_record(ctx, s, key);
+    mr = map_find_record(ctx, s, key, map_hash_key(ctx, key));
     return JS_NewBool(ctx, (mr != NULL));
 }
 
@@ -45712,7 +49423,7 @@ static JSValue js_map_delete(JSContext *ctx, JSValueConst this_val,
     if (!s)
         return JS_EXCEPTION;
     key = map_normalize_key(ctx, argv[0]);
-    mr = map_find_record(ctx, s, key);
+    mr = map_find_record(ctx, s, key, map_hash_key(ctx, key));
     if (!mr)
         return JS_FALSE;
     map_delete_record(ctx->rt, s, mr);
@@ -45723,14 +49434,20 @@ static JSValue js_map_clear(JSContext *ctx, JSValueConst this_val,
                             int argc, JSValueConst *argv, int magic)
 {
     JSMapState *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_MAP + magic);
-    struct list_head *el, *el1;
     JSMapRecord *mr;
+    uint32_t i;
 
     if (!s)
         return JS_EXCEPTION;
-    list_for_each_safe(el, el1, &s->records) {
-        mr = list_entry(el, JSMapRecord, link);
-        map_delete_record(ctx->rt, s, mr);
+    /* Note: freeing the values may not modify the map */
+    for(i = 0; i < s->record_end; i++) {
+        mr = &s->records[i];
+        if (!map_record_is_deleted(mr))
+            map_delete_record(ctx->rt, s, mr);
+    }
+    if (s->record_end != 0) {
+        map_compact(s);
+        map_hash_rebuild(s);
     }
     return JS_UNDEFINED;
 }
@@ -45749,7 +49466,7 @@ static JSValue js_map_forEach(JSContext *ctx, JSValueConst this_val,
     JSMapState *s = JS_GetOpaque2(ctx, this_val, JS_CLASS_MAP + magic);
     JSValueConst func, this_arg;
     JSValue ret, args[3];
-    struct list_head *el;
+    JSMapCursor cursor;
     JSMapRecord *mr;
 
     if (!s)
@@ -45761,33 +49478,32 @@ static JSValue js_map_forEach(JSContext *ctx, JSValueConst this_val,
         this_arg = JS_UNDEFINED;
     if (check_function(ctx, func))
         return JS_EXCEPTION;
-    /* Note: the list can be modified while traversing it, but the
-       current element is locked */
-    el = s->records.next;
-    while (el != &s->records) {
-        mr = list_entry(el, JSMapRecord, link);
-        if (!mr->empty) {
-            mr->ref_count++;
-            /* must duplicate in case the record is deleted */
-            args[1] = JS_DupValue(ctx, mr->key);
-            if (magic)
-                args[0] = args[1];
-            else
-                args[0] = JS_DupValue(ctx, mr->value);
-            args[2] = (JSValue)this_val;
-            ret = JS_Call(ctx, func, this_arg, 3, (JSValueConst *)args);
-            JS_FreeValue(ctx, args[0]);
-            if (!magic)
-                JS_FreeValue(ctx, args[1]);
-            el = el->next;
-            map_decref_record(ctx->rt, mr);
-            if (JS_IsException(ret))
-                return ret;
-            JS_FreeValue(ctx, ret);
-        } else {
-            el = el->next;
+    /* Note: the map can be modified while traversing it, the cursor
+       is updated if the records are moved */
+    cursor.pos = 0;
+    list_add_tail(&cursor.link, &s->cursors);
+    while (cursor.pos < s->record_end) {
+        mr = &s->records[cursor.pos++];
+        if (map_record_is_deleted(mr))
+            continue;
+        /* must duplicate in case the record is deleted */
+        args[1] = JS_DupValue(ctx, mr->key);
+        if (magic)
+            args[0] = args[1];
+        else
+            args[0] = JS_DupValue(ctx, mr->value);
+        args[2] = (JSValue)this_val;
+        ret = JS_Call(ctx, func, this_arg, 3, (JSValueConst *)args);
+        JS_FreeValue(ctx, args[0]);
+        if (!magic)
+            JS_FreeValue(ctx, args[1]);
+        if (JS_IsException(ret)) {
+            list_del(&cursor.link);
+            return ret;
         }
+        JS_FreeValue(ctx, ret);
     }
+    list_del(&cursor.link);
     return JS_UNDEFINED;
 }
 
@@ -45797,23 +49513,27 @@ static void js_map_finalizer(JSRuntime *rt, JSValue val)
     JSMapState *s;
     struct list_head *el, *el1;
     JSMapRecord *mr;
+    uint32_t i;
 
     p = JS_VALUE_GET_OBJ(val);
     s = p->u.map_state;
     if (s) {
-        /* if the object is deleted we are sure that no iterator is
-           using it */
-        list_for_each_safe(el, el1, &s->records) {
-            mr = list_entry(el, JSMapRecord, link);
-            if (!mr->empty) {
+        /* During the GC sweep phase the iterators may be finalized
+           after the map: detach them */
+        list_for_each_safe(el, el1, &s->cursors) {
+            init_list_head(el);
+        }
+        for(i = 0; i < s->record_end; i++) {
+            mr = &s->records[i];
+            if (!map_record_is_deleted(mr)) {
                 if (s->is_weak)
-                    delete_weak_ref(rt, mr);
+                    delete_weak_ref(rt, s, i);
                 else
                     JS_FreeValueRT(rt, mr->key);
                 JS_FreeValueRT(rt, mr->value);
             }
-            js_free_rt(rt, mr);
         }
+        js_free_rt(rt, s->records);
         js_free_rt(rt, s->hash_table);
         js_free_rt(rt, s);
     }
@@ -45823,13 +49543,15 @@ static void js_map_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
 {
     JSObject *p = JS_VALUE_GET_OBJ(val);
     JSMapState *s;
-    struct list_head *el;
     JSMapRecord *mr;
+    uint32_t i;
 
     s = p->u.map_state;
     if (s) {
-        list_for_each(el, &s->records) {
-            mr = list_entry(el, JSMapRecord, link);
+        for(i = 0; i < s->record_end; i++) {
+            mr = &s->records[i];
+            if (map_record_is_deleted(mr))
+                continue;
             if (!s->is_weak)
                 JS_MarkValue(rt, mr->key, mark_func);
             JS_MarkValue(rt, mr->value, mark_func);
@@ -45842,7 +49564,7 @@ static void js_map_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
 typedef struct JSMapIteratorData {
     JSValue obj;
     JSIteratorKindEnum kind;
-    JSMapRecord *cur_record;
+    JSMapCursor cursor; /* in the map cursor list if obj is defined */
 } JSMapIteratorData;
 
 static void js_map_iterator_finalizer(JSRuntime *rt, JSValue val)
@@ -45853,11 +49575,8 @@ static void js_map_iterator_finalizer(JSRuntime *rt, JSValue val)
     p = JS_VALUE_GET_OBJ(val);
     it = p->u.map_iterator_data;
     if (it) {
-        /* During the GC sweep phase the Map finalizer may be
-           called before the Map iterator finalizer */
-        if (JS_IsLiveObject(rt, it->obj) && it->cur_record) {
-            map_decref_record(rt, it->cur_record);
-        }
+        if (!JS_IsUndefined(it->obj))
+            list_del(&it->cursor.link);
         JS_FreeValueRT(rt, it->obj);
         js_free_rt(rt, it);
     }
@@ -45870,7 +49589,6 @@ static void js_map_iterator_mark(JSRuntime *rt, JSValueConst val,
     JSMapIteratorData *it;
     it = p->u.map_iterator_data;
     if (it) {
-        /* the record is already marked by the object */
         JS_MarkValue(rt, it->obj, mark_func);
     }
 }
@@ -45898,7 +49616,8 @@ static JSValue js_create_map_iterator(JSContext *ctx, JSValueConst this_val,
     }
     it->obj = JS_DupValue(ctx, this_val);
     it->kind = kind;
-    it->cur_record = NULL;
+    it->cursor.pos = 0;
+    list_add_tail(&it->cursor.link, &s->cursors);
     JS_SetOpaque(enum_obj, it);
     return enum_obj;
  fail:
@@ -45912,7 +49631,6 @@ static JSValue js_map_iterator_next(JSContext *ctx, JSValueConst this_val,
     JSMapIteratorData *it;
     JSMapState *s;
     JSMapRecord *mr;
-    struct list_head *el;
 
     it = JS_GetOpaque2(ctx, this_val, JS_CLASS_MAP_ITERATOR + magic);
     if (!it) {
@@ -45923,17 +49641,10 @@ static JSValue js_map_iterator_next(JSContext *ctx, JSValueConst this_val,
         goto done;
     s = JS_GetOpaque(it->obj, JS_CLASS_MAP + magic);
     assert(s != NULL);
-    if (!it->cur_record) {
-        el = s->records.next;
-    } else {
-        mr = it->cur_record;
-        el = mr->link.next;
-        map_decref_record(ctx->rt, mr); /* the record can be freed here */
-    }
     for(;;) {
-        if (el == &s->records) {
+        if (it->cursor.pos >= s->record_end) {
             /* no more record  */
-            it->cur_record = NULL;
+            list_del(&it->cursor.link);
             JS_FreeValue(ctx, it->obj);
             it->obj = JS_UNDEFINED;
         done:
@@ -45941,16 +49652,10 @@ static JSValue js_map_iterator_next(JSContext *ctx, JSValueConst this_val,
             *pdone = TRUE;
             return JS_UNDEFINED;
         }
-        mr = list_entry(el, JSMapRecord, link);
-        if (!mr->empty)
+        mr = &s->records[it->cursor.pos++];
+        if (!map_record_is_deleted(mr))
             break;
-        /* get the next record */
-        el = mr->link.next;
     }
-
-    /* lock the record so that it won't be freed */
-    mr->ref_count++;
-    it->cur_record = mr;
     *pdone = FALSE;
 
     if (it->kind == JS_ITERATOR_KIND_KEY) {
@@ -49140,6 +52845,60 @@ static JSValue js_bigint_op1(JSContext *ctx,
     return JS_NewBigInt64(ctx, res);
 }
 
+/* BigInt.powMod(a, e, m) = a^e mod m, in [0, m). Odd moduli use
+   Montgomery multiplication. */
+static JSValue js_bigint_powMod(JSContext *ctx,
+                                JSValueConst this_val,
+                                int argc, JSValueConst *argv)
+{
+    bf_t a_s, e_s, m_s, *a, *e, *m, *r;
+    int status;
+    JSValue res;
+
+    res = JS_NewBigInt(ctx);
+    if (JS_IsException(res))
+        return JS_EXCEPTION;
+    a = JS_ToBigInt(ctx, &a_s, argv[0]);
+    if (!a)
+        goto fail;
+    e = JS_ToBigInt(ctx, &e_s, argv[1]);
+    if (!e) {
+        JS_FreeBigInt(ctx, a, &a_s);
+        goto fail;
+    }
+    m = JS_ToBigInt(ctx, &m_s, argv[2]);
+    if (!m) {
+        JS_FreeBigInt(ctx, a, &a_s);
+        JS_FreeBigInt(ctx, e, &e_s);
+        goto fail;
+    }
+    r = JS_GetBigInt(res);
+    if (e->sign) {
+        JS_ThrowRangeError(ctx, "negative exponent");
+        goto fail_free;
+    }
+    if (m->sign || bf_is_zero(m)) {
+        JS_ThrowRangeError(ctx, "modulus must be positive");
+        goto fail_free;
+    }
+    status = bf_pow_mod(r, a, e, m);
+    if (unlikely(status)) {
+        throw_bf_exception(ctx, status);
+        goto fail_free;
+    }
+    JS_FreeBigInt(ctx, a, &a_s);
+    JS_FreeBigInt(ctx, e, &e_s);
+    JS_FreeBigInt(ctx, m, &m_s);
+    return JS_CompactBigInt(ctx, res);
+ fail_free:
+    JS_FreeBigInt(ctx, a, &a_s);
+    JS_FreeBigInt(ctx, e, &e_s);
+    JS_FreeBigInt(ctx, m, &m_s);
+ fail:
+    JS_FreeValue(ctx, res);
+    return JS_EXCEPTION;
+}
+
 static JSValue js_bigint_asUintN(JSContext *ctx,
                                   JSValueConst this_val,
                                   int argc, JSValueConst *argv, int asIntN)
@@ -49196,6 +52955,7 @@ static const JSCFunctionListEntry js_bigint_funcs[] = {
     JS_CFUNC_MAGIC_DEF("sqrtrem", 1, js_bigint_sqrt, 1 ),
     JS_CFUNC_MAGIC_DEF("floorLog2", 1, js_bigint_op1, 0 ),
     JS_CFUNC_MAGIC_DEF("ctz", 1, js_bigint_op1, 1 ),
+    JS_CFUNC_DEF("powMod", 3, js_bigint_powMod ),
 };
 
 static const JSCFunctionListEntry js_bigint_proto_funcs[] = {
@@ -49213,7 +52973,7 @@ void JS_AddIntrinsicBigInt(JSContext *ctx)
     rt->bigint_ops.from_string = js_string_to_bigint;
     rt->bigint_ops.unary_arith = js_unary_arith_bigint;
     rt->bigint_ops.binary_arith = js_binary_arith_bigint;
-    rt->bigint_ops.compare = js_compare_bigfloat;
+    rt->bigint_ops.compare = js_compare_bigint;
     
     ctx->class_proto[JS_CLASS_BIG_INT] = JS_NewObject(ctx);
     JS_SetPropertyFunctionList(ctx, ctx->class_proto[JS_CLASS_BIG_INT],
@@ -343,8 +343,81 @@ void JS_SetRuntimeOpaque(JSRuntime *rt, void *opaque);
 typedef void JS_MarkFunc(JSRuntime *rt, JSGCObjectHeader *gp);
 void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func);
 void JS_RunGC(JSRuntime *rt);
+/* Run the cycle collector on a part of the heap for about 'budget_us'
+   microseconds. Successive slices rotate over the whole heap. Return
+   TRUE if the slice covered the whole heap. */
+JS_BOOL JS_RunGCSlice(JSRuntime *rt, int64_t budget_us);
+/* when 'budget_us' > 0, the automatic GC only runs slices of this
+   budget until the heap has doubled since the last full GC. Use 0 to
+   restore the stop-the-world behavior. */
+void JS_SetGCSliceBudget(JSRuntime *rt, int64_t budget_us);
+/* Run the cycle collector on the objects allocated since the last
+   collection. The survivors are promoted to the old generation. */
+void JS_RunMinorGC(JSRuntime *rt);
+/* when 'size' > 0, a minor GC is run each time 'size' bytes were
+   allocated since the last collection. Use 0 to disable it. */
+void JS_SetGCNurserySize(JSRuntime *rt, size_t size);
 JS_BOOL JS_IsLiveObject(JSRuntime *rt, JSValueConst obj);
 
+#define JS_GC_PAUSE_HISTOGRAM_SIZE 16
+
+typedef struct JSGCStats {
+    int64_t full_count;
+    int64_t slice_count;
+    int64_t minor_count;
+    int64_t total_pause_us;
+    int64_t max_pause_us;
+    /* pause_histogram[i] counts the pauses in [2^i, 2^(i+1)) us. The
+       first bucket also counts the pauses < 1 us and the last one all
+       the longer pauses. */
+    int64_t pause_histogram[JS_GC_PAUSE_HISTOGRAM_SIZE];
+} JSGCStats;
+
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s);
+void JS_ResetGCStats(JSRuntime *rt);
+
+/* the compiled RegExp bytecode is shared by the regexps having the same
+   source and flags. At most 'size' entries are kept, the least recently
+   used first evicted. Use 0 to disable the cache, 'size' is limited to
+   65536. */
+void JS_SetRegExpCacheSize(JSRuntime *rt, int size);
+
+typedef struct JSRegExpCacheStats {
+    int64_t hits;
+    int64_t misses;
+    int64_t count;
+    int64_t size;
+} JSRegExpCacheStats;
+
+void JS_GetRegExpCacheStats(JSRuntime *rt, JSRegExpCacheStats *s);
+
+/* sample the JS call stack every 'interval_us' us of execution. Return
+   -1 if already profiling or memory error. */
+int JS_StartProfiling(JSRuntime *rt, int64_t interval_us);
+/* stop profiling and, if 'filename' is not NULL, write the samples to
+   it in the Chrome trace event format. Return -1 if error. */
+int JS_StopProfiling(JSRuntime *rt, const char *filename);
+/* record the JS stack and the kind of an allocation each time
+   'sample_interval' bytes were allocated. Return -1 if already
+   profiling or memory error. */
+int JS_StartAllocProfiling(JSRuntime *rt, size_t sample_interval);
+/* write the live sampled allocations to 'filename' in the folded
+   stacks format. Return -1 if error. */
+int JS_DumpAllocProfile(JSRuntime *rt, const char *filename);
+void JS_StopAllocProfiling(JSRuntime *rt);
+
+typedef struct JSHeapSnapshotHandle {
+    const char *name;
+    JSValueConst value;
+} JSHeapSnapshotHandle;
+
+/* run the GC and write the reachable heap to 'filename' in the V8
+   .heapsnapshot format. 'handles' are the values held by the host,
+   reported under the "(Host handles)" root. Return -1 if error. */
+int JS_WriteHeapSnapshot(JSRuntime *rt, const char *filename,
+                         const JSHeapSnapshotHandle *handles,
+                         int handle_count);
+
 JSContext *JS_NewContext(JSRuntime *rt);
 void JS_FreeContext(JSContext *s);
 JSContext *JS_DupContext(JSContext *ctx);
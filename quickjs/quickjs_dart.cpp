@@ -17,12 +17,18 @@
 #include <thread>
 #include <pthread.h>
 #include <sstream>
+#include <chrono>
 #include "quickjs_ext.h"
 #include "quickjs-libc.h"
 #include "cutils.h"
 #include <memory.h>
 #include <sys/time.h>
 #include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
 
 
 using namespace std;
@@ -44,6 +50,11 @@ const int JS_ACTION_NEW_ARRAYBUFFER = 14;
 const int JS_ACTION_COMPILE = 15;
 const int JS_ACTION_LOAD_COMPILED = 16;
 const int JS_ACTION_NEW_ARRAY = 17;
+const int JS_ACTION_LOAD_PLUGIN = 18;
+
+// result of an action when results[0] holds the value thrown by the
+// script, the other failures return -1 with a message
+const int ACTION_RESULT_EXCEPTION = -2;
 
 const int JS_ACTION_IS_ARRAY = 100;
 const int JS_ACTION_IS_FUNCTION = 101;
@@ -76,15 +87,36 @@ const int MEMBER_GETTER       = 1 << 2;
 const int MEMBER_SETTER       = 1 << 3;
 const int MEMBER_STATIC       = 1 << 4;
 
+// optional intrinsics of a new context, the ES2020 built-ins are
+// always present
+const int INTRINSIC_OPERATORS   = 1 << 0;
+const int INTRINSIC_BIGFLOAT    = 1 << 1;
+const int INTRINSIC_BIGDECIMAL  = 1 << 2;
+const int INTRINSIC_MATH_MODE   = 1 << 3;
+
+// console levels, also the type passed to the print handler. The
+// messages below the level of the context are dropped before their
+// arguments are converted, CONSOLE_NONE drops everything.
+const int CONSOLE_LOG   = 0;
+const int CONSOLE_WARN  = 1;
+const int CONSOLE_ERROR = 2;
+const int CONSOLE_NONE  = 3;
+
+// console flags
+const int CONSOLE_TIMESTAMPS = 1 << 0;
+
 class JsContext;
 
-typedef void(*JsPrintHandler)(int type, const char *str);
+// prints a batch of 'count' console messages, levels[i] is the level
+// of texts[i]
+typedef void(*JsPrintHandler)(JsContext *, int count, const int *levels, const char *const *texts);
 typedef int(*JsToDartActionHandler)(JsContext *, int type, int argc);
 
 struct JsHandlers {
     int maxArguments;
     JsPrintHandler print;
     JsToDartActionHandler toDartAction;
+    int intrinsics;
 };
 
 struct JsArgument {
@@ -150,6 +182,7 @@ struct JsMember {
 
 struct JsFunction {
     JSValue value;
+    JsContext *context;
 };
 
 struct JsClass {
@@ -171,6 +204,174 @@ struct JsPromise {
 };
 
 
+class JsRuntime {
+    int retainCount = 1;
+
+public:
+    JSRuntime *runtime;
+    map<JSClassID, JsContext *> classes;
+
+    JsRuntime() {
+        runtime = JS_NewRuntime();
+        JS_SetRuntimeOpaque(runtime, this);
+    }
+
+    ~JsRuntime() {
+        JS_FreeRuntime(runtime);
+    }
+
+    bool isShared() const {
+        return retainCount > 1;
+    }
+
+    JsRuntime *retain() {
+        ++retainCount;
+        return this;
+    }
+
+    void release() {
+        if (--retainCount == 0) {
+            delete this;
+        }
+    }
+};
+
+const int ACTION_TYPE_COUNT = 128;
+const int ACTION_HISTOGRAM_SIZE = 16;
+
+struct JsActionStats {
+    int64_t count;
+    // time spent in native code, the nested Dart callbacks excluded
+    int64_t nativeTime;
+    // time spent waiting for Dart callbacks
+    int64_t dartTime;
+    int64_t maxTime;
+    // histogram[i] counts the actions which took [2^i, 2^(i+1)) us
+    int64_t histogram[ACTION_HISTOGRAM_SIZE];
+};
+
+// Records the latency of the actions crossing the bridge and, if a
+// trace file is set, streams them as Chrome trace events.
+class BridgeTracer {
+    FILE *file;
+    int64_t startTime;
+    bool firstEvent = true;
+
+    static int histogramIndex(int64_t time) {
+        int i = 0;
+        while (time > 1 && i < ACTION_HISTOGRAM_SIZE - 1) {
+            time >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+public:
+    JsActionStats jsActions[ACTION_TYPE_COUNT] = {};
+    JsActionStats dartActions[ACTION_TYPE_COUNT] = {};
+    // total time spent in Dart callbacks, used to split the time of
+    // the JS actions which call back into Dart
+    int64_t dartTime = 0;
+
+    static int64_t now() {
+        return chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    BridgeTracer(FILE *file) : file(file), startTime(now()) {
+        if (file) fputs("{\"traceEvents\":[", file);
+    }
+
+    ~BridgeTracer() {
+        if (file) {
+            fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+            fclose(file);
+        }
+    }
+
+    void record(bool dart, int type, int64_t start, int64_t end, int64_t dartTime) {
+        if (type < 0 || type >= ACTION_TYPE_COUNT) return;
+        JsActionStats &stats = dart ? dartActions[type] : jsActions[type];
+        int64_t time = end - start;
+        stats.count++;
+        stats.nativeTime += time - dartTime;
+        stats.dartTime += dartTime;
+        stats.maxTime = max(stats.maxTime, time);
+        stats.histogram[histogramIndex(time)]++;
+        if (file) {
+            fprintf(file, "%s\n{\"name\":\"%s_ACTION_%d\",\"cat\":\"bridge\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}",
+                    firstEvent ? "" : ",", dart ? "DART" : "JS", type,
+                    (long long)(start - startTime), (long long)time, dart ? 2 : 1);
+            firstEvent = false;
+        }
+    }
+};
+
+// Buffers the console output as records with their level and time.
+// A flush passes all the buffered records to one call of the print
+// handler, each record stays a separate message. The records are
+// flushed when the buffer is full, when an error is printed, before
+// calling Dart and at the end of each action.
+class ConsoleSink {
+    struct Record {
+        int level;
+        int64_t time;
+        string text;
+    };
+
+    JsContext *owner;
+    JsPrintHandler handler;
+    int64_t startTime;
+    size_t capacity = 64;
+    vector<Record> records;
+    vector<int> levels;
+    vector<const char *> texts;
+
+public:
+    int level = CONSOLE_LOG;
+    int flags = 0;
+    // start times of console.time and values of console.count by label
+    map<string, int64_t> timers;
+    map<string, int64_t> counters;
+
+    ConsoleSink(JsContext *owner, JsPrintHandler handler) : owner(owner), handler(handler), startTime(BridgeTracer::now()) {}
+
+    // number of buffered records, 0 calls the handler for each record
+    // alone
+    void setCapacity(size_t size) {
+        flush();
+        capacity = size;
+        records.shrink_to_fit();
+    }
+
+    bool enabled(int type) const {
+        return handler && type >= level;
+    }
+
+    void add(int type, string &&text) {
+        if (!enabled(type)) return;
+        records.push_back({type, BridgeTracer::now(), std::move(text)});
+        if (records.size() >= capacity || type >= CONSOLE_ERROR) flush();
+    }
+
+    void flush() {
+        if (records.empty()) return;
+        levels.clear();
+        texts.clear();
+        for (Record &record : records) {
+            if (flags & CONSOLE_TIMESTAMPS) {
+                char stamp[32];
+                snprintf(stamp, sizeof(stamp), "[%.3f] ", (record.time - startTime) / 1000.0);
+                record.text.insert(0, stamp);
+            }
+            levels.push_back(record.level);
+            texts.push_back(record.text.c_str());
+        }
+        handler(owner, (int)records.size(), levels.data(), texts.data());
+        records.clear();
+    }
+};
+
 bool isWordChar(char x) {
     return (x >= 'a' && x <= 'z') || (x >= 'A' && x <= 'Z') || (x >= '0' && x <= '9') || x == '_';
 }
@@ -207,6 +408,8 @@ class JsContext {
 //    JSAtom operator_set_atom;
 
     vector<JSValue> temp_results;
+    // exports objects of the loaded native plugins by library path.
+    map<string, JSValue> plugins;
 
     static JSValue constructor(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
         JsContext *self = (JsContext *)JS_GetContextOpaque(ctx);
@@ -346,7 +549,10 @@ class JsContext {
         return JS_EXCEPTION;
     }
     static void class_finalizer(JSRuntime *rt, JSValue val) {
-        JsContext *self = (JsContext *)JS_GetRuntimeOpaque(rt);
+        JsRuntime *shared = (JsRuntime *)JS_GetRuntimeOpaque(rt);
+        auto it = shared->classes.find(JS_GetClassID3(val));
+        if (it == shared->classes.end()) return;
+        JsContext *self = it->second;
         self->arguments[0].setPointer(JS_VALUE_GET_PTR(val));
         self->toDartAction(DART_ACTION_DELETE, 1);
     }
@@ -379,7 +585,7 @@ class JsContext {
     static char *module_name(JSContext *ctx,
             const char *module_base_name,
             const char *module_name, void *opaque) {
-        JsContext *self = (JsContext *)opaque;
+        JsContext *self = (JsContext *)JS_GetContextOpaque(ctx);
         self->arguments[0].set(module_base_name);
         self->arguments[1].set(module_name);
         int ret = self->toDartAction(DART_ACTION_MODULE_NAME, 2);
@@ -392,7 +598,7 @@ class JsContext {
 
     static JSModuleDef *module_loader(JSContext *ctx,
             const char *module_name, void *opaque) {
-        JsContext *self = (JsContext *)opaque;
+        JsContext *self = (JsContext *)JS_GetContextOpaque(ctx);
         self->arguments[0].set(module_name);
         int ret = self->toDartAction(DART_ACTION_LOAD_MODULE, 1);
         JSModuleDef *module = nullptr;
@@ -416,21 +622,94 @@ class JsContext {
         return module;
     }
 
-    static JSValue consolePrint(JSContext *ctx, int type, int argc, JSValueConst *argv) {
-        string str;
+    static void appendArguments(JSContext *ctx, string &str, int argc, JSValueConst *argv) {
         for (int i = 0; i < argc; ++i) {
-            const char *cstr = JS_ToCString(ctx, argv[i]);
+            size_t len;
+            const char *cstr = JS_ToCStringLen(ctx, &len, argv[i]);
             if (cstr) {
-                str += cstr;
+                str.append(cstr, len);
                 JS_FreeCString(ctx, cstr);
                 if (i != argc - 1) {
                     str += ',';
                 }
             }
         }
-        JSRuntime *runtime = JS_GetRuntime(ctx);
-        JsContext *that = (JsContext *)JS_GetRuntimeOpaque(runtime);
-        print(that, type, "%s", str.c_str());
+    }
+
+    static JSValue consolePrint(JSContext *ctx, int type, int argc, JSValueConst *argv) {
+        JsContext *that = (JsContext *)JS_GetContextOpaque(ctx);
+        if (!that->console.enabled(type)) return JS_UNDEFINED;
+        string str;
+        appendArguments(ctx, str, argc, argv);
+        that->console.add(type, std::move(str));
+        return JS_UNDEFINED;
+    }
+
+    // false with a pending exception if the label is not convertible
+    static bool consoleLabel(JSContext *ctx, int argc, JSValueConst *argv, string &label) {
+        label = "default";
+        if (argc > 0 && !JS_IsUndefined(argv[0])) {
+            size_t len;
+            const char *cstr = JS_ToCStringLen(ctx, &len, argv[0]);
+            if (!cstr) return false;
+            label.assign(cstr, len);
+            JS_FreeCString(ctx, cstr);
+        }
+        return true;
+    }
+
+    // console.time, console.timeLog and console.timeEnd
+    static JSValue consoleTime(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+        JsContext *that = (JsContext *)JS_GetContextOpaque(ctx);
+        ConsoleSink &console = that->console;
+        string label;
+        if (!consoleLabel(ctx, argc, argv, label)) return JS_EXCEPTION;
+        auto it = console.timers.find(label);
+        if (magic == 0) {
+            if (it == console.timers.end()) {
+                console.timers[label] = BridgeTracer::now();
+            } else {
+                print(that, CONSOLE_WARN, "Timer '%s' already exists", label.c_str());
+            }
+        } else if (it == console.timers.end()) {
+            print(that, CONSOLE_WARN, "Timer '%s' does not exist", label.c_str());
+        } else {
+            int64_t time = BridgeTracer::now() - it->second;
+            if (magic == 2) console.timers.erase(it);
+            if (console.enabled(CONSOLE_LOG)) {
+                char elapsed[32];
+                snprintf(elapsed, sizeof(elapsed), ": %.3fms", time / 1000.0);
+                label += elapsed;
+                if (magic == 1 && argc > 1) {
+                    label += ' ';
+                    appendArguments(ctx, label, argc - 1, argv + 1);
+                }
+                console.add(CONSOLE_LOG, std::move(label));
+            }
+        }
+        return JS_UNDEFINED;
+    }
+
+    // console.count and console.countReset
+    static JSValue consoleCount(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+        JsContext *that = (JsContext *)JS_GetContextOpaque(ctx);
+        ConsoleSink &console = that->console;
+        string label;
+        if (!consoleLabel(ctx, argc, argv, label)) return JS_EXCEPTION;
+        if (magic == 0) {
+            int64_t count = ++console.counters[label];
+            if (console.enabled(CONSOLE_LOG)) {
+                label += ": " + to_string(count);
+                console.add(CONSOLE_LOG, std::move(label));
+            }
+        } else {
+            auto it = console.counters.find(label);
+            if (it == console.counters.end()) {
+                print(that, CONSOLE_WARN, "Count for '%s' does not exist", label.c_str());
+            } else {
+                it->second = 0;
+            }
+        }
         return JS_UNDEFINED;
     }
 
@@ -455,6 +734,18 @@ class JsContext {
         return ss.str();
     }
 
+    // Hand the pending exception over to Dart in results[0], it is only
+    // converted to a message if Dart reads it.
+    int exceptionResult() {
+        JSValue ex = JS_GetException(context);
+        if (setArgument(results[0], ex)) {
+            temp_results.push_back(ex);
+        } else {
+            JS_FreeValue(context, ex);
+        }
+        return ACTION_RESULT_EXCEPTION;
+    }
+
     bool setArgument(JsArgument &argument, JSValue value) {
         auto tag = JS_VALUE_GET_TAG(value);
         switch (tag) {
@@ -578,16 +869,22 @@ class JsContext {
     }
 
     static void function_finalizer(JSRuntime *rt, void *opaque) {
-        JsContext *self = (JsContext *)JS_GetRuntimeOpaque(rt);
         JsFunction *func = (JsFunction *)opaque;
-        self->arguments[0].setPointer(JS_VALUE_GET_PTR(func->value));
-        self->toDartAction(DART_ACTION_DELETE, 1);
+        JsContext *self = func->context;
+        if (self) {
+            self->functions.erase(func);
+            self->arguments[0].setPointer(JS_VALUE_GET_PTR(func->value));
+            self->toDartAction(DART_ACTION_DELETE, 1);
+        }
         delete func;
     }
 
     string temp_string;
     JsArgument tempArgument;
     vector<JSValue> classVector;
+    vector<JSClassID> classIds;
+    set<JsFunction *> functions;
+    JsRuntime *shared;
     JSValue promise;
     JSValue promiseResolve;
     stack<JsArgument *> backups;
@@ -596,23 +893,33 @@ public:
     static JsContext *_temp;
     JSContext   *context;
     JSRuntime   *runtime;
+    BridgeTracer *tracer = nullptr;
+    ConsoleSink console;
 
     JsContext(
             JsArgument *arguments,
             JsArgument *results,
-            JsHandlers *handlers) :
+            JsHandlers *handlers,
+            JsRuntime *shared) :
             arguments(arguments),
             results(results),
-            handlers(*handlers) {
+            handlers(*handlers),
+            shared(shared ? shared->retain() : new JsRuntime()),
+            console(this, handlers->print) {
         _temp = this;
-        runtime = JS_NewRuntime();
-        JS_SetRuntimeOpaque(runtime, this);
-        JS_SetModuleLoaderFunc(runtime, module_name, module_loader, this);
+        runtime = this->shared->runtime;
+        JS_SetModuleLoaderFunc(runtime, module_name, module_loader, nullptr);
 
         context = JS_NewContext(runtime);
-        JS_AddIntrinsicOperators(context);
+        if (handlers->intrinsics & INTRINSIC_OPERATORS)
+            JS_AddIntrinsicOperators(context);
+        if (handlers->intrinsics & INTRINSIC_BIGFLOAT)
+            JS_AddIntrinsicBigFloat(context);
+        if (handlers->intrinsics & INTRINSIC_BIGDECIMAL)
+            JS_AddIntrinsicBigDecimal(context);
+        if (handlers->intrinsics & INTRINSIC_MATH_MODE)
+            JS_EnableBignumExt(context, TRUE);
         JS_AddIntrinsicRequire(context);
-        JS_AddIntrinsicProxy(context);
         JS_SetContextOpaque(context, this);
 
         private_key = JS_NewAtom(context, "_$tar");
@@ -626,17 +933,25 @@ public:
         JSValue console = JS_NewObject(context);
 
         JS_SetPropertyStr(context, console, "log", JS_NewCFunction(context, [](JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv){
-            consolePrint(ctx, 0, argc, argv);
-            return JS_UNDEFINED;
+            return consolePrint(ctx, CONSOLE_LOG, argc, argv);
         }, "log", 1));
+        JS_SetPropertyStr(context, console, "info", JS_NewCFunction(context, [](JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv){
+            return consolePrint(ctx, CONSOLE_LOG, argc, argv);
+        }, "info", 1));
+        JS_SetPropertyStr(context, console, "debug", JS_NewCFunction(context, [](JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv){
+            return consolePrint(ctx, CONSOLE_LOG, argc, argv);
+        }, "debug", 1));
         JS_SetPropertyStr(context, console, "warn", JS_NewCFunction(context, [](JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv){
-            consolePrint(ctx, 1, argc, argv);
-            return JS_UNDEFINED;
+            return consolePrint(ctx, CONSOLE_WARN, argc, argv);
         }, "warn", 1));
         JS_SetPropertyStr(context, console, "error", JS_NewCFunction(context, [](JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv){
-            consolePrint(ctx, 2, argc, argv);
-            return JS_UNDEFINED;
+            return consolePrint(ctx, CONSOLE_ERROR, argc, argv);
         }, "error", 1));
+        JS_SetPropertyStr(context, console, "time", JS_NewCFunctionMagic(context, consoleTime, "time", 1, JS_CFUNC_generic_magic, 0));
+        JS_SetPropertyStr(context, console, "timeLog", JS_NewCFunctionMagic(context, consoleTime, "timeLog", 1, JS_CFUNC_generic_magic, 1));
+        JS_SetPropertyStr(context, console, "timeEnd", JS_NewCFunctionMagic(context, consoleTime, "timeEnd", 1, JS_CFUNC_generic_magic, 2));
+        JS_SetPropertyStr(context, console, "count", JS_NewCFunctionMagic(context, consoleCount, "count", 1, JS_CFUNC_generic_magic, 0));
+        JS_SetPropertyStr(context, console, "countReset", JS_NewCFunctionMagic(context, consoleCount, "countReset", 1, JS_CFUNC_generic_magic, 1));
         JS_SetPropertyStr(context, global, "console", console);
 
 
@@ -653,10 +968,17 @@ public:
     }
 
     ~JsContext() {
+        // the last exception may still be waiting for Dart
+        clearCache();
+        console.flush();
         for (auto it = classVector.begin(); it != classVector.end(); ++it) {
             JS_FreeValue(context, *it);
         }
         classVector.clear();
+        for (auto it = plugins.begin(); it != plugins.end(); ++it) {
+            JS_FreeValue(context, it->second);
+        }
+        plugins.clear();
         JS_FreeAtom(context, private_key);
         JS_FreeAtom(context, class_private_key);
         JS_FreeAtom(context, exports_key);
@@ -667,13 +989,26 @@ public:
         JS_FreeValue(context, promiseResolve);
 
         JS_FreeContext(context);
-        JS_FreeRuntime(runtime);
+        if (shared->isShared()) {
+            // Finalize the objects of this context while the classes are
+            // still registered, the runtime outlives it.
+            JS_RunGC(runtime);
+            for (auto it = classIds.begin(); it != classIds.end(); ++it) {
+                shared->classes.erase(*it);
+            }
+            for (auto it = functions.begin(); it != functions.end(); ++it) {
+                (*it)->context = nullptr;
+            }
+            functions.clear();
+        }
+        shared->release();
         if (_temp == this)
             _temp = nullptr;
         while (!backups.empty()) {
             free(backups.top());
             backups.pop();
         }
+        delete tracer;
     }
 
     static void printError(JsContext *that, JSValue value, const char *prefix) {
@@ -704,7 +1039,23 @@ public:
     }
 
     int toDartAction(int type, int argc) {
-        int ret = handlers.toDartAction(this, type, argc);
+        int ret;
+        // keep the order of the script output and of the Dart prints
+        console.flush();
+        if (tracer) {
+            BridgeTracer *current = tracer;
+            int64_t start = BridgeTracer::now(), dartTime = tracer->dartTime;
+            ret = handlers.toDartAction(this, type, argc);
+            // the tracer may have been stopped by the callback
+            if (tracer == current) {
+                int64_t end = BridgeTracer::now();
+                tracer->record(true, type, start, end, end - start);
+                // the nested callbacks already added their own time
+                tracer->dartTime += (end - start) - (tracer->dartTime - dartTime);
+            }
+        } else {
+            ret = handlers.toDartAction(this, type, argc);
+        }
         if (ret < 0) {
             if (ret == -1) {
                 JSValue value = getArgument(results[0]);
@@ -733,7 +1084,87 @@ public:
         backups.push(backup);
     }
 
+    // Load the native plugin at `path` and return its exports object, on
+    // failure return JS_EXCEPTION with the message in temp_string. The
+    // library stays loaded for the life of the process, the functions it
+    // registered may still be referenced by other contexts.
+#ifndef _WIN32
+    // The plugins are not linked with this library, their undefined
+    // JS_* symbols are resolved from the global scope. Dart opens this
+    // library with RTLD_LOCAL, so it is promoted to RTLD_GLOBAL before
+    // the first plugin is loaded.
+    static void exportSymbols() {
+        static bool exported = false;
+        if (exported) return;
+        Dl_info info;
+        if (dladdr((void *)&JS_NewObject, &info) && info.dli_fname) {
+            // never closed, like the plugins
+            exported = dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_GLOBAL) != nullptr;
+        }
+    }
+#endif
+
+    JSValue loadPlugin(const char *path) {
+        auto it = plugins.find(path);
+        if (it != plugins.end()) {
+            return JS_DupValue(context, it->second);
+        }
+        JS_PluginInitFunction *init = nullptr;
+#ifdef _WIN32
+        HMODULE handle = LoadLibraryA(path);
+        if (handle) {
+            init = (JS_PluginInitFunction *)GetProcAddress(handle, JS_PLUGIN_INIT_NAME);
+        }
+#else
+        exportSymbols();
+        void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (handle) {
+            init = (JS_PluginInitFunction *)dlsym(handle, JS_PLUGIN_INIT_NAME);
+        }
+#endif
+        if (!handle) {
+            stringstream ss;
+            ss << "Could not load plugin " << path;
+#ifndef _WIN32
+            ss << ": " << dlerror();
+#endif
+            temp_string = ss.str();
+            return JS_EXCEPTION;
+        }
+        if (!init) {
+            temp_string = string("Plugin ") + path + " does not export " JS_PLUGIN_INIT_NAME;
+            return JS_EXCEPTION;
+        }
+
+        JSValue exports = JS_NewObject(context);
+        if (JS_IsException(exports) || init(context, exports) < 0) {
+            JS_FreeValue(context, exports);
+            JSValue ex = JS_GetException(context);
+            temp_string = errorString(ex);
+            JS_FreeValue(context, ex);
+            return JS_EXCEPTION;
+        }
+        plugins[path] = JS_DupValue(context, exports);
+        return exports;
+    }
+
     int action(int type, int argc) {
+        int ret;
+        if (!tracer) {
+            ret = runAction(type, argc);
+        } else {
+            BridgeTracer *current = tracer;
+            int64_t start = BridgeTracer::now(), dartTime = tracer->dartTime;
+            ret = runAction(type, argc);
+            if (tracer == current) {
+                tracer->record(false, type, start, BridgeTracer::now(), tracer->dartTime - dartTime);
+            }
+        }
+        console.flush();
+        return ret;
+    }
+
+    int runAction(int type, int argc) {
         switch (type) {
             case JS_ACTION_EVAL: {
                 if (argc == 2 &&
@@ -743,11 +1174,7 @@ public:
                     const char *filename = (const char *)arguments[1].ptrValue;
                     JSValue val = JS_Eval(context, code, strlen(code), filename, JS_EVAL_TYPE_GLOBAL);
                     if (JS_IsException(val)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         if (setArgument(results[0], val)) {
                             temp_results.push_back(val);
@@ -763,7 +1190,11 @@ public:
             case JS_ACTION_TO_STRING: {
                 if (argc == 1 && arguments[0].type == ARG_TYPE_MANAGED_VALUE) {
                     JSValue value = JS_MKPTR(JS_TAG_OBJECT, arguments[0].ptrValue);
-                    results[0].set(JS_ToCString(context, value));
+                    const char *str = JS_ToCString(context, value);
+                    if (!str) {
+                        return exceptionResult();
+                    }
+                    results[0].set(str);
                     return 1;
                 }
                 results[0].set("WrongArguments");
@@ -792,11 +1223,7 @@ public:
                         JS_FreeValue(context, val);
                         return 0;
                     } else {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     }
                 }
                 results[0].set("WrongArguments");
@@ -821,11 +1248,7 @@ public:
                     JS_FreeAtom(context, atom);
 
                     if (JS_IsException(val)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         if (setArgument(results[0], val)) {
                             temp_results.push_back(val);
@@ -861,11 +1284,7 @@ public:
                     JS_FreeAtom(context, atom);
 
                     if (JS_IsException(val)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         if (setArgument(results[0], val)) {
                             temp_results.push_back(val);
@@ -885,11 +1304,7 @@ public:
                     if (JS_IsConstructor(context, value)) {
                         JSValue ret = JS_CallConstructor(context, value, 1, &init_object);
                         if (JS_IsException(ret)) {
-                            JSValue ex = JS_GetException(context);
-                            temp_string = errorString(ex);
-                            JS_FreeValue(context, ex);
-                            results[0].set(temp_string.c_str());
-                            return -1;
+                            return exceptionResult();
                         } else {
                             if (JS_HasProperty(context, ret, private_key)) {
                                 temp_results.push_back(ret);
@@ -937,6 +1352,8 @@ public:
             }
             case JS_ACTION_WRAP_FUNCTION: {
                 JsFunction *func = new JsFunction();
+                func->context = this;
+                functions.insert(func);
                 JSValue data = JS_NewBigInt64(context, (int64_t)func);
                 JSValue value = JS_NewCFunctionDataFinalizer(
                         context, function_callback, 0, 0, 1,
@@ -974,11 +1391,7 @@ public:
                         }
 
                         if (JS_IsException(val)) {
-                            JSValue ex = JS_GetException(context);
-                            temp_string = errorString(ex);
-                            JS_FreeValue(context, ex);
-                            results[0].set(temp_string.c_str());
-                            return -1;
+                            return exceptionResult();
                         } else {
                             if (setArgument(results[0], val)) {
                                 temp_results.push_back(val);
@@ -1014,21 +1427,13 @@ public:
                     JSValue ret = JS_Eval(context, strcode.c_str(), strcode.size(), filename,
                             JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
                     if (JS_IsException(ret)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         int tag = JS_VALUE_GET_TAG(ret);
                         if (tag == JS_TAG_MODULE) {
                             JSValue val = JS_EvalFunction(context, ret);
                             if (JS_IsException(val)) {
-                                JSValue ex = JS_GetException(context);
-                                temp_string = errorString(ex);
-                                JS_FreeValue(context, ex);
-                                results[0].set(temp_string.c_str());
-                                return -1;
+                                return exceptionResult();
                             } else {
                                 JSModuleDef *module = (JSModuleDef *)JS_VALUE_GET_PTR(ret);
                                 JSValue data = JS_GetModuleDefault(context, module);
@@ -1068,11 +1473,7 @@ public:
                     JSValue ret = JS_Eval(context, strcode.c_str(), strcode.size(), filename,
                                           JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
                     if (JS_IsException(ret)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         int tag = JS_VALUE_GET_TAG(ret);
                         if (tag == JS_TAG_MODULE) {
@@ -1103,11 +1504,7 @@ public:
 
                     JSValue val = JS_EvalFunction(context, value);
                     if (JS_IsException(val)) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         JSModuleDef *module = (JSModuleDef *)JS_VALUE_GET_PTR(value);
                         JSValue data = JS_GetModuleDefault(context, module);
@@ -1154,11 +1551,7 @@ public:
                             context, &propertyEnum, &length, obj,
                             JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK);
                     if (ret < 0) {
-                        JSValue ex = JS_GetException(context);
-                        temp_string = errorString(ex);
-                        JS_FreeValue(context, ex);
-                        results[0].set(temp_string.c_str());
-                        return -1;
+                        return exceptionResult();
                     } else {
                         temp_string.clear();
                         for (int i = 0; i < length; ++i) {
@@ -1190,6 +1583,33 @@ public:
                 temp_results.push_back(obj);
                 return 1;
             }
+            case JS_ACTION_LOAD_PLUGIN: {
+                if (argc == 2 &&
+                    arguments[0].type == ARG_TYPE_STRING &&
+                    (arguments[1].type == ARG_TYPE_STRING || arguments[1].type == ARG_TYPE_NULL)) {
+                    const char *path = (const char *)arguments[0].ptrValue;
+                    JSValue exports = loadPlugin(path);
+                    if (JS_IsException(exports)) {
+                        results[0].set(temp_string.c_str());
+                        return -1;
+                    }
+                    if (arguments[1].type == ARG_TYPE_STRING) {
+                        JSValue global = JS_GetGlobalObject(context);
+                        int ret = JS_SetPropertyStr(context, global, (const char *)arguments[1].ptrValue,
+                                                    JS_DupValue(context, exports));
+                        JS_FreeValue(context, global);
+                        if (ret < 0) {
+                            JS_FreeValue(context, exports);
+                            return exceptionResult();
+                        }
+                    }
+                    results[0].setPointer(JS_VALUE_GET_PTR(exports));
+                    temp_results.push_back(exports);
+                    return 1;
+                }
+                results[0].set("WrongArguments");
+                return -1;
+            }
             case JS_ACTION_NEW_ARRAYBUFFER: {
                 if (argc == 2 &&
                 (arguments[0].type == ARG_TYPE_INT32 ||
@@ -1269,6 +1689,25 @@ public:
         return &tempArgument;
     }
 
+    void releaseValue(void *ptr) {
+        JS_FreeValue(context, JS_MKPTR(JS_TAG_OBJECT, ptr));
+    }
+
+    // dartHandles are the objects retained by Dart, one entry per
+    // reference, Dart keeps track of them so the bridge does not have to
+    int writeHeapSnapshot(const char *path, void **dartHandles, int count) {
+        vector<JSHeapSnapshotHandle> handles;
+        for (int i = 0; i < count; ++i) {
+            JSHeapSnapshotHandle handle = {"Dart handle", JS_MKPTR(JS_TAG_OBJECT, dartHandles[i])};
+            handles.push_back(handle);
+        }
+        for (auto it = temp_results.begin(); it != temp_results.end(); ++it) {
+            JSHeapSnapshotHandle handle = {"Dart temporary", *it};
+            handles.push_back(handle);
+        }
+        return JS_WriteHeapSnapshot(runtime, path, handles.data(), (int)handles.size());
+    }
+
     static void freeArrayBufferData(JSRuntime *rt, void *opaque, void *ptr) {
         uint8_t *buf = (uint8_t *)opaque;
         delete buf;
@@ -1282,6 +1721,8 @@ public:
                 .finalizer = class_finalizer,
         };
         JS_NewClass(runtime, classId, &def);
+        shared->classes[classId] = this;
+        classIds.push_back(classId);
 
         JSValue proto = JS_NewObject(context);
         JSValue thisData = JS_NewInt32(context, id);
@@ -1399,10 +1840,7 @@ public:
         JSValue value = JS_CallConstructor(context, ctor, 1, &func);
         JS_FreeValue(context, func);
         if (JS_IsException(value)) {
-            JSValue ex = JS_GetException(context);
-            temp_string = errorString(ex);
-            results[0].set(temp_string.c_str());
-            JS_FreeValue(context, ex);
+            exceptionResult();
             pro->free(context);
             delete pro;
             return nullptr;
@@ -1413,14 +1851,23 @@ public:
     }
 
     static void print(JsContext *that, int type, const char *format, ...) {
+        if (!that || !that->console.enabled(type)) return;
         va_list vlist;
-        char str[1024];
+        char buf[1024];
         va_start(vlist, format);
-        vsnprintf(str, 1024, format, vlist);
+        int len = vsnprintf(buf, sizeof(buf), format, vlist);
         va_end(vlist);
-        str[1023] = 0;
-        if (that && that->handlers.print)
-            that->handlers.print(type, str);
+        if (len < 0) return;
+        string str;
+        if (len < (int)sizeof(buf)) {
+            str.assign(buf, len);
+        } else {
+            str.resize(len);
+            va_start(vlist, format);
+            vsnprintf(&str[0], len + 1, format, vlist);
+            va_end(vlist);
+        }
+        that->console.add(type, std::move(str));
     }
 
     bool hasPendingJob() {
@@ -1430,11 +1877,14 @@ public:
     int executePendingJob() {
         JSContext  *context;
         int ret = JS_ExecutePendingJob(runtime, &context);
+        console.flush();
         if (ret == -1) {
             JSValue ex = JS_GetException(context);
-            temp_string = errorString(ex);
-            results[0].set(temp_string.c_str());
-            JS_FreeValue(context, ex);
+            if (setArgument(results[0], ex)) {
+                temp_results.push_back(ex);
+            } else {
+                JS_FreeValue(context, ex);
+            }
         }
         return ret;
     }
@@ -1468,14 +1918,24 @@ extern void JS_Log(const char *format, ...) {
     }
 }
 
+JsRuntime *newJsRuntime() {
+    return new JsRuntime();
+}
+
+void releaseJsRuntime(JsRuntime *runtime) {
+    runtime->release();
+}
+
 JsContext *setupJsContext(
         JsArgument *arguments,
         JsArgument *results,
-        JsHandlers *handlers) {
+        JsHandlers *handlers,
+        JsRuntime *runtime) {
     return new JsContext(
             arguments,
             results,
-            handlers);
+            handlers,
+            runtime);
 }
 
 void deleteJsContext(JsContext *self) {
@@ -1508,9 +1968,7 @@ JsArgument *jsContextRetainValue(JsContext *self, void *ptr) {
 }
 
 void jsContextReleaseValue(JsContext *self, void *ptr) {
-    JSValue value = JS_MKPTR(JS_TAG_OBJECT, ptr);
-    JSContext *context = self->context;
-    JS_FreeValue(context, value);
+    self->releaseValue(ptr);
 }
 
 void jsContextClearCache(JsContext *self) {
@@ -1533,6 +1991,86 @@ int jsContextExecutePendingJob(JsContext *self) {
     return self->executePendingJob();
 }
 
+int jsContextRunGCSlice(JsContext *self, int64_t budget) {
+    return JS_RunGCSlice(self->runtime, budget);
+}
+
+void jsContextSetGCSliceBudget(JsContext *self, int64_t budget) {
+    JS_SetGCSliceBudget(self->runtime, budget);
+}
+
+void jsContextSetGCNurserySize(JsContext *self, int64_t size) {
+    JS_SetGCNurserySize(self->runtime, (size_t)size);
+}
+
+void jsContextGetGCStats(JsContext *self, JSGCStats *stats) {
+    JS_GetGCStats(self->runtime, stats);
+}
+
+void jsContextSetRegExpCacheSize(JsContext *self, int size) {
+    JS_SetRegExpCacheSize(self->runtime, size);
+}
+
+void jsContextGetRegExpCacheStats(JsContext *self, JSRegExpCacheStats *stats) {
+    JS_GetRegExpCacheStats(self->runtime, stats);
+}
+
+int jsContextStartProfiling(JsContext *self, int64_t interval) {
+    return JS_StartProfiling(self->runtime, interval);
+}
+
+int jsContextStopProfiling(JsContext *self, const char *path) {
+    return JS_StopProfiling(self->runtime, path);
+}
+
+int jsContextStartAllocProfiling(JsContext *self, int64_t interval) {
+    return JS_StartAllocProfiling(self->runtime, (size_t)interval);
+}
+
+int jsContextDumpAllocProfile(JsContext *self, const char *path) {
+    return JS_DumpAllocProfile(self->runtime, path);
+}
+
+void jsContextStopAllocProfiling(JsContext *self) {
+    JS_StopAllocProfiling(self->runtime);
+}
+
+int jsContextWriteHeapSnapshot(JsContext *self, const char *path, void **handles, int count) {
+    return self->writeHeapSnapshot(path, handles, count);
+}
+
+int jsContextStartTracing(JsContext *self, const char *path) {
+    if (self->tracer) return -1;
+    FILE *file = nullptr;
+    if (path) {
+        file = fopen(path, "w");
+        if (!file) return -1;
+    }
+    self->tracer = new BridgeTracer(file);
+    return 0;
+}
+
+void jsContextStopTracing(JsContext *self) {
+    delete self->tracer;
+    self->tracer = nullptr;
+}
+
+int jsContextGetActionStats(JsContext *self, int dart, int type, JsActionStats *stats) {
+    if (!self->tracer || type < 0 || type >= ACTION_TYPE_COUNT) return -1;
+    *stats = dart ? self->tracer->dartActions[type] : self->tracer->jsActions[type];
+    return 0;
+}
+
+void jsContextSetConsole(JsContext *self, int level, int bufferSize, int flags) {
+    self->console.setCapacity(bufferSize > 0 ? bufferSize : 0);
+    self->console.level = level;
+    self->console.flags = flags;
+}
+
+void jsContextFlushConsole(JsContext *self) {
+    self->console.flush();
+}
+
 void jsContextSetup() {}
 
 }
@@ -116,6 +116,12 @@ void *JS_GetOpaque3(JSValueConst obj) {
     return p->u.opaque;
 }
 
+JSClassID JS_GetClassID3(JSValueConst obj) {
+    if (JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return 0;
+    return JS_VALUE_GET_OBJ(obj)->class_id;
+}
+
 JSValue require_handler(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     JSValue ret = JS_UNDEFINED;
     if (argc > 0) {
@@ -35,6 +35,7 @@ typedef void (*JS_ForEachFunction)(JSContext *ctx, void *data, int argc, JSValue
 void JS_ArrayForEach(JSContext *ctx, JSValue value, JS_ForEachFunction func, void *data);
 
 void *JS_GetOpaque3(JSValueConst obj);
+JSClassID JS_GetClassID3(JSValueConst obj);
 
 void JS_AddIntrinsicRequire(JSContext *ctx);
 void JS_AddIntrinsicWorker(JSContext *ctx);
@@ -44,6 +45,18 @@ JSValue JS_GetModuleDefault(JSContext *ctx, JSModuleDef *module);
 typedef JSValue (*JS_PromiseCallback)(JSContext *ctx, JSValue value);
 void JS_SetPromiseTransform(JS_PromiseCallback callback);
 
+/* Native plugins are shared libraries exporting JS_PLUGIN_INIT_NAME. The
+   init function defines its functions and classes (JS_NewCFunction,
+   JS_NewClass...) on 'exports' and returns 0, or -1 with a pending
+   exception. The plugins must use the JS_* functions of the library
+   which loads them:
+   - Linux and Android: leave them undefined (no -lqjs). The library
+     makes its symbols global before loading the first plugin.
+   - macOS and iOS: link with '-undefined dynamic_lookup'.
+   - Windows: link with the import library of the plugin DLL. */
+#define JS_PLUGIN_INIT_NAME "js_init_plugin"
+typedef int JS_PluginInitFunction(JSContext *ctx, JSValueConst exports);
+
 void jsContextSetup();
 
 #ifdef __cplusplus
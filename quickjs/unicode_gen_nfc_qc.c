@@ -0,0 +1,293 @@
+/*
+ * Generation of the NFC_Quick_Check tables (libunicode-nfc-qc.h)
+ *
+ * The tables are derived from the decomposition and composition
+ * tables of libunicode-table.h so that they agree with
+ * unicode_normalize(). Usage:
+ *
+ *   gcc -O2 -I. -o unicode_gen_nfc_qc unicode_gen_nfc_qc.c cutils.c
+ *   ./unicode_gen_nfc_qc libunicode-nfc-qc.h
+ *   ./unicode_gen_nfc_qc -check
+ *
+ * '-check' compares unicode_nfc_quick_check(), built with the current
+ * libunicode-nfc-qc.h, with unicode_normalize() for all the code
+ * points and fails if they disagree.
+ */
+#include "libunicode.c"
+
+#define CHARCODE_MAX 0x110000
+
+/* 1 if NFC_Quick_Check = No or Maybe */
+static uint8_t nfc_qc[CHARCODE_MAX];
+
+static uint8_t qc_table[65536];
+static int qc_table_len;
+static uint8_t qc_index[4096];
+static int qc_index_len;
+
+static uint8_t bmp_index[256];
+static uint32_t bmp_table[256 * 8];
+static int bmp_page_count;
+
+static void __attribute__((noreturn, format(printf, 1, 2))) error(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void build_nfc_qc(void)
+{
+    uint32_t c, idx1, d_idx, d_off, v, code, len, type, pair[2], *out;
+    int i, n;
+
+    /* Maybe: the second character of each composition pair */
+    for(i = 0; i < countof(unicode_comp_table); i++) {
+        idx1 = unicode_comp_table[i];
+        d_idx = idx1 >> 6;
+        d_off = idx1 & 0x3f;
+        v = unicode_decomp_table1[d_idx];
+        code = v >> (32 - 18);
+        len = (v >> (32 - 18 - 7)) & 0x7f;
+        type = (v >> (32 - 18 - 7 - 6)) & 0x3f;
+        if (unicode_decomp_entry(pair, code + d_off, d_idx, code,
+                                 len, type) != 2)
+            error("invalid composition pair for U+%04X", code + d_off);
+        nfc_qc[pair[1]] = 1;
+    }
+    /* Maybe: the Hangul V and T jamos, with the ranges used by the
+       Hangul composition of compose_pair() */
+    for(c = 0x1161; c < 0x1161 + 21; c++)
+        nfc_qc[c] = 1;
+    for(c = 0x11a7; c < 0x11a7 + 28; c++)
+        nfc_qc[c] = 1;
+    /* No: the other characters not preserved by NFC */
+    for(c = 0; c < CHARCODE_MAX; c++) {
+        if (nfc_qc[c])
+            continue;
+        n = unicode_normalize(&out, &c, 1, UNICODE_NFC, NULL,
+                              cr_default_realloc);
+        if (n < 0)
+            error("unicode_normalize failed for U+%04X", c);
+        if (n != 1 || out[0] != c)
+            nfc_qc[c] = 1;
+        free(out);
+    }
+}
+
+static void add_index(uint32_t v)
+{
+    qc_index[qc_index_len++] = v;
+    qc_index[qc_index_len++] = v >> 8;
+    qc_index[qc_index_len++] = v >> 16;
+}
+
+static void add_run(uint32_t len)
+{
+    len--;
+    if (len < 0x80) {
+        qc_table[qc_table_len++] = 0x80 + len;
+    } else if (len < 0x2000) {
+        qc_table[qc_table_len++] = 0x40 + (len >> 8);
+        qc_table[qc_table_len++] = len;
+    } else {
+        qc_table[qc_table_len++] = 0x60 + (len >> 16);
+        qc_table[qc_table_len++] = len >> 8;
+        qc_table[qc_table_len++] = len;
+    }
+}
+
+/* same compressed format as the unicode_prop_* tables: alternating
+   lengths of the runs outside and inside the set, with an index entry
+   every UNICODE_INDEX_BLOCK_LEN bytes (see lre_is_in_table()) */
+static void encode_nfc_qc(void)
+{
+    uint32_t c, start, code, len0, len1;
+    int block_end, offset;
+
+    qc_table_len = 0;
+    qc_index_len = 0;
+    block_end = UNICODE_INDEX_BLOCK_LEN;
+    code = 0;
+    c = 0;
+    for(;;) {
+        start = c;
+        while (c < CHARCODE_MAX && !nfc_qc[c])
+            c++;
+        if (c == CHARCODE_MAX)
+            break;
+        len0 = c - start;
+        start = c;
+        while (c < CHARCODE_MAX && nfc_qc[c])
+            c++;
+        len1 = c - start;
+        if (len0 == 0)
+            error("the set must not contain U+0000");
+
+        if (qc_table_len >= block_end) {
+            offset = qc_table_len - block_end;
+            if (offset >= 8)
+                error("index offset overflow");
+            add_index(code | (offset << 21));
+            block_end += UNICODE_INDEX_BLOCK_LEN;
+        }
+        if (len0 <= 8 && len1 <= 8) {
+            qc_table[qc_table_len++] = ((len0 - 1) << 3) | (len1 - 1);
+        } else {
+            add_run(len0);
+            add_run(len1);
+        }
+        code += len0 + len1;
+    }
+    add_index(code);
+
+    for(c = 0; c < CHARCODE_MAX; c++) {
+        if (lre_is_in_table(c, qc_table, qc_index, qc_index_len / 3) !=
+            nfc_qc[c])
+            error("encoding error at U+%04X", c);
+    }
+}
+
+/* BMP bitmap of the characters for which unicode_nfc_quick_check() is
+   not 0 */
+static void build_bmp_bitmap(void)
+{
+    uint32_t c;
+    int block, i;
+    BOOL found;
+
+    bmp_page_count = 0;
+    for(block = 0; block < 256; block++) {
+        found = FALSE;
+        for(i = 0; i < 256; i++) {
+            c = block * 256 + i;
+            if (nfc_qc[c] || unicode_get_cc(c) != 0) {
+                if (!found) {
+                    found = TRUE;
+                    bmp_index[block] = ++bmp_page_count;
+                }
+                bmp_table[(bmp_page_count - 1) * 8 + (i >> 5)] |=
+                    1U << (i & 31);
+            }
+        }
+    }
+}
+
+static void dump_byte_table(FILE *f, const char *name,
+                            const uint8_t *tab, int len)
+{
+    int i;
+
+    fprintf(f, "static const uint8_t %s[%d] = {", name, len);
+    for(i = 0; i < len; i++) {
+        if (i % 8 == 0)
+            fprintf(f, "\n   ");
+        fprintf(f, " 0x%02x,", tab[i]);
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+static void dump_u32_table(FILE *f, const char *name,
+                           const uint32_t *tab, int len)
+{
+    int i;
+
+    fprintf(f, "static const uint32_t %s[%d] = {", name, len);
+    for(i = 0; i < len; i++) {
+        if (i % 4 == 0)
+            fprintf(f, "\n   ");
+        fprintf(f, " 0x%08x,", tab[i]);
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+static void dump_header(FILE *f)
+{
+    fprintf(f,
+            "/* NFC_Quick_Check tables */\n"
+            "/*\n"
+            " * Generated by unicode_gen_nfc_qc.c from the tables of\n"
+            " * libunicode-table.h so that they agree with unicode_normalize():\n"
+            " *\n"
+            " * - unicode_nfc_qc_table/unicode_nfc_qc_index: the characters with\n"
+            " *   NFC_Quick_Check = No or Maybe. Maybe is the second character of\n"
+            " *   each pair of unicode_comp_table plus the Hangul V and T jamos\n"
+            " *   (U+1161-U+1175, U+11A7-U+11C2). No is every other character that\n"
+            " *   unicode_normalize(UNICODE_NFC) does not map to itself. They use the\n"
+            " *   same compressed format as the unicode_prop_* tables, read by\n"
+            " *   lre_is_in_table().\n"
+            " *\n"
+            " * - unicode_nfc_qc_bmp_index/unicode_nfc_qc_bmp_table: a two level\n"
+            " *   bitmap of the BMP characters for which unicode_nfc_quick_check()\n"
+            " *   is not 0. unicode_nfc_qc_bmp_index gives the 1 based 256 bit page\n"
+            " *   of each 256 character block, or 0 when the block has none.\n"
+            " *\n"
+            " * Regenerate them when libunicode-table.h is updated and check them\n"
+            " * with 'unicode_gen_nfc_qc -check'.\n"
+            " */\n"
+            "\n"
+            "#ifdef CONFIG_ALL_UNICODE\n"
+            "\n");
+    dump_byte_table(f, "unicode_nfc_qc_table", qc_table, qc_table_len);
+    dump_byte_table(f, "unicode_nfc_qc_index", qc_index, qc_index_len);
+    dump_byte_table(f, "unicode_nfc_qc_bmp_index", bmp_index, 256);
+    dump_u32_table(f, "unicode_nfc_qc_bmp_table", bmp_table,
+                   bmp_page_count * 8);
+    fprintf(f, "#endif /* CONFIG_ALL_UNICODE */\n");
+}
+
+/* compare unicode_nfc_quick_check() with the result derived from
+   unicode_normalize() */
+static int check_nfc_qc(void)
+{
+    uint32_t c;
+    int expected, res, errors;
+
+    errors = 0;
+    for(c = 0; c < CHARCODE_MAX; c++) {
+        expected = nfc_qc[c] ? -1 : unicode_get_cc(c);
+        res = unicode_nfc_quick_check(c);
+        if (res != expected) {
+            if (errors < 20) {
+                fprintf(stderr, "U+%04X: unicode_nfc_quick_check()=%d, expected %d\n",
+                        c, res, expected);
+            }
+            errors++;
+        }
+    }
+    if (errors) {
+        fprintf(stderr, "%d errors: regenerate libunicode-nfc-qc.h\n", errors);
+        return 1;
+    }
+    printf("unicode_nfc_quick_check: OK\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+
+    if (argc < 2) {
+        printf("usage: %s libunicode-nfc-qc.h\n"
+               "       %s -check\n", argv[0], argv[0]);
+        exit(1);
+    }
+    build_nfc_qc();
+    if (!strcmp(argv[1], "-check"))
+        return check_nfc_qc();
+
+    encode_nfc_qc();
+    build_bmp_bitmap();
+    f = fopen(argv[1], "wb");
+    if (!f) {
+        perror(argv[1]);
+        exit(1);
+    }
+    dump_header(f);
+    fclose(f);
+    return 0;
+}
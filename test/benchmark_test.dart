@@ -0,0 +1,209 @@
+import 'package:flutter_test/flutter_test.dart';
+import 'package:js_script/js_script.dart';
+import 'package:js_script/js_script_io.dart';
+
+/// Evaluates [setup], which must define a global `run()`, then calls
+/// `run()` [rounds] times and prints the best time.
+///
+/// Run with `flutter test test/benchmark_test.dart`.
+void bench(String name, String setup, dynamic expected, {
+  int rounds = 5,
+  JsScript Function()? create,
+}) {
+  test(name, () {
+    JsScript script = create == null ? JsScript() : create();
+    script.eval(setup);
+    int best = -1;
+    for (int i = 0; i < rounds; ++i) {
+      Stopwatch watch = Stopwatch()..start();
+      dynamic result = script.eval("run()");
+      watch.stop();
+      expect(result, expected);
+      if (best < 0 || watch.elapsedMicroseconds < best) {
+        best = watch.elapsedMicroseconds;
+      }
+    }
+    print("$name: ${(best / 1000).toStringAsFixed(2)} ms");
+
+    script.dispose();
+  });
+}
+
+void main() {
+  // about 3MB of records with the same shape
+  bench('JSON.parse', r"""
+    var records = [];
+    for (var i = 0; i < 40000; ++i) {
+      records.push({id: i, name: 'item' + i, price: i * 0.25,
+                    tags: ['a', 'b'], active: i % 2 == 0});
+    }
+    var payload = JSON.stringify(records);
+    function run() {
+      var list = JSON.parse(payload);
+      return list.length + ':' + (payload.length > 2 * 1024 * 1024);
+    }
+  """, "40000:true");
+
+  // 's += x' building about 5MB of HTML
+  bench('string append', r"""
+    function run() {
+      var html = '<table>';
+      for (var i = 0; i < 100000; ++i) {
+        html += '<tr><td>' + i + '</td><td class="name">row ' + i + '</td></tr>\n';
+      }
+      html += '</table>';
+      return html.length > 4 * 1024 * 1024;
+    }
+  """, true);
+
+  // indexOf, equality, split, replace and toLowerCase on about 1MB of
+  // 8-bit and of 16-bit text
+  bench('string search and case mapping', r"""
+    function corpus(word) {
+      var text = '';
+      for (var i = 0; i < 20000; ++i) {
+        text += 'The Quick Brown ' + word + ' ' + i + ' jumps over the lazy dog; ';
+      }
+      return text;
+    }
+    var latin1 = [corpus('Fox'), corpus('Fox')];
+    var wide = [corpus('Fox—'), corpus('Fox—')];
+    function search(texts, needle) {
+      var text = texts[0], n = 0;
+      for (var i = 0; i < 200; ++i) n += text.indexOf(needle) > 0;
+      for (var i = 0; i < 200; ++i) n += text == texts[1];
+      n += text.split('; ').length;
+      n += text.replace(/lazy/g, 'busy').length == text.length;
+      n += text.toLowerCase().length == text.length;
+      return n;
+    }
+    function run() {
+      return search(latin1, 'Fox 19999') + ':' + search(wide, 'Fox— 19999');
+    }
+  """, "20403:20403");
+
+  // insert, lookup and iterate 200k entries
+  bench('Map and Set', r"""
+    function run() {
+      var map = new Map(), set = new Set();
+      for (var i = 0; i < 200000; ++i) {
+        map.set('k' + i, i);
+        set.add(i);
+      }
+      var hits = 0;
+      for (var i = 0; i < 200000; ++i) {
+        if (map.get('k' + i) === i && set.has(i)) hits++;
+      }
+      var sum = 0;
+      for (var [k, v] of map) sum += v;
+      for (var v of set) sum -= v;
+      return hits + ':' + sum;
+    }
+  """, "200000:0");
+
+  // log scanning over about 2MB: a literal prefix, an alternation, a
+  // case insensitive pattern, one without a prefilter and a replace
+  bench('RegExp log scan', r"""
+    var lines = [];
+    for (var i = 0; i < 40000; ++i) {
+      lines.push(i % 10 == 0 ?
+        '2024-01-01 12:00:00 ERROR: Timeout' + i + ' in worker' :
+        '2024-01-01 12:00:00 INFO: request ' + i + ' served in 12ms');
+    }
+    var log = lines.join('\n');
+    function count(re) {
+      var n = 0;
+      while (re.exec(log) !== null) n++;
+      return n;
+    }
+    function run() {
+      return [
+        count(/ERROR: (\w+)/g),
+        count(/(?:WARN|ERROR): Timeout/g),
+        count(/error: \w+/gi),
+        count(/\d+ms/g),
+        log.replace(/ERROR: (\w+)/g, 'E[$1]').length < log.length,
+        log.length > 1024 * 1024,
+      ].join();
+    }
+  """, "4000,4000,4000,36000,true,true");
+
+  // context creation and plain arithmetic for each intrinsics profile
+  for (JsIntrinsics intrinsics in JsIntrinsics.values) {
+    test('startup ${intrinsics.name}', () {
+      const int count = 50;
+      Stopwatch watch = Stopwatch()..start();
+      for (int i = 0; i < count; ++i) {
+        IOJsScript(intrinsics: intrinsics).dispose();
+      }
+      watch.stop();
+      print("startup ${intrinsics.name}: "
+          "${(watch.elapsedMicroseconds / count / 1000).toStringAsFixed(3)} ms");
+    });
+
+    bench('arithmetic ${intrinsics.name}', r"""
+      function run() {
+        var s = 0, f = 0.5, b = 0n;
+        for (var i = 0; i < 1000000; ++i) {
+          s = (s + i * 3) % 1000003;
+          f = f * 1.000001 + 0.25;
+          if ((i & 1023) == 0) b += BigInt(i) * 12345678901n;
+        }
+        return s + ':' + (f > 0) + ':' + b;
+      }
+    """, "18:true:6027390365392052224",
+        create: () => IOJsScript(intrinsics: intrinsics));
+  }
+
+  // a 2048-bit modular exponentiation, then multiplication and division
+  // from 64 to 65536 bits
+  bench('BigInt', r"""
+    var seed = 7;
+    function rnd(bits) {
+      var x = 1n;
+      for (var i = 0; i < bits; i += 16) {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        x = (x << 16n) | BigInt(seed & 0xffff);
+      }
+      return x;
+    }
+    var m = rnd(2048) | 1n, base = rnd(2000), e = rnd(2048);
+    var sizes = [];
+    for (var bits = 64; bits <= 65536; bits *= 4) {
+      sizes.push([rnd(bits), rnd(bits >> 1)]);
+    }
+    function run() {
+      var ok = BigInt.powMod(base, e, m) < m;
+      for (var [a, c] of sizes) {
+        for (var k = 0; k < 10; ++k) {
+          var p = a * c;
+          ok = ok && p / c == a && (p + 1n) % c == 1n;
+        }
+      }
+      return ok;
+    }
+  """, true);
+
+  // case mapping and normalization of ASCII, Latin-1 and non Latin text
+  bench('toUpperCase and normalize', r"""
+    function corpus(parts) {
+      var text = '';
+      for (var i = 0; i < 20000; ++i) text += parts[i % parts.length];
+      return text;
+    }
+    var corpora = [
+      corpus(['hello world ', 'The Quick Brown Fox ']),
+      corpus(['Straße ', 'ÉCOLE élève ', 'café ', 'naïve ']),
+      corpus(['ΣΊΣΥΦΟΣ ', '한국어 ', 'ǅemal ', 'ﬁ ligature ', 'é ']),
+    ];
+    function run() {
+      var lengths = [];
+      for (var text of corpora) {
+        lengths.push(text.toUpperCase().length, text.toLowerCase().length,
+                     text.normalize('NFC').length, text.normalize('NFD').length);
+      }
+      return lengths.join();
+    }
+  """, "320000,320000,320000,320000,155000,150000,150000,175000,"
+      "132000,128000,124000,152000");
+}
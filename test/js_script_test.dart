@@ -1,6 +1,7 @@
 import 'package:flutter/services.dart';
 import 'package:flutter_test/flutter_test.dart';
 import 'package:js_script/js_script.dart';
+import 'package:js_script/js_script_io.dart';
 
 void main() {
   const MethodChannel channel = MethodChannel('js_script');
@@ -24,4 +25,225 @@ void main() {
 
     script.dispose();
   });
+
+  test('string append with a toString changing the variable', () {
+    JsScript script = JsScript();
+    // the generator frame holding `s` is freed by toString
+    expect(script.eval(r"""
+      function* gen() {
+        let s = "x".repeat(300);
+        yield (o) => { s = s + o; return s; };
+      }
+      let it = gen();
+      let f = it.next().value;
+      f({ toString() { it = null; return "y"; } }) === "x".repeat(300) + "y";
+    """), true);
+    expect(script.eval(r"""
+      let t = "a".repeat(300);
+      function g(o) { t = t + o; return t; }
+      let r = g({ toString() { t = "b"; return "c"; } });
+      r === "a".repeat(300) + "c" && t === r;
+    """), true);
+
+    script.dispose();
+  });
+
+  test('BigInt.powMod', () {
+    JsScript script = JsScript();
+    // compared with square and multiply, then the edge cases: m = 1,
+    // e = 0, even m, negative a and the invalid arguments
+    expect(script.eval(r"""
+      function ref(a, e, m) {
+        let r = 1n % m;
+        a = ((a % m) + m) % m;
+        while (e > 0n) {
+          if (e & 1n) r = r * a % m;
+          a = a * a % m;
+          e >>= 1n;
+        }
+        return r;
+      }
+      let seed = 1;
+      function rnd(bits) {
+        let x = 0n;
+        for (let i = 0; i < bits; i += 16) {
+          seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+          x = (x << 16n) | BigInt(seed & 0xffff);
+        }
+        return x;
+      }
+      let ok = true;
+      for (let i = 0; i < 300; i++) {
+        let bits = [8, 64, 65, 130, 520, 1100][i % 6];
+        let a = rnd(bits) - rnd(bits), e = rnd(bits >> (i % 3)), m = rnd(bits) + 1n;
+        if (BigInt.powMod(a, e, m) !== ref(a, e, m)) ok = false;
+      }
+      let edge = BigInt.powMod(5n, 3n, 1n) === 0n &&
+        BigInt.powMod(7n, 0n, 13n) === 1n &&
+        BigInt.powMod(7n, 0n, 1n) === 0n &&
+        BigInt.powMod(3n, 5n, 16n) === 243n % 16n &&
+        BigInt.powMod(-3n, 3n, 10n) === 3n &&
+        BigInt.powMod(0n, 0n, 7n) === 1n &&
+        BigInt.powMod(2n, 1000n, 2n ** 64n) === 0n;
+      let errs = 0;
+      try { BigInt.powMod(2n, -1n, 7n); } catch (e) { if (e instanceof RangeError) errs++; }
+      try { BigInt.powMod(2n, 3n, 0n); } catch (e) { if (e instanceof RangeError) errs++; }
+      try { BigInt.powMod(2n, 3n, -7n); } catch (e) { if (e instanceof RangeError) errs++; }
+      [ok, edge, errs].join();
+    """), "true,true,3");
+
+    script.dispose();
+  });
+
+  test('BigInt multiplication and division', () {
+    JsScript script = JsScript();
+    // sizes on both sides of the Karatsuba, FFT and large division
+    // thresholds
+    expect(script.eval(r"""
+      let seed = 7;
+      function rnd(bits) {
+        let x = 1n;
+        for (let i = 0; i < bits; i += 16) {
+          seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+          x = (x << 16n) | BigInt(seed & 0xffff);
+        }
+        return x;
+      }
+      let ok = true;
+      for (let bits of [64, 1000, 3000, 6400, 12800, 25600, 30000, 60000]) {
+        for (let k = 0; k < 3; k++) {
+          let a = rnd(bits), b = rnd(bits >> k), c = rnd(bits >> 1);
+          let p = a * b;
+          if (p / b !== a || p % b !== 0n) ok = false;
+          if (a * (b + c) !== p + a * c) ok = false;
+          let q = p / c, r = p % c;
+          if (q * c + r !== p || r < 0n || r >= c) ok = false;
+        }
+      }
+      ok;
+    """), true);
+
+    script.dispose();
+  });
+
+  test('console label conversion error', () {
+    JsScript script = JsScript();
+    expect(script.eval(r"""
+      let errors = 0;
+      try { console.count(Symbol('s')); } catch (e) { if (e instanceof TypeError) errors++; }
+      try { console.time(Symbol('s')); } catch (e) { if (e instanceof TypeError) errors++; }
+      errors;
+    """), 2);
+
+    script.dispose();
+  });
+
+  test('console output', () {
+    List<String> lines = [];
+    IOJsScript script = IOJsScript();
+    script.onConsole = (level, message) => lines.add("${level.name}:$message");
+    script.eval(r"""
+      console.log('a', 1);
+      console.log('two\nlines');
+      console.warn('w');
+      console.count(); console.count(); console.count('k');
+      console.countReset(); console.count(); console.countReset('nope');
+      console.time('t'); console.timeEnd('t'); console.timeEnd('t');
+    """);
+    expect(lines.length, 10);
+    expect(lines.sublist(0, 8), [
+      "log:a,1",
+      "log:two\nlines",
+      "warn:w",
+      "log:default: 1",
+      "log:default: 2",
+      "log:k: 1",
+      "log:default: 1",
+      "warn:Count for 'nope' does not exist",
+    ]);
+    expect(lines[8], matches(r"^log:t: \d+\.\d{3}ms$"));
+    expect(lines[9], "warn:Timer 't' does not exist");
+
+    script.dispose();
+  });
+
+  test('console level, buffer size and timestamps', () {
+    List<String> lines = [];
+    IOJsScript script = IOJsScript();
+    script.onConsole = (level, message) => lines.add("${level.name}:$message");
+    // the filtered arguments are not converted
+    script.setConsole(level: JsConsoleLevel.warn);
+    script.eval(r"""
+      console.log('hidden', { toString() { throw new Error('converted'); } });
+      console.count('c');
+      console.warn('shown');
+      console.error('error');
+    """);
+    expect(lines, ["warn:shown", "error:error"]);
+
+    lines.clear();
+    script.setConsole(bufferSize: 0);
+    script.eval(r"""
+      for (let i = 0; i < 3; i++) console.log(i);
+      console.count('c');
+    """);
+    expect(lines, ["log:0", "log:1", "log:2", "log:c: 2"]);
+
+    lines.clear();
+    script.setConsole(timestamps: true);
+    script.eval("console.log('x')");
+    expect(lines.single, matches(r"^log:\[\d+\.\d{3}\] x$"));
+
+    lines.clear();
+    script.setConsole(level: JsConsoleLevel.none);
+    script.eval("console.error('dropped')");
+    expect(lines, isEmpty);
+
+    script.dispose();
+  });
+
+  test('JsException after dispose', () {
+    JsScript script = JsScript();
+    List<JsException> exceptions = [];
+    for (int i = 0; i < 2; ++i) {
+      try {
+        script.eval(r"""
+          function fail() { throw new TypeError("bad value"); }
+          fail();
+        """);
+      } on JsException catch (e) {
+        exceptions.add(e);
+      }
+    }
+    // only the resolved exception is formatted before dispose
+    exceptions[0].resolve();
+    script.dispose();
+
+    expect(exceptions[0].message, "TypeError: bad value");
+    expect(exceptions[0].stack, contains("at fail"));
+    expect(exceptions[0].toString(), startsWith("TypeError: bad value\n"));
+    expect(exceptions[1].message, "[Disposed JsValue]");
+    expect(exceptions[1].stack, null);
+    expect(exceptions[1].toString(), "[Disposed JsValue]");
+  });
+
+  test('JsException with a throwing toString', () {
+    JsScript script = JsScript();
+    JsException? exception;
+    try {
+      script.eval(r"""
+        throw {
+          toString() { throw new Error("toString"); },
+          get stack() { throw new Error("stack"); },
+        };
+      """);
+    } on JsException catch (e) {
+      exception = e;
+    }
+    expect(exception!.message, "[Unprintable JsValue]");
+    expect(exception.stack, null);
+    expect(exception.toString(), "[Unprintable JsValue]");
+
+    script.dispose();
+  });
 }